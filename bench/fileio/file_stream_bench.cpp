@@ -0,0 +1,975 @@
+// Submission cost of random reads through file_stream.
+//
+// Runs 10k random 4 KiB reads from a set of concurrent readers and reports
+// how many io_uring_enter calls were needed.  Before submissions were
+// batched per scheduler turn, every read made its own call, so the
+// unbatched figure equals the number of reads.
+//
+// A second run starts far more readers than a small ring can hold to show
+// the excess waiting for room instead of failing.
+//
+// The hot read runs compare small cached reads into ordinary memory with
+// reads into buffers leased from the registered pool (READ_FIXED), and
+// plain descriptors with the registered file table (IOSQE_FIXED_FILE),
+// reporting CPU time per read.
+//
+// The queue depth runs keep 64 positional reads in flight against one
+// file_stream and compare the rate with 64 file_streams each doing
+// read_some on the same file.
+//
+// The article write runs store header + body + trailer records three ways:
+// one writev of the segments, a copy into a staging buffer and one write,
+// and one write per segment.
+//
+// The completion rate run keeps 256 cached reads in flight on one thread
+// and reports completions per second and the average number of
+// completions harvested per poll.
+//
+// The record lookup runs fetch random 256-byte records from the data file
+// through a mapped_file and through file_stream read_at, reporting
+// lookups per second.
+//
+// The ring sharding runs spread cached positional reads over 1 to 8
+// threads running one io_context, first with every thread sharing one
+// ring and then with a ring per thread, reporting total IOPS.
+//
+// The cold scan runs drop the data file from the page cache and read it
+// front to back in 256 KiB chunks, once with default readahead, once after
+// advise(sequential), and once prefetching the next few chunks ahead of
+// the reader, reporting MB/s.
+//
+// The article serving runs send 1 MiB binary articles from a cached spool
+// file to a loopback TCP connection with splice_to, once splicing through a
+// pipe and once copying through a buffer, reporting MB/s and CPU time per
+// article. The CPU time includes the thread draining the connection.
+//
+// The small append runs write 1M 100-byte overview records to a file, once
+// with a write_some per record and once through a buffered_file_writer with
+// 256 KiB blocks and two blocks in flight, reporting records per second and
+// entries submitted to the ring.
+
+#include <fileio/buffered_file_writer.h>
+#include <fileio/direct_writer.h>
+#include <fileio/file_service.h>
+#include <fileio/file_stream.h>
+#include <fileio/mapped_file.h>
+
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <boost/corosio/io_context.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace nntp;
+using namespace boost;
+
+namespace
+{
+
+constexpr std::size_t FILE_SIZE{64 * 1024 * 1024};
+constexpr std::size_t BLOCK_SIZE{4096};
+constexpr std::size_t READ_COUNT{10000};
+constexpr std::size_t READERS{32};
+constexpr unsigned BURST_QUEUE_DEPTH{8};
+constexpr std::size_t BURST_READERS{512};
+constexpr std::size_t HOT_READ_SIZE{512};
+constexpr std::size_t HOT_READ_COUNT{200000};
+constexpr std::size_t HOT_SPAN{1024 * 1024};
+constexpr std::size_t QUEUE_DEPTH_READERS{64};
+constexpr std::size_t QUEUE_DEPTH_READS{100000};
+constexpr std::size_t ARTICLE_WRITES{50000};
+constexpr std::size_t ARTICLE_BODY_SIZE{2048};
+
+constexpr std::size_t SPOOL_BYTES{256 * 1024 * 1024};
+constexpr std::size_t SPOOL_RECORD_SIZE{3000};
+
+constexpr std::size_t DURABLE_WRITERS{16};
+constexpr std::size_t DURABLE_APPENDS{200};
+constexpr std::size_t DURABLE_RECORD_SIZE{1024};
+
+constexpr std::size_t SQPOLL_READERS{4};
+constexpr std::size_t SQPOLL_READS{200000};
+
+constexpr std::size_t COMPLETION_READERS{256};
+constexpr std::size_t COMPLETION_READS{1000000};
+
+constexpr std::size_t RECORD_SIZE{256};
+constexpr std::size_t MAPPED_LOOKUPS{2000000};
+constexpr std::size_t STREAM_LOOKUPS{200000};
+
+constexpr std::size_t SHARD_READERS{64};
+constexpr std::size_t SHARD_READS{400000};
+
+constexpr std::size_t SCAN_CHUNK{256 * 1024};
+constexpr std::size_t SCAN_PREFETCH_CHUNKS{8};
+
+constexpr std::size_t SERVE_ARTICLE_SIZE{1024 * 1024};
+constexpr std::size_t SERVE_ARTICLES{1024};
+
+constexpr std::size_t SMALL_RECORD_SIZE{100};
+constexpr std::size_t SMALL_RECORDS{1000000};
+
+enum class ArticleWrite
+{
+    GATHER,
+    STAGED,
+    SEGMENTS
+};
+
+enum class ScanHint
+{
+    NONE,
+    SEQUENTIAL,
+    PREFETCH
+};
+
+// Stands in for a corosio socket: splice_to only needs the descriptor
+struct native_socket
+{
+    int fd;
+    int native_handle() const noexcept { return fd; }
+};
+
+std::filesystem::path make_data_file()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_fileio.dat";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::vector<char> block(BLOCK_SIZE);
+    for (std::size_t offset = 0; offset < FILE_SIZE; offset += BLOCK_SIZE)
+    {
+        std::fill(block.begin(), block.end(), static_cast<char>(offset / BLOCK_SIZE));
+        out.write(block.data(), static_cast<std::streamsize>(block.size()));
+    }
+    return path;
+}
+
+capy::task<> reader(corosio::io_context &ctx, std::filesystem::path const &path, std::size_t count, unsigned seed,
+    std::size_t &errors)
+{
+    file_stream file(ctx);
+    if (file.open(path, file_stream::read_only))
+    {
+        ++errors;
+        co_return;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::size_t> block(0, FILE_SIZE / BLOCK_SIZE - 1);
+    std::vector<char> buffer(BLOCK_SIZE);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        file.seek(block(rng) * BLOCK_SIZE);
+        auto [ec, n] = co_await file.read_some(capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (ec)
+            ++errors;
+    }
+}
+
+capy::task<> hot_reader(corosio::io_context &ctx, std::filesystem::path const &path, std::size_t count, unsigned seed,
+    bool fixed, std::size_t &errors)
+{
+    file_stream file(ctx);
+    file_stream::fixed_buffer leased = fixed ? file.lease_buffer() : file_stream::fixed_buffer();
+    if (file.open(path, file_stream::read_only) || (fixed && !leased))
+    {
+        ++errors;
+        co_return;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::size_t> slot(0, HOT_SPAN / HOT_READ_SIZE - 1);
+    std::vector<char> buffer(HOT_READ_SIZE);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        file.seek(slot(rng) * HOT_READ_SIZE);
+        auto [ec, n] = fixed ? co_await file.read_fixed(leased, HOT_READ_SIZE)
+                             : co_await file.read_some(capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (ec)
+            ++errors;
+    }
+}
+
+capy::task<> positional_reader(file_stream &file, std::size_t count, unsigned seed, std::size_t &errors)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::size_t> block(0, FILE_SIZE / BLOCK_SIZE - 1);
+    std::vector<char> buffer(BLOCK_SIZE);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto [ec, n] = co_await file.read_at(block(rng) * BLOCK_SIZE, capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (ec)
+            ++errors;
+    }
+}
+
+capy::task<> article_writer(file_stream &file, ArticleWrite how, std::size_t &errors)
+{
+    const std::string header = "Path: bench\r\nMessage-ID: <1@bench.example>\r\nNewsgroups: misc.test\r\n\r\n";
+    const std::string body(ARTICLE_BODY_SIZE, 'x');
+    const std::string trailer = "\r\n.\r\n";
+    std::string staging;
+    for (std::size_t i = 0; i < ARTICLE_WRITES; ++i)
+    {
+        std::size_t expected = header.size() + body.size() + trailer.size();
+        std::size_t written = 0;
+        if (how == ArticleWrite::GATHER)
+        {
+            const std::array<capy::const_buffer, 3> segments = {capy::const_buffer(header.data(), header.size()),
+                capy::const_buffer(body.data(), body.size()), capy::const_buffer(trailer.data(), trailer.size())};
+            auto [ec, n] = co_await file.write_some(segments);
+            written = ec ? 0 : n;
+        }
+        else if (how == ArticleWrite::STAGED)
+        {
+            staging.assign(header).append(body).append(trailer);
+            auto [ec, n] = co_await file.write_some(capy::const_buffer(staging.data(), staging.size()));
+            written = ec ? 0 : n;
+        }
+        else
+        {
+            for (std::string const *segment : {&header, &body, &trailer})
+            {
+                auto [ec, n] = co_await file.write_some(capy::const_buffer(segment->data(), segment->size()));
+                written += ec ? 0 : n;
+            }
+        }
+        if (written != expected)
+            ++errors;
+    }
+}
+
+capy::task<> spool_appender(file_stream &file, std::size_t &errors)
+{
+    direct_writer writer(file);
+    const std::string record(SPOOL_RECORD_SIZE, 'x');
+    while (writer.end() < SPOOL_BYTES)
+    {
+        if (co_await writer.write(record.data(), record.size()))
+            ++errors;
+    }
+    if (co_await writer.flush())
+        ++errors;
+}
+
+capy::task<> small_appender(corosio::io_context &ctx, file_stream &file, bool buffered, std::size_t &errors)
+{
+    std::string record(SMALL_RECORD_SIZE - 1, 'o');
+    record += '\n';
+    if (!buffered)
+    {
+        for (std::size_t i = 0; i < SMALL_RECORDS; ++i)
+        {
+            auto [ec, n] = co_await file.write_some(capy::const_buffer(record.data(), record.size()));
+            if (ec || n != record.size())
+                ++errors;
+        }
+        co_return;
+    }
+
+    buffered_file_writer writer(ctx.get_executor(), file);
+    for (std::size_t i = 0; i < SMALL_RECORDS; ++i)
+    {
+        if (co_await writer.write(record.data(), record.size()))
+            ++errors;
+    }
+    if (co_await writer.flush())
+        ++errors;
+}
+
+capy::task<> durable_appender(file_stream &file, std::size_t writer, bool linked, std::size_t &errors)
+{
+    const std::string record(DURABLE_RECORD_SIZE, 'd');
+    for (std::size_t i = 0; i < DURABLE_APPENDS; ++i)
+    {
+        const std::uint64_t offset = (i * DURABLE_WRITERS + writer) * DURABLE_RECORD_SIZE;
+        const capy::const_buffer buffer(record.data(), record.size());
+        if (linked)
+        {
+            auto [ec, n] = co_await file.write_durable_at(offset, buffer);
+            if (ec)
+                ++errors;
+        }
+        else
+        {
+            auto [ec, n] = co_await file.write_at(offset, buffer);
+            auto [sync_ec, unused] = co_await file.fdatasync();
+            if (ec || sync_ec)
+                ++errors;
+        }
+    }
+}
+
+capy::task<> timed_reader(corosio::io_context &ctx, std::filesystem::path const &path, std::size_t count,
+    unsigned seed, std::vector<double> &latencies, std::size_t &errors)
+{
+    using Clock = std::chrono::steady_clock;
+
+    file_stream file(ctx);
+    if (file.open(path, file_stream::read_only))
+    {
+        ++errors;
+        co_return;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::size_t> block(0, HOT_SPAN / BLOCK_SIZE - 1);
+    std::vector<char> buffer(BLOCK_SIZE);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Clock::time_point start = Clock::now();
+        auto [ec, n] = co_await file.read_at(block(rng) * BLOCK_SIZE, capy::mutable_buffer(buffer.data(), buffer.size()));
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        if (ec)
+            ++errors;
+    }
+}
+
+capy::task<> shared_reader(file_stream &file, std::size_t count, unsigned seed, std::atomic<std::size_t> &errors)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::size_t> block(0, HOT_SPAN / BLOCK_SIZE - 1);
+    std::vector<char> buffer(BLOCK_SIZE);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto [ec, n] = co_await file.read_at(block(rng) * BLOCK_SIZE, capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (ec)
+            ++errors;
+    }
+}
+
+capy::task<> record_reader(file_stream &file, std::size_t count, std::uint64_t &checksum, std::size_t &errors)
+{
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<std::size_t> record(0, FILE_SIZE / RECORD_SIZE - 1);
+    std::array<char, RECORD_SIZE> buffer;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto [ec, n] = co_await file.read_at(record(rng) * RECORD_SIZE, capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (ec || n != RECORD_SIZE)
+            ++errors;
+        checksum += static_cast<unsigned char>(buffer[0]);
+    }
+}
+
+capy::task<> scanner(file_stream &file, ScanHint hint, std::size_t &errors)
+{
+    if (hint != ScanHint::NONE)
+    {
+        auto [ec, unused] = co_await file.advise(file_stream::sequential);
+        if (ec)
+            ++errors;
+    }
+
+    std::vector<char> buffer(SCAN_CHUNK);
+    for (std::size_t offset = 0; offset < FILE_SIZE; offset += SCAN_CHUNK)
+    {
+        // Keep a window of chunks queued ahead of the one being read
+        if (hint == ScanHint::PREFETCH && offset % (SCAN_PREFETCH_CHUNKS * SCAN_CHUNK) == 0)
+        {
+            auto [ec, unused] = co_await file.prefetch(offset + SCAN_CHUNK, SCAN_PREFETCH_CHUNKS * SCAN_CHUNK);
+            if (ec)
+                ++errors;
+        }
+        auto [ec, n] = co_await file.read_at(offset, capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (ec || n != SCAN_CHUNK)
+            ++errors;
+    }
+}
+
+capy::task<> article_server(file_stream &file, native_socket sock, std::size_t &errors)
+{
+    const std::size_t articles = FILE_SIZE / SERVE_ARTICLE_SIZE;
+    for (std::size_t i = 0; i < SERVE_ARTICLES; ++i)
+    {
+        auto [ec, n] = co_await file.splice_to(sock, (i % articles) * SERVE_ARTICLE_SIZE, SERVE_ARTICLE_SIZE);
+        if (ec || n != SERVE_ARTICLE_SIZE)
+            ++errors;
+    }
+}
+
+// Connected loopback TCP sockets, or false if they cannot be made
+bool tcp_pair(int (&fds)[2])
+{
+    const int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bool ok = listener != -1 && ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 &&
+              ::listen(listener, 1) == 0 && ::getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &len) == 0;
+
+    fds[0] = ok ? ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+    ok = ok && fds[0] != -1 && ::connect(fds[0], reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    fds[1] = ok ? ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC) : -1;
+    if (listener != -1)
+        ::close(listener);
+    return ok && fds[1] != -1;
+}
+
+// Fraction of a file's pages resident in the page cache
+double resident_fraction(std::filesystem::path const &path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return 0.0;
+    const auto size = static_cast<std::size_t>(std::filesystem::file_size(path));
+    void *map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return 0.0;
+
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> pages((size + page - 1) / page);
+    std::size_t resident = 0;
+    if (::mincore(map, size, pages.data()) == 0)
+    {
+        for (unsigned char p : pages)
+            resident += p & 1;
+    }
+    ::munmap(map, size);
+    return pages.empty() ? 0.0 : static_cast<double>(resident) / static_cast<double>(pages.size());
+}
+
+void random_reads(std::filesystem::path const &path)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    std::size_t errors = 0;
+    for (std::size_t i = 0; i < READERS; ++i)
+    {
+        capy::run_async(ctx.get_executor())(
+            reader(ctx, path, READ_COUNT / READERS, static_cast<unsigned>(i), errors));
+    }
+
+    const file_service_stats before = get_file_service_stats(ctx);
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const file_service_stats after = get_file_service_stats(ctx);
+
+    const std::uint64_t calls = after.submit_calls - before.submit_calls;
+    const std::uint64_t entries = after.submitted - before.submitted;
+    std::printf("random 4KiB reads: %zu reads by %zu readers in %.3fs (%.0f IOPS)\n", READ_COUNT, READERS, seconds,
+        READ_COUNT / seconds);
+    std::printf("  io_uring_enter calls: %llu batched, %zu unbatched (%.1f entries per call)\n",
+        static_cast<unsigned long long>(calls), READ_COUNT,
+        calls ? static_cast<double>(entries) / static_cast<double>(calls) : 0.0);
+    std::printf("  errors: %zu\n", errors);
+}
+
+void overflow_burst(std::filesystem::path const &path)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.queue_depth = BURST_QUEUE_DEPTH;
+    configure_file_service(ctx, options);
+
+    std::size_t errors = 0;
+    for (std::size_t i = 0; i < BURST_READERS; ++i)
+    {
+        capy::run_async(ctx.get_executor())(reader(ctx, path, 4, static_cast<unsigned>(i), errors));
+    }
+    ctx.run();
+
+    const file_service_stats stats = get_file_service_stats(ctx);
+    std::printf("burst: %zu readers on a %u entry ring\n", BURST_READERS, BURST_QUEUE_DEPTH);
+    std::printf("  parked %llu of %llu operations, errors: %zu\n", static_cast<unsigned long long>(stats.parked),
+        static_cast<unsigned long long>(stats.completions), errors);
+}
+
+void hot_reads(std::filesystem::path const &path, bool fixed, bool registered)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    file_service_options options;
+    options.fixed_buffer_count = READERS;
+    options.fixed_buffer_size = HOT_READ_SIZE;
+    options.registered_files = registered ? READERS : 0;
+    configure_file_service(ctx, options);
+
+    std::size_t errors = 0;
+    for (std::size_t i = 0; i < READERS; ++i)
+    {
+        capy::run_async(ctx.get_executor())(
+            hot_reader(ctx, path, HOT_READ_COUNT / READERS, static_cast<unsigned>(i), fixed, errors));
+    }
+
+    const std::clock_t cpu_start = std::clock();
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    std::printf("hot %zu byte reads, %-8s buffers, %-10s fds: %10.0f reads/s, %.2f us CPU per read, errors: %zu\n",
+        HOT_READ_SIZE, fixed ? "fixed" : "ordinary", registered ? "registered" : "plain", HOT_READ_COUNT / seconds,
+        cpu_seconds * 1e6 / HOT_READ_COUNT, errors);
+}
+
+void queue_depth_reads(std::filesystem::path const &path, bool shared)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    file_service_options options;
+    options.queue_depth = QUEUE_DEPTH_READERS;
+    configure_file_service(ctx, options);
+
+    std::size_t errors = 0;
+    file_stream file(ctx);
+    if (shared && file.open(path, file_stream::read_only))
+    {
+        std::printf("queue depth: cannot open %s\n", path.c_str());
+        return;
+    }
+    for (std::size_t i = 0; i < QUEUE_DEPTH_READERS; ++i)
+    {
+        const std::size_t count = QUEUE_DEPTH_READS / QUEUE_DEPTH_READERS;
+        const auto seed = static_cast<unsigned>(i);
+        capy::run_async(ctx.get_executor())(shared ? positional_reader(file, count, seed, errors)
+                                                   : reader(ctx, path, count, seed, errors));
+    }
+
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("queue depth %zu, %-24s %10.0f IOPS, errors: %zu\n", QUEUE_DEPTH_READERS,
+        shared ? "read_at on one stream:" : "read_some on 64 streams:", QUEUE_DEPTH_READS / seconds, errors);
+}
+
+void article_writes(ArticleWrite how)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_fileio_articles.dat";
+    std::size_t errors = 0;
+    file_stream file(ctx);
+    if (file.open(path, file_stream::write_only, file_stream::create_always))
+    {
+        std::printf("article writes: cannot open %s\n", path.c_str());
+        return;
+    }
+    capy::run_async(ctx.get_executor())(article_writer(file, how, errors));
+
+    const file_service_stats before = get_file_service_stats(ctx);
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const file_service_stats after = get_file_service_stats(ctx);
+
+    const char *name = how == ArticleWrite::GATHER ? "writev" : how == ArticleWrite::STAGED ? "staged copy" : "per segment";
+    std::printf("article writes, %-12s %10.0f articles/s, %.1f SQEs per article, errors: %zu\n", name,
+        ARTICLE_WRITES / seconds, static_cast<double>(after.submitted - before.submitted) / ARTICLE_WRITES, errors);
+
+    file.close();
+    std::filesystem::remove(path);
+}
+
+void spool_appends(bool direct)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_fileio_spool.dat";
+    std::size_t errors = 0;
+    file_stream file(ctx);
+    if (file.open(path, file_stream::write_only, file_stream::create_always,
+            direct ? file_stream::direct : file_stream::no_flags))
+    {
+        std::printf("spool appends: cannot open %s%s\n", path.c_str(), direct ? " with O_DIRECT" : "");
+        return;
+    }
+    capy::run_async(ctx.get_executor())(spool_appender(file, errors));
+
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    file.close();
+
+    std::printf("spool appends, %-8s %8.1f MB/s, %5.1f%% of spool in page cache, errors: %zu\n",
+        direct ? "O_DIRECT" : "buffered", SPOOL_BYTES / seconds / 1e6, resident_fraction(path) * 100.0, errors);
+    std::filesystem::remove(path);
+}
+
+void durable_appends(bool linked)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_fileio_durable.dat";
+    std::size_t errors = 0;
+    file_stream file(ctx);
+    if (file.open(path, file_stream::write_only, file_stream::create_always))
+    {
+        std::printf("durable appends: cannot open %s\n", path.c_str());
+        return;
+    }
+    for (std::size_t i = 0; i < DURABLE_WRITERS; ++i)
+    {
+        capy::run_async(ctx.get_executor())(durable_appender(file, i, linked, errors));
+    }
+
+    const file_service_stats before = get_file_service_stats(ctx);
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const file_service_stats after = get_file_service_stats(ctx);
+
+    const std::size_t appends = DURABLE_WRITERS * DURABLE_APPENDS;
+    std::printf("durable appends, %-20s %8.0f appends/s, %.2f SQEs per append, errors: %zu\n",
+        linked ? "linked group commit" : "write then fdatasync", appends / seconds,
+        static_cast<double>(after.submitted - before.submitted) / appends, errors);
+
+    file.close();
+    std::filesystem::remove(path);
+}
+
+void sqpoll_reads(std::filesystem::path const &path, bool sqpoll)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.sqpoll = sqpoll;
+    options.sqpoll_idle_ms = 50;
+    configure_file_service(ctx, options);
+
+    std::vector<double> latencies;
+    latencies.reserve(SQPOLL_READS);
+    std::size_t errors = 0;
+    for (std::size_t i = 0; i < SQPOLL_READERS; ++i)
+    {
+        capy::run_async(ctx.get_executor())(
+            timed_reader(ctx, path, SQPOLL_READS / SQPOLL_READERS, static_cast<unsigned>(i), latencies, errors));
+    }
+
+    const file_service_stats before = get_file_service_stats(ctx);
+    const std::clock_t cpu_start = std::clock();
+    ctx.run();
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    const file_service_stats after = get_file_service_stats(ctx);
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p)
+    { return latencies.empty() ? 0.0 : latencies[static_cast<std::size_t>(p * (latencies.size() - 1))]; };
+
+    std::printf("SQPOLL %-3s%s %.2f us CPU per read, p50 %.1f us, p99 %.1f us, %.3f enters per read, errors: %zu\n",
+        sqpoll ? "on" : "off", sqpoll && !after.sqpoll ? " (unavailable)" : "", cpu_seconds * 1e6 / SQPOLL_READS,
+        percentile(0.50), percentile(0.99),
+        static_cast<double>(after.submit_calls - before.submit_calls) / SQPOLL_READS, errors);
+}
+
+void record_lookups(std::filesystem::path const &path, bool mapped)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::uint64_t checksum = 0;
+    std::size_t errors = 0;
+    std::size_t lookups = mapped ? MAPPED_LOOKUPS : STREAM_LOOKUPS;
+    double seconds = 0;
+    if (mapped)
+    {
+        mapped_file file;
+        if (file.open(path) || file.advise(mapped_file::random))
+        {
+            std::printf("record lookups: cannot map %s\n", path.c_str());
+            return;
+        }
+
+        std::mt19937_64 rng(7);
+        std::uniform_int_distribution<std::size_t> record(0, FILE_SIZE / RECORD_SIZE - 1);
+        std::array<char, RECORD_SIZE> buffer;
+        const Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < lookups; ++i)
+        {
+            const auto bytes = file.view(record(rng) * RECORD_SIZE, RECORD_SIZE);
+            if (bytes.size() != RECORD_SIZE)
+                ++errors;
+            std::memcpy(buffer.data(), bytes.data(), bytes.size());
+            checksum += static_cast<unsigned char>(buffer[0]);
+        }
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    else
+    {
+        corosio::io_context ctx;
+        file_stream file(ctx);
+        if (file.open(path, file_stream::read_only))
+        {
+            std::printf("record lookups: cannot open %s\n", path.c_str());
+            return;
+        }
+        capy::run_async(ctx.get_executor())(record_reader(file, lookups, checksum, errors));
+        const Clock::time_point start = Clock::now();
+        ctx.run();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    std::printf("record lookups, %-12s %10.0f lookups/s, %.3f us per lookup, checksum %llu, errors: %zu\n",
+        mapped ? "mapped_file:" : "file_stream:", lookups / seconds, seconds * 1e6 / lookups,
+        static_cast<unsigned long long>(checksum), errors);
+}
+
+void completion_rate(std::filesystem::path const &path)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    file_service_options options;
+    options.queue_depth = COMPLETION_READERS;
+    configure_file_service(ctx, options);
+
+    std::atomic<std::size_t> errors{0};
+    file_stream file(ctx);
+    if (file.open(path, file_stream::read_only))
+    {
+        std::printf("completion rate: cannot open %s\n", path.c_str());
+        return;
+    }
+    for (std::size_t i = 0; i < COMPLETION_READERS; ++i)
+    {
+        capy::run_async(ctx.get_executor())(
+            shared_reader(file, COMPLETION_READS / COMPLETION_READERS, static_cast<unsigned>(i), errors));
+    }
+
+    const file_service_stats before = get_file_service_stats(ctx);
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const file_service_stats after = get_file_service_stats(ctx);
+
+    const auto completions = static_cast<double>(after.completions - before.completions);
+    const auto batches = static_cast<double>(after.completion_batches - before.completion_batches);
+    std::printf("completion rate: %10.0f completions/s, %.1f completions per batch, errors: %zu\n",
+        completions / seconds, batches == 0 ? 0.0 : completions / batches, errors.load());
+}
+
+void sharded_reads(std::filesystem::path const &path, std::size_t threads, bool per_thread)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    file_service_options options;
+    options.ring_per_thread = per_thread;
+    configure_file_service(ctx, options);
+
+    // A stream is driven by one thread at a time, so each reader has its own
+    std::atomic<std::size_t> errors{0};
+    std::vector<std::unique_ptr<file_stream>> files;
+    for (std::size_t i = 0; i < SHARD_READERS; ++i)
+    {
+        files.push_back(std::make_unique<file_stream>(ctx));
+        if (files.back()->open(path, file_stream::read_only))
+        {
+            std::printf("ring sharding: cannot open %s\n", path.c_str());
+            return;
+        }
+        capy::run_async(ctx.get_executor())(
+            shared_reader(*files.back(), SHARD_READS / SHARD_READERS, static_cast<unsigned>(i), errors));
+    }
+
+    const Clock::time_point start = Clock::now();
+    std::vector<std::thread> runners;
+    for (std::size_t t = 1; t < threads; ++t)
+    {
+        runners.emplace_back([&ctx] { ctx.run(); });
+    }
+    ctx.run();
+    for (std::thread &runner : runners)
+    {
+        runner.join();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const file_service_stats stats = get_file_service_stats(ctx);
+
+    // The share of completions that resumed on the thread that started them
+    const double owner_share = stats.completions
+        ? 100.0 * static_cast<double>(stats.owner_completions) / static_cast<double>(stats.completions)
+        : 0.0;
+    std::printf("%zu threads, %-16s %10.0f IOPS, %llu rings, %5.1f%% on owner, errors: %zu\n", threads,
+        per_thread ? "ring per thread:" : "shared ring:", SHARD_READS / seconds,
+        static_cast<unsigned long long>(stats.rings), owner_share, errors.load());
+}
+
+void cold_scan(std::filesystem::path const &path, ScanHint hint)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Write back any dirty pages first; only clean pages can be dropped
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1 || ::fdatasync(fd) == -1 || ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+    {
+        std::printf("cold scan: cannot drop %s from the page cache\n", path.c_str());
+        if (fd != -1)
+            ::close(fd);
+        return;
+    }
+    ::close(fd);
+    const double resident = resident_fraction(path);
+
+    corosio::io_context ctx;
+    file_stream file(ctx);
+    if (file.open(path, file_stream::read_only))
+    {
+        std::printf("cold scan: cannot open %s\n", path.c_str());
+        return;
+    }
+
+    std::size_t errors = 0;
+    capy::run_async(ctx.get_executor())(scanner(file, hint, errors));
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const char *name = hint == ScanHint::NONE ? "default:" : hint == ScanHint::SEQUENTIAL ? "sequential:" : "prefetch:";
+    std::printf("cold scan, %-12s %8.1f MB/s (%.0f%% cached before), errors: %zu\n", name,
+        FILE_SIZE / seconds / (1024 * 1024), resident * 100, errors);
+}
+
+void serve_articles(std::filesystem::path const &path, bool splice)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    file_service_options options;
+    options.splice = splice;
+    configure_file_service(ctx, options);
+
+    int fds[2];
+    if (!tcp_pair(fds))
+    {
+        std::printf("article serving: cannot connect over loopback\n");
+        return;
+    }
+
+    file_stream file(ctx);
+    if (file.open(path, file_stream::read_only))
+    {
+        std::printf("article serving: cannot open %s\n", path.c_str());
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return;
+    }
+
+    // The client discards what it receives
+    std::thread client([fd = fds[1]] {
+        std::vector<char> buffer(SERVE_ARTICLE_SIZE);
+        while (::read(fd, buffer.data(), buffer.size()) > 0)
+        {
+        }
+    });
+
+    std::size_t errors = 0;
+    capy::run_async(ctx.get_executor())(article_server(file, native_socket{fds[0]}, errors));
+    const std::clock_t cpu_start = std::clock();
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    ::shutdown(fds[0], SHUT_WR);
+    client.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    const file_service_stats stats = get_file_service_stats(ctx);
+    std::printf("1 MiB articles, %-9s %8.1f MB/s, %.0f us CPU per article, %llu fallbacks, errors: %zu\n",
+        splice ? "splice:" : "copy:", SERVE_ARTICLES * SERVE_ARTICLE_SIZE / seconds / (1024 * 1024),
+        cpu_seconds * 1e6 / SERVE_ARTICLES, static_cast<unsigned long long>(stats.splice_fallbacks), errors);
+}
+
+void small_appends(bool buffered)
+{
+    using Clock = std::chrono::steady_clock;
+
+    corosio::io_context ctx;
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_fileio_overview.dat";
+    std::size_t errors = 0;
+    file_stream file(ctx);
+    if (file.open(path, file_stream::write_only, file_stream::create_always))
+    {
+        std::printf("small appends: cannot open %s\n", path.c_str());
+        return;
+    }
+    capy::run_async(ctx.get_executor())(small_appender(ctx, file, buffered, errors));
+
+    const file_service_stats before = get_file_service_stats(ctx);
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const file_service_stats after = get_file_service_stats(ctx);
+    file.close();
+
+    std::printf("small appends, %-9s %10.0f records/s, %8llu entries submitted, errors: %zu\n",
+        buffered ? "buffered:" : "raw:", SMALL_RECORDS / seconds,
+        static_cast<unsigned long long>(after.submitted - before.submitted), errors);
+    std::filesystem::remove(path);
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path path = make_data_file();
+
+    random_reads(path);
+    overflow_burst(path);
+    for (bool registered : {false, true})
+    {
+        hot_reads(path, false, registered);
+        hot_reads(path, true, registered);
+    }
+    queue_depth_reads(path, false);
+    queue_depth_reads(path, true);
+    for (ArticleWrite how : {ArticleWrite::GATHER, ArticleWrite::STAGED, ArticleWrite::SEGMENTS})
+    {
+        article_writes(how);
+    }
+    spool_appends(false);
+    spool_appends(true);
+    durable_appends(false);
+    durable_appends(true);
+    sqpoll_reads(path, false);
+    sqpoll_reads(path, true);
+    record_lookups(path, true);
+    record_lookups(path, false);
+    completion_rate(path);
+    for (std::size_t threads : {1, 2, 4, 8})
+    {
+        sharded_reads(path, threads, false);
+        sharded_reads(path, threads, true);
+    }
+    for (ScanHint hint : {ScanHint::NONE, ScanHint::SEQUENTIAL, ScanHint::PREFETCH})
+    {
+        cold_scan(path, hint);
+    }
+    serve_articles(path, true);
+    serve_articles(path, false);
+    small_appends(false);
+    small_appends(true);
+
+    std::filesystem::remove(path);
+    return EXIT_SUCCESS;
+}
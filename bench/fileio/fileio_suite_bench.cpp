@@ -0,0 +1,597 @@
+// Regression suite for file_stream against a synchronous baseline.
+//
+// Every case runs twice: through file_stream on io_uring, with one
+// coroutine per unit of queue depth on a single thread, and through plain
+// pread/pwrite/open/close calls made by a pool of as many threads as the
+// queue depth.  The cases are:
+//
+//   seq_read, rand_read, seq_write, rand_write
+//       positional transfers over a 256 MiB file at 4 KiB, 64 KiB and
+//       1 MiB blocks and queue depths 1, 8 and 64.  Reads are served from
+//       the page cache, so they measure the cost of issuing I/O rather
+//       than the device; writes are not synced.
+//   append
+//       100-byte records appended one at a time: write_some per record,
+//       a buffered_file_writer, and write(2) per record.
+//   open_close
+//       opening and closing a small file, with async_open/async_close on
+//       the ring.
+//
+// Each result reports IOPS, MB/s, p50/p99/p999 latency per operation and
+// system calls per operation.  Both backends count system calls the same
+// way: a perf counter on the raw_syscalls:sys_enter tracepoint counts every
+// call made by the process and the threads it starts while the case runs,
+// whether to submit, to wait for completions or to do the I/O itself.
+// Opening the counter needs read access to tracefs and a
+// kernel.perf_event_paranoid of 1 or lower (or CAP_PERFMON); without them
+// syscalls_per_op is null.
+//
+// The results are written as JSON to the file named by the first argument,
+// or to standard output.  Progress goes to standard error.
+
+#include <fileio/buffered_file_writer.h>
+#include <fileio/file_stream.h>
+
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <boost/corosio/io_context.hpp>
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace nntp;
+using namespace boost;
+
+namespace
+{
+
+constexpr std::size_t FILE_SIZE{256 * 1024 * 1024};
+constexpr std::size_t CASE_BYTES{256 * 1024 * 1024};
+constexpr std::size_t MIN_OPS{2000};
+constexpr std::size_t MAX_OPS{200000};
+constexpr std::array<std::size_t, 3> BLOCK_SIZES{4096, 64 * 1024, 1024 * 1024};
+constexpr std::array<std::size_t, 3> QUEUE_DEPTHS{1, 8, 64};
+
+constexpr std::size_t APPEND_RECORD_SIZE{100};
+constexpr std::size_t APPEND_RECORDS{200000};
+
+constexpr std::size_t STORM_OPS{50000};
+constexpr std::size_t STORM_QUEUE_DEPTH{16};
+
+using Clock = std::chrono::steady_clock;
+
+enum class Pattern
+{
+    SEQUENTIAL,
+    RANDOM
+};
+
+struct io_case
+{
+    char const *name;
+    Pattern pattern;
+    bool write;
+    std::size_t block_size;
+    std::size_t queue_depth;
+};
+
+struct result
+{
+    std::string name;
+    std::string backend;
+    std::size_t block_size = 0;
+    std::size_t queue_depth = 0;
+    std::size_t ops = 0;
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+    std::optional<std::uint64_t> syscalls;
+    std::size_t errors = 0;
+
+    // Microseconds per operation
+    std::vector<double> latencies;
+};
+
+// Counts the system calls entered by the calling thread, and by threads it
+// starts while the counter is open, between start() and stop()
+class syscall_counter
+{
+public:
+    syscall_counter()
+    {
+        const std::uint64_t id = tracepoint_id();
+        if (id == 0)
+        {
+            return;
+        }
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = id;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    ~syscall_counter()
+    {
+        if (fd_ != -1)
+        {
+            ::close(fd_);
+        }
+    }
+
+    syscall_counter(syscall_counter const &) = delete;
+    syscall_counter &operator=(syscall_counter const &) = delete;
+
+    bool available() const noexcept { return fd_ != -1; }
+
+    void start()
+    {
+        if (fd_ != -1)
+        {
+            ::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // Threads counted through inherit must have exited by now, since their
+    // counts are added to this one when they do
+    std::optional<std::uint64_t> stop()
+    {
+        if (fd_ == -1)
+        {
+            return std::nullopt;
+        }
+        ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        std::uint64_t count = 0;
+        if (::read(fd_, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+        {
+            return std::nullopt;
+        }
+        return count;
+    }
+
+private:
+    static std::uint64_t tracepoint_id()
+    {
+        for (char const *path : {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                 "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"})
+        {
+            std::ifstream in(path);
+            std::uint64_t id = 0;
+            if (in >> id)
+            {
+                return id;
+            }
+        }
+        return 0;
+    }
+
+    int fd_ = -1;
+};
+
+double micros(Clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+std::size_t op_count(std::size_t block_size)
+{
+    return std::clamp(CASE_BYTES / block_size, MIN_OPS, MAX_OPS);
+}
+
+// Sequential cases hand out consecutive blocks to whichever worker asks next
+std::uint64_t offset_of(Pattern pattern, std::size_t index, std::size_t block_size, std::mt19937_64 &rng)
+{
+    const std::size_t blocks = FILE_SIZE / block_size;
+    if (pattern == Pattern::SEQUENTIAL)
+        return static_cast<std::uint64_t>(index % blocks) * block_size;
+    return static_cast<std::uint64_t>(rng() % blocks) * block_size;
+}
+
+std::filesystem::path make_data_file()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_fileio_suite.dat";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::vector<char> chunk(1024 * 1024);
+    std::mt19937 rng(42);
+    std::generate(chunk.begin(), chunk.end(), [&] { return static_cast<char>(rng()); });
+    for (std::size_t written = 0; written < FILE_SIZE; written += chunk.size())
+        out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    return path;
+}
+
+//------------------------------------------------------------------------------
+// io_uring backend
+
+capy::task<> ring_worker(file_stream &file, io_case const &c, std::size_t &next, unsigned seed, result &r)
+{
+    std::vector<char> buffer(c.block_size, 'w');
+    std::mt19937_64 rng(seed);
+    for (std::size_t i; (i = next++) < r.ops;)
+    {
+        const std::uint64_t offset = offset_of(c.pattern, i, c.block_size, rng);
+        const Clock::time_point start = Clock::now();
+        std::error_code ec;
+        std::size_t n = 0;
+        if (c.write)
+        {
+            auto [wec, wn] = co_await file.write_at(offset, capy::const_buffer(buffer.data(), buffer.size()));
+            ec = wec;
+            n = wn;
+        }
+        else
+        {
+            auto [rec, rn] = co_await file.read_at(offset, capy::mutable_buffer(buffer.data(), buffer.size()));
+            ec = rec;
+            n = rn;
+        }
+        r.latencies.push_back(micros(Clock::now() - start));
+        if (ec || n != c.block_size)
+            ++r.errors;
+    }
+}
+
+result ring_io(std::filesystem::path const &path, io_case const &c)
+{
+    result r{c.name, "io_uring", c.block_size, c.queue_depth, op_count(c.block_size)};
+    r.bytes = static_cast<std::uint64_t>(r.ops) * c.block_size;
+    r.latencies.reserve(r.ops);
+
+    corosio::io_context ctx;
+    file_stream file(ctx);
+    if (file.open(path, c.write ? file_stream::read_write : file_stream::read_only))
+    {
+        r.errors = r.ops;
+        return r;
+    }
+
+    std::size_t next = 0;
+    for (std::size_t q = 0; q < c.queue_depth; ++q)
+        capy::run_async(ctx.get_executor())(ring_worker(file, c, next, static_cast<unsigned>(q + 1), r));
+
+    syscall_counter syscalls;
+    syscalls.start();
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.syscalls = syscalls.stop();
+    file.close();
+    return r;
+}
+
+capy::task<> ring_appender(corosio::io_context &ctx, file_stream &file, bool buffered, result &r)
+{
+    const std::string record(APPEND_RECORD_SIZE, 'a');
+    if (buffered)
+    {
+        buffered_file_writer writer(ctx.get_executor(), file);
+        for (std::size_t i = 0; i < r.ops; ++i)
+        {
+            const Clock::time_point start = Clock::now();
+            if (co_await writer.write(record.data(), record.size()))
+                ++r.errors;
+            r.latencies.push_back(micros(Clock::now() - start));
+        }
+        if (co_await writer.flush())
+            ++r.errors;
+        co_return;
+    }
+
+    for (std::size_t i = 0; i < r.ops; ++i)
+    {
+        const Clock::time_point start = Clock::now();
+        auto [ec, n] = co_await file.write_some(capy::const_buffer(record.data(), record.size()));
+        r.latencies.push_back(micros(Clock::now() - start));
+        if (ec || n != record.size())
+            ++r.errors;
+    }
+}
+
+result ring_appends(std::filesystem::path const &path, bool buffered)
+{
+    result r{"append", buffered ? "io_uring_buffered" : "io_uring", APPEND_RECORD_SIZE, 1, APPEND_RECORDS};
+    r.bytes = static_cast<std::uint64_t>(r.ops) * APPEND_RECORD_SIZE;
+    r.latencies.reserve(r.ops);
+
+    corosio::io_context ctx;
+    file_stream file(ctx);
+    if (file.open(path, file_stream::write_only, file_stream::create_always))
+    {
+        r.errors = r.ops;
+        return r;
+    }
+    capy::run_async(ctx.get_executor())(ring_appender(ctx, file, buffered, r));
+
+    syscall_counter syscalls;
+    syscalls.start();
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.syscalls = syscalls.stop();
+    file.close();
+    return r;
+}
+
+capy::task<> ring_opener(corosio::io_context &ctx, std::filesystem::path const &path, std::size_t &next, result &r)
+{
+    while (next++ < r.ops)
+    {
+        file_stream file(ctx);
+        const Clock::time_point start = Clock::now();
+        auto [ec, unused] = co_await file.async_open(path, file_stream::read_only);
+        auto [ec2, unused2] = co_await file.async_close();
+        r.latencies.push_back(micros(Clock::now() - start));
+        if (ec || ec2)
+            ++r.errors;
+    }
+}
+
+result ring_storm(std::filesystem::path const &path)
+{
+    result r{"open_close", "io_uring", 0, STORM_QUEUE_DEPTH, STORM_OPS};
+    r.latencies.reserve(r.ops);
+
+    corosio::io_context ctx;
+    std::size_t next = 0;
+    for (std::size_t q = 0; q < STORM_QUEUE_DEPTH; ++q)
+        capy::run_async(ctx.get_executor())(ring_opener(ctx, path, next, r));
+
+    syscall_counter syscalls;
+    syscalls.start();
+    const Clock::time_point start = Clock::now();
+    ctx.run();
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.syscalls = syscalls.stop();
+    return r;
+}
+
+//------------------------------------------------------------------------------
+// Thread pool baseline
+
+// Runs body(worker, index, latencies, errors) for every operation index
+// over queue_depth threads and merges what the workers recorded
+template<class Body>
+void run_pool(std::size_t queue_depth, result &r, Body body)
+{
+    std::atomic<std::size_t> next{0};
+    std::vector<std::vector<double>> latencies(queue_depth);
+    std::vector<std::size_t> errors(queue_depth);
+    std::vector<std::thread> threads;
+
+    // Opened before the workers start, so their calls are counted too
+    syscall_counter syscalls;
+    syscalls.start();
+    const Clock::time_point start = Clock::now();
+    for (std::size_t t = 0; t < queue_depth; ++t)
+    {
+        threads.emplace_back(
+            [&, t]
+            {
+                latencies[t].reserve(r.ops / queue_depth + 1);
+                for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < r.ops;)
+                    body(t, i, latencies[t], errors[t]);
+            });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.syscalls = syscalls.stop();
+
+    for (std::size_t t = 0; t < queue_depth; ++t)
+    {
+        r.latencies.insert(r.latencies.end(), latencies[t].begin(), latencies[t].end());
+        r.errors += errors[t];
+    }
+}
+
+result pool_io(std::filesystem::path const &path, io_case const &c)
+{
+    result r{c.name, "thread_pool", c.block_size, c.queue_depth, op_count(c.block_size)};
+    r.bytes = static_cast<std::uint64_t>(r.ops) * c.block_size;
+    r.latencies.reserve(r.ops);
+
+    const int fd = ::open(path.c_str(), (c.write ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd == -1)
+    {
+        r.errors = r.ops;
+        return r;
+    }
+
+    std::vector<std::vector<char>> buffers(c.queue_depth, std::vector<char>(c.block_size, 'w'));
+    std::vector<std::mt19937_64> rngs;
+    for (std::size_t t = 0; t < c.queue_depth; ++t)
+        rngs.emplace_back(static_cast<unsigned>(t + 1));
+
+    run_pool(c.queue_depth, r,
+        [&](std::size_t t, std::size_t i, std::vector<double> &latencies, std::size_t &errors)
+        {
+            const auto offset = static_cast<off_t>(offset_of(c.pattern, i, c.block_size, rngs[t]));
+            char *buffer = buffers[t].data();
+            const Clock::time_point start = Clock::now();
+            const ssize_t n = c.write ? ::pwrite(fd, buffer, c.block_size, offset)
+                                      : ::pread(fd, buffer, c.block_size, offset);
+            latencies.push_back(micros(Clock::now() - start));
+            if (n != static_cast<ssize_t>(c.block_size))
+                ++errors;
+        });
+
+    ::close(fd);
+    return r;
+}
+
+result pool_appends(std::filesystem::path const &path)
+{
+    result r{"append", "thread_pool", APPEND_RECORD_SIZE, 1, APPEND_RECORDS};
+    r.bytes = static_cast<std::uint64_t>(r.ops) * APPEND_RECORD_SIZE;
+    r.latencies.reserve(r.ops);
+
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        r.errors = r.ops;
+        return r;
+    }
+
+    // Appends are ordered, so one thread makes them
+    const std::string record(APPEND_RECORD_SIZE, 'a');
+    run_pool(1, r,
+        [&](std::size_t, std::size_t, std::vector<double> &latencies, std::size_t &errors)
+        {
+            const Clock::time_point start = Clock::now();
+            const ssize_t n = ::write(fd, record.data(), record.size());
+            latencies.push_back(micros(Clock::now() - start));
+            if (n != static_cast<ssize_t>(record.size()))
+                ++errors;
+        });
+
+    ::close(fd);
+    return r;
+}
+
+result pool_storm(std::filesystem::path const &path)
+{
+    result r{"open_close", "thread_pool", 0, STORM_QUEUE_DEPTH, STORM_OPS};
+    r.latencies.reserve(r.ops);
+
+    run_pool(STORM_QUEUE_DEPTH, r,
+        [&](std::size_t, std::size_t, std::vector<double> &latencies, std::size_t &errors)
+        {
+            const Clock::time_point start = Clock::now();
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1 || ::close(fd) == -1)
+                ++errors;
+            latencies.push_back(micros(Clock::now() - start));
+        });
+    return r;
+}
+
+//------------------------------------------------------------------------------
+// Reporting
+
+double percentile(std::vector<double> const &sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0;
+    const auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size()));
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+json::object to_json(result &r)
+{
+    std::sort(r.latencies.begin(), r.latencies.end());
+
+    const double seconds = r.seconds > 0 ? r.seconds : 1e-9;
+    json::object o;
+    o["case"] = r.name;
+    o["backend"] = r.backend;
+    o["block_size"] = r.block_size;
+    o["queue_depth"] = r.queue_depth;
+    o["ops"] = r.ops;
+    o["errors"] = r.errors;
+    o["seconds"] = r.seconds;
+    o["iops"] = static_cast<double>(r.ops) / seconds;
+    o["mb_per_s"] = static_cast<double>(r.bytes) / seconds / 1e6;
+    o["latency_us"] = {
+        {"p50", percentile(r.latencies, 0.50)},
+        {"p99", percentile(r.latencies, 0.99)},
+        {"p999", percentile(r.latencies, 0.999)},
+    };
+    if (r.syscalls && r.ops)
+    {
+        o["syscalls_per_op"] = static_cast<double>(*r.syscalls) / static_cast<double>(r.ops);
+    }
+    else
+    {
+        o["syscalls_per_op"] = nullptr;
+    }
+    return o;
+}
+
+void record(json::array &results, result r)
+{
+    std::fprintf(stderr, "%-10s %-17s %8zu B  qd %-3zu %10.0f IOPS  errors: %zu\n", r.name.c_str(),
+        r.backend.c_str(), r.block_size, r.queue_depth, r.seconds > 0 ? r.ops / r.seconds : 0.0, r.errors);
+    results.push_back(to_json(r));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const std::filesystem::path path = make_data_file();
+    const std::filesystem::path scratch = std::filesystem::temp_directory_path() / "bench_fileio_suite_append.dat";
+
+    if (!syscall_counter().available())
+    {
+        std::fprintf(stderr, "cannot count system calls through raw_syscalls:sys_enter; reporting none\n");
+    }
+
+    json::array results;
+    for (std::size_t block_size : BLOCK_SIZES)
+    {
+        for (std::size_t queue_depth : QUEUE_DEPTHS)
+        {
+            const std::array<io_case, 4> cases{{
+                {"seq_read", Pattern::SEQUENTIAL, false, block_size, queue_depth},
+                {"rand_read", Pattern::RANDOM, false, block_size, queue_depth},
+                {"seq_write", Pattern::SEQUENTIAL, true, block_size, queue_depth},
+                {"rand_write", Pattern::RANDOM, true, block_size, queue_depth},
+            }};
+            for (io_case const &c : cases)
+            {
+                record(results, ring_io(path, c));
+                record(results, pool_io(path, c));
+            }
+        }
+    }
+
+    record(results, ring_appends(scratch, false));
+    record(results, ring_appends(scratch, true));
+    record(results, pool_appends(scratch));
+    std::filesystem::remove(scratch);
+
+    record(results, ring_storm(path));
+    record(results, pool_storm(path));
+    std::filesystem::remove(path);
+
+    json::object report;
+    report["benchmark"] = "fileio";
+    report["file_size"] = FILE_SIZE;
+    report["results"] = std::move(results);
+    const std::string text = json::serialize(report);
+
+    if (argc > 1)
+    {
+        std::ofstream out(argv[1], std::ios::binary | std::ios::trunc);
+        out << text << '\n';
+        if (!out)
+        {
+            std::fprintf(stderr, "cannot write %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::printf("%s\n", text.c_str());
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+// Articles/sec for a streaming feed versus lock-step IHAVE.
+//
+// The peer is an in-process loopback server that answers every command as
+// soon as it arrives, so the measured rate is the sender's CPU cost.  Each
+// prepare()/receive() exchange is one round trip; the modelled rates add
+// that many RTTs to show what a real link would see.
+
+#include <nntp/FeedSender.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace nntp;
+
+namespace
+{
+
+constexpr std::size_t ARTICLE_COUNT{100000};
+constexpr std::size_t ARTICLE_SIZE{4096};
+constexpr std::size_t REFUSE_EVERY{4};
+
+class LoopbackPeer
+{
+public:
+    // Consume a batch of command bytes and append the responses
+    void feed(std::string_view data, std::string &responses)
+    {
+        while (!data.empty())
+        {
+            const std::size_t eol = data.find("\r\n");
+            const std::string_view line = data.substr(0, eol);
+            data.remove_prefix(eol + 2);
+
+            if (m_in_article)
+            {
+                if (line == ".")
+                {
+                    m_in_article = false;
+                    respond(responses, m_streaming ? "239 " : "235 ", m_current);
+                }
+                continue;
+            }
+
+            const std::size_t space = line.find(' ');
+            const std::string_view verb = line.substr(0, space);
+            const std::string_view id = line.substr(space + 1);
+            if (verb == "MODE")
+            {
+                responses.append("203 Streaming permitted\r\n");
+            }
+            else if (verb == "CHECK")
+            {
+                respond(responses, wanted() ? "238 " : "438 ", id);
+            }
+            else if (verb == "TAKETHIS")
+            {
+                m_streaming = true;
+                m_in_article = true;
+                m_current = id;
+            }
+            else if (verb == "IHAVE")
+            {
+                if (wanted())
+                {
+                    m_streaming = false;
+                    m_in_article = true;
+                    m_current = id;
+                    responses.append("335 Send it\r\n");
+                }
+                else
+                {
+                    responses.append("435 Not wanted\r\n");
+                }
+            }
+        }
+    }
+
+private:
+    bool wanted() noexcept
+    {
+        return ++m_offers % REFUSE_EVERY != 0;
+    }
+
+    static void respond(std::string &responses, std::string_view status, std::string_view id)
+    {
+        responses.append(status);
+        responses.append(id);
+        responses.append("\r\n");
+    }
+
+    std::size_t m_offers{};
+    bool m_in_article{};
+    bool m_streaming{};
+    std::string m_current;
+};
+
+struct Spool
+{
+    std::vector<MessageId> ids;
+    std::vector<std::size_t> offsets;
+    std::string articles;
+};
+
+Spool make_spool()
+{
+    Spool spool;
+    spool.ids.reserve(ARTICLE_COUNT);
+    spool.offsets.reserve(ARTICLE_COUNT + 1);
+    spool.articles.reserve(ARTICLE_COUNT * ARTICLE_SIZE);
+    for (std::size_t i = 0; i < ARTICLE_COUNT; ++i)
+    {
+        const std::string id = "<" + std::to_string(i) + "@bench.example>";
+        spool.ids.emplace_back(id);
+        spool.offsets.push_back(spool.articles.size());
+        std::string article = "Message-ID: " + id + "\r\nNewsgroups: misc.test\r\n\r\n";
+        while (article.size() + 2 < ARTICLE_SIZE)
+        {
+            article.append(std::min<std::size_t>(70, ARTICLE_SIZE - article.size() - 2), 'x');
+            article.append("\r\n");
+        }
+        spool.articles.append(article);
+    }
+    spool.offsets.push_back(spool.articles.size());
+    return spool;
+}
+
+void run(const char *name, FeedMode mode, const Spool &spool)
+{
+    using Clock = std::chrono::steady_clock;
+
+    FeedSender sender(mode);
+    LoopbackPeer peer;
+    const std::string_view articles = spool.articles;
+    for (std::size_t i = 0; i < ARTICLE_COUNT; ++i)
+    {
+        sender.offer(spool.ids[i], articles.substr(spool.offsets[i], spool.offsets[i + 1] - spool.offsets[i]));
+    }
+
+    std::string wire;
+    std::string responses;
+    std::size_t round_trips = 0;
+    std::size_t bytes = 0;
+    const Clock::time_point start = Clock::now();
+    while (!sender.idle())
+    {
+        wire.clear();
+        for (std::string_view buffer : sender.prepare())
+        {
+            wire.append(buffer);
+        }
+        bytes += wire.size();
+        responses.clear();
+        peer.feed(wire, responses);
+        sender.receive(responses);
+        sender.take_results();
+        ++round_trips;
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("%-9s %10.0f articles/s %8.1f MB/s %8zu round trips", name, ARTICLE_COUNT / seconds,
+        bytes / seconds / 1e6, round_trips);
+    for (const double rtt_ms : {1.0, 50.0})
+    {
+        const double modelled = seconds + round_trips * rtt_ms / 1000.0;
+        std::printf("  %5.0fms RTT: %9.0f articles/s", rtt_ms, ARTICLE_COUNT / modelled);
+    }
+    std::printf("\n  accepted %llu refused %llu\n",
+        static_cast<unsigned long long>(sender.count(FeedOutcome::ACCEPTED)),
+        static_cast<unsigned long long>(sender.count(FeedOutcome::REFUSED)));
+}
+
+} // namespace
+
+int main()
+{
+    const Spool spool = make_spool();
+
+    run("STREAMING", FeedMode::STREAMING, spool);
+    run("IHAVE", FeedMode::IHAVE, spool);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+// Ingest rate and retrieval latency of the cyclic article spool.
+//
+// The ingest run stores 2 GiB of articles between 1 KiB and 64 KiB into
+// four 256 MiB buffers, so the spool wraps twice, and reports the
+// sustained MB/s including the final flush.
+//
+// The retrieve run then fetches random articles among those still in the
+// spool, one at a time, and reports lookups per second with the p50, p99
+// and p999 latency.  The articles were just written, so most are served
+// from the page cache.
+
+#include <storage/cyclic_spool.h>
+
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <boost/corosio/io_context.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace nntp;
+using namespace boost;
+
+namespace
+{
+
+constexpr std::size_t BUFFERS{4};
+constexpr std::uint64_t BUFFER_SIZE{256 * 1024 * 1024};
+constexpr std::uint64_t INGEST_BYTES{2ull * 1024 * 1024 * 1024};
+constexpr std::size_t MIN_ARTICLE{1024};
+constexpr std::size_t MAX_ARTICLE{64 * 1024};
+constexpr std::size_t RETRIEVES{200000};
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<std::filesystem::path> spool_paths()
+{
+    std::vector<std::filesystem::path> paths;
+    for (std::size_t i = 0; i < BUFFERS; ++i)
+    {
+        paths.push_back(std::filesystem::temp_directory_path() / ("bench_spool" + std::to_string(i) + ".cyc"));
+        std::filesystem::remove(paths.back());
+    }
+    return paths;
+}
+
+capy::task<> ingest(cyclic_spool &spool, std::vector<spool_token> &tokens, std::size_t &errors)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<std::size_t> size(MIN_ARTICLE, MAX_ARTICLE);
+    const std::string body(MAX_ARTICLE, 'x');
+
+    std::uint64_t stored = 0;
+    while (stored < INGEST_BYTES)
+    {
+        const std::size_t length = size(rng);
+        spool_token token;
+        if (co_await spool.store(std::string_view(body.data(), length), token))
+            ++errors;
+        tokens.push_back(token);
+        stored += length;
+    }
+    if (co_await spool.flush())
+        ++errors;
+}
+
+capy::task<> retrieve(cyclic_spool &spool, std::vector<spool_token> const &tokens, std::vector<double> &latencies,
+    std::size_t &errors)
+{
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<std::size_t> pick(0, tokens.size() - 1);
+    std::string article;
+    for (std::size_t i = 0; i < RETRIEVES; ++i)
+    {
+        const Clock::time_point start = Clock::now();
+        if (co_await spool.retrieve(tokens[pick(rng)], article))
+            ++errors;
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+}
+
+double percentile(std::vector<double> const &sorted, double fraction)
+{
+    const auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size()));
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace
+
+int main()
+{
+    const std::vector<std::filesystem::path> paths = spool_paths();
+    corosio::io_context ctx;
+    cyclic_spool spool(ctx);
+    std::size_t errors = 0;
+
+    auto open = [&]() -> capy::task<>
+    {
+        if (co_await spool.open(paths, BUFFER_SIZE))
+            ++errors;
+    };
+    capy::run_async(ctx.get_executor())(open());
+    ctx.run();
+    if (errors)
+    {
+        std::printf("cannot open the spool in %s\n", std::filesystem::temp_directory_path().c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<spool_token> tokens;
+    capy::run_async(ctx.get_executor())(ingest(spool, tokens, errors));
+    Clock::time_point start = Clock::now();
+    ctx.restart();
+    ctx.run();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::printf("ingest:   %8.1f MB/s, %zu articles, errors: %zu\n", INGEST_BYTES / seconds / 1e6, tokens.size(),
+        errors);
+
+    // Only the last BUFFERS cycles are still in the spool
+    const std::uint64_t last_cycle = tokens.back().cycle;
+    std::erase_if(tokens, [&](spool_token const &t) { return t.cycle + BUFFERS <= last_cycle; });
+
+    errors = 0;
+    std::vector<double> latencies;
+    latencies.reserve(RETRIEVES);
+    capy::run_async(ctx.get_executor())(retrieve(spool, tokens, latencies, errors));
+    start = Clock::now();
+    ctx.restart();
+    ctx.run();
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("retrieve: %8.0f lookups/s, p50 %.1f us, p99 %.1f us, p999 %.1f us, errors: %zu\n",
+        RETRIEVES / seconds, percentile(latencies, 0.50), percentile(latencies, 0.99), percentile(latencies, 0.999),
+        errors);
+
+    auto close = [&]() -> capy::task<> { co_await spool.close(); };
+    capy::run_async(ctx.get_executor())(close());
+    ctx.restart();
+    ctx.run();
+
+    for (auto const &path : paths)
+        std::filesystem::remove(path);
+    return EXIT_SUCCESS;
+}
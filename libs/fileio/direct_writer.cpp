@@ -0,0 +1,88 @@
+#include <fileio/direct_writer.h>
+
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+
+#include <boost/capy/buffers.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace nntp {
+
+direct_writer::direct_writer(
+    file_stream& file,
+    std::uint64_t offset,
+    std::size_t capacity)
+    : file_(file)
+    , offset_(offset)
+{
+    if (capacity == 0 || !is_direct_aligned(capacity) || !is_direct_aligned(offset))
+        throw std::invalid_argument("direct_writer: offset and capacity must be block aligned");
+    buffer_.resize(capacity);
+}
+
+boost::capy::task<std::error_code>
+direct_writer::write(void const* data, std::size_t size)
+{
+    auto const* bytes = static_cast<std::byte const*>(data);
+    while (size > 0)
+    {
+        std::size_t n = std::min(size, buffer_.size() - staged_);
+        std::memcpy(buffer_.data() + staged_, bytes, n);
+        staged_ += n;
+        bytes += n;
+        size -= n;
+
+        // A full buffer is whole blocks and goes out as is
+        if (staged_ == buffer_.size())
+        {
+            if (auto ec = co_await write_staged(staged_))
+                co_return ec;
+            offset_ += staged_;
+            staged_ = 0;
+        }
+    }
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+direct_writer::flush()
+{
+    if (staged_ == 0)
+        co_return std::error_code();
+
+    // Pad the partial block; the padding is overwritten by later appends
+    std::size_t padded = direct_align_up(staged_);
+    std::memset(buffer_.data() + staged_, 0, padded - staged_);
+    if (auto ec = co_await write_staged(padded))
+        co_return ec;
+
+    // Keep the partial block staged so the next flush rewrites it whole
+    std::size_t whole = direct_align_down(staged_);
+    std::memmove(buffer_.data(), buffer_.data() + whole, staged_ - whole);
+    offset_ += whole;
+    staged_ -= whole;
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+direct_writer::write_staged(std::size_t length)
+{
+    std::size_t done = 0;
+    while (done < length)
+    {
+        auto [ec, n] = co_await file_.write_at(
+            offset_ + done,
+            boost::capy::const_buffer(buffer_.data() + done, length - done));
+        if (ec)
+            co_return ec;
+        if (n == 0)
+            co_return std::make_error_code(std::errc::io_error);
+        done += n;
+    }
+    co_return std::error_code();
+}
+
+} // namespace nntp
+
+#endif
@@ -1,4 +1,5 @@
 #include <fileio/file_stream.h>
+#include <fileio/file_service.h>
 #include <boost/corosio/detail/platform.hpp>
 
 #if BOOST_COROSIO_HAS_IOCP
@@ -32,7 +33,8 @@ std::error_code
 file_stream::open(
     std::filesystem::path const& path,
     access_mode access,
-    creation_mode creation)
+    creation_mode creation,
+    open_flags /*options*/)
 {
     if (!impl_)
         return std::make_error_code(std::errc::bad_file_descriptor);
@@ -131,6 +133,21 @@ file_stream::cancel() noexcept
     }
 }
 
+void
+configure_file_service(
+    boost::capy::execution_context& /*ctx*/,
+    file_service_options const& /*opts*/)
+{
+    // The completion port has no submission queue to size
+}
+
+file_service_stats
+get_file_service_stats(boost::capy::execution_context& /*ctx*/)
+{
+    // Overlapped I/O issues one call per operation; nothing to count
+    return {};
+}
+
 } // namespace nntp
 
 #elif defined(__linux__)
@@ -142,8 +159,74 @@ file_stream::cancel() noexcept
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include <utility>
+
 namespace nntp {
 
+namespace {
+
+// Convert file_stream modes to POSIX open flags
+int
+posix_open_flags(
+    file_stream::access_mode access,
+    file_stream::creation_mode creation,
+    file_stream::open_flags options) noexcept
+{
+    // Convert access mode to POSIX flags
+    int flags = 0;
+    if (access == file_stream::read_only)
+        flags = O_RDONLY;
+    else if (access == file_stream::write_only)
+        flags = O_WRONLY;
+    else if (access == (file_stream::read_only | file_stream::write_only))
+        flags = O_RDWR;
+
+    // Convert creation mode to POSIX flags
+    switch (creation)
+    {
+    case file_stream::open_existing:
+        // No additional flags - file must exist
+        break;
+    case file_stream::create_new:
+        flags |= O_CREAT | O_EXCL;
+        break;
+    case file_stream::create_always:
+        flags |= O_CREAT | O_TRUNC;
+        break;
+    case file_stream::open_always:
+        flags |= O_CREAT;
+        break;
+    }
+
+    // Bypass the page cache
+    if (options & file_stream::direct)
+        flags |= O_DIRECT;
+
+    return flags;
+}
+
+// Convert an access pattern to posix_fadvise advice
+int
+to_fadvise(file_stream::access_pattern pattern) noexcept
+{
+    switch (pattern)
+    {
+    case file_stream::sequential:
+        return POSIX_FADV_SEQUENTIAL;
+    case file_stream::random:
+        return POSIX_FADV_RANDOM;
+    case file_stream::willneed:
+        return POSIX_FADV_WILLNEED;
+    case file_stream::dontneed:
+        return POSIX_FADV_DONTNEED;
+    case file_stream::normal:
+    default:
+        return POSIX_FADV_NORMAL;
+    }
+}
+
+} // namespace
+
 using file_service = detail::uring_file_service;
 using file_impl = detail::uring_file_impl;
 
@@ -165,42 +248,17 @@ std::error_code
 file_stream::open(
     std::filesystem::path const& path,
     access_mode access,
-    creation_mode creation)
+    creation_mode creation,
+    open_flags options)
 {
     if (!impl_)
         return std::make_error_code(std::errc::bad_file_descriptor);
 
-    // Convert access mode to POSIX flags
-    int flags = 0;
-    if (access == read_only)
-        flags = O_RDONLY;
-    else if (access == write_only)
-        flags = O_WRONLY;
-    else if (access == (read_only | write_only))
-        flags = O_RDWR;
-
-    // Convert creation mode to POSIX flags
-    switch (creation)
-    {
-    case open_existing:
-        // No additional flags - file must exist
-        break;
-    case create_new:
-        flags |= O_CREAT | O_EXCL;
-        break;
-    case create_always:
-        flags |= O_CREAT | O_TRUNC;
-        break;
-    case open_always:
-        flags |= O_CREAT;
-        break;
-    }
-
     // Open file through service
     return svc_->open_file(
         *impl_->get_internal(),
         path,
-        flags,
+        posix_open_flags(access, creation, options),
         0644);  // Default permissions: rw-r--r--
 }
 
@@ -265,6 +323,260 @@ file_stream::cancel() noexcept
     }
 }
 
+//------------------------------------------------------------------------------
+// Registered buffers
+
+file_stream::fixed_buffer
+file_stream::lease_buffer() noexcept
+{
+    int index = svc_->lease_buffer();
+    if (index < 0)
+        return {};
+    return fixed_buffer(svc_, index, svc_->buffer_data(index), svc_->buffer_size());
+}
+
+file_stream::fixed_awaitable
+file_stream::read_fixed(fixed_buffer& buf, std::size_t size) noexcept
+{
+    return fixed_awaitable(*this, buf, size, false);
+}
+
+file_stream::fixed_awaitable
+file_stream::write_fixed(fixed_buffer const& buf, std::size_t size) noexcept
+{
+    return fixed_awaitable(*this, buf, size, true);
+}
+
+std::coroutine_handle<>
+file_stream::start_fixed(
+    bool write,
+    fixed_buffer const& buf,
+    std::size_t size,
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred)
+{
+    if (!impl_ || !buf || size > buf.size())
+    {
+        *ec = std::make_error_code(std::errc::invalid_argument);
+        *bytes_transferred = 0;
+        return h;
+    }
+
+    auto* internal = impl_->get_internal();
+    if (write)
+        return internal->write_fixed(
+            h, ex, buf.data(), size, buf.index_, std::move(token), ec, bytes_transferred);
+    return internal->read_fixed(
+        h, ex, buf.data(), size, buf.index_, std::move(token), ec, bytes_transferred);
+}
+
+file_stream::control_awaitable
+file_stream::async_open(
+    std::filesystem::path path,
+    access_mode access,
+    creation_mode creation,
+    open_flags flags)
+{
+    control_awaitable aw(*this, control_kind::open);
+    aw.path_ = std::move(path);
+    aw.flags_ = posix_open_flags(access, creation, flags);
+    return aw;
+}
+
+file_stream::control_awaitable
+file_stream::async_close()
+{
+    return control_awaitable(*this, control_kind::close);
+}
+
+file_stream::control_awaitable
+file_stream::fsync()
+{
+    return control_awaitable(*this, control_kind::fsync);
+}
+
+file_stream::control_awaitable
+file_stream::fdatasync()
+{
+    return control_awaitable(*this, control_kind::fdatasync);
+}
+
+file_stream::control_awaitable
+file_stream::fallocate(std::uint64_t offset, std::uint64_t length)
+{
+    control_awaitable aw(*this, control_kind::fallocate);
+    aw.offset_ = offset;
+    aw.length_ = length;
+    return aw;
+}
+
+file_stream::control_awaitable
+file_stream::advise(access_pattern pattern, std::uint64_t offset, std::uint64_t length)
+{
+    control_awaitable aw(*this, control_kind::fadvise);
+    aw.pattern_ = pattern;
+    aw.offset_ = offset;
+    aw.length_ = length;
+    return aw;
+}
+
+file_stream::control_awaitable
+file_stream::prefetch(std::uint64_t offset, std::uint64_t length)
+{
+    return advise(willneed, offset, length);
+}
+
+file_stream::control_awaitable
+file_stream::async_size()
+{
+    return control_awaitable(*this, control_kind::size);
+}
+
+std::coroutine_handle<>
+file_stream::start_control(control_awaitable& aw, std::coroutine_handle<> h)
+{
+    if (!impl_)
+    {
+        aw.ec_ = std::make_error_code(std::errc::bad_file_descriptor);
+        return h;
+    }
+
+    using kind = detail::file_ctl_op::kind;
+    auto* internal = impl_->get_internal();
+    switch (aw.what_)
+    {
+    case control_kind::open:
+        return internal->open_async(h, aw.path_, aw.flags_, 0644, &aw.ec_);
+    case control_kind::close:
+        return internal->close_async(h, &aw.ec_);
+    case control_kind::fsync:
+        return internal->control_async(h, kind::fsync, 0, 0, &aw.ec_, &aw.value_);
+    case control_kind::fdatasync:
+        return internal->control_async(h, kind::fdatasync, 0, 0, &aw.ec_, &aw.value_);
+    case control_kind::fallocate:
+        return internal->control_async(
+            h, kind::fallocate, aw.offset_, aw.length_, &aw.ec_, &aw.value_);
+    case control_kind::fadvise:
+        return internal->fadvise_async(
+            h, to_fadvise(aw.pattern_), aw.offset_, aw.length_, &aw.ec_);
+    case control_kind::size:
+        break;
+    }
+    return internal->control_async(h, kind::statx, 0, 0, &aw.ec_, &aw.value_);
+}
+
+std::coroutine_handle<>
+file_stream::start_splice(
+    splice_awaitable& aw,
+    std::coroutine_handle<> h,
+    std::stop_token token)
+{
+    if (!impl_)
+    {
+        aw.ec_ = std::make_error_code(std::errc::bad_file_descriptor);
+        return h;
+    }
+
+    return impl_->get_internal()->splice_to(
+        h, aw.sock_fd_, aw.offset_, aw.length_, std::move(token), &aw.ec_, &aw.n_);
+}
+
+std::coroutine_handle<>
+file_stream::start_at(
+    at_kind kind,
+    std::uint64_t offset,
+    boost::corosio::io_buffer_param buffers,
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred,
+    std::chrono::nanoseconds timeout)
+{
+    if (!impl_ || !is_open())
+    {
+        *ec = std::make_error_code(std::errc::bad_file_descriptor);
+        *bytes_transferred = 0;
+        return h;
+    }
+
+    auto* internal = impl_->get_internal();
+    switch (kind)
+    {
+    case at_kind::write:
+        return internal->write_at(
+            h, ex, offset, buffers, std::move(token), ec, bytes_transferred, timeout);
+    case at_kind::write_durable:
+        return internal->write_durable_at(
+            h, ex, offset, buffers, std::move(token), ec, bytes_transferred);
+    case at_kind::read_some:
+        return internal->read_some_for(
+            h, ex, buffers, timeout, std::move(token), ec, bytes_transferred);
+    case at_kind::write_some:
+        return internal->write_some_for(
+            h, ex, buffers, timeout, std::move(token), ec, bytes_transferred);
+    case at_kind::read:
+        break;
+    }
+    return internal->read_at(
+        h, ex, offset, buffers, std::move(token), ec, bytes_transferred, timeout);
+}
+
+file_stream::fixed_buffer::fixed_buffer(fixed_buffer&& other) noexcept
+    : svc_(std::exchange(other.svc_, nullptr))
+    , index_(std::exchange(other.index_, -1))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+{
+}
+
+file_stream::fixed_buffer&
+file_stream::fixed_buffer::operator=(fixed_buffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        svc_ = std::exchange(other.svc_, nullptr);
+        index_ = std::exchange(other.index_, -1);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+file_stream::fixed_buffer::~fixed_buffer()
+{
+    release();
+}
+
+void
+file_stream::fixed_buffer::release() noexcept
+{
+    if (svc_)
+    {
+        svc_->release_buffer(index_);
+        svc_ = nullptr;
+        data_ = nullptr;
+    }
+}
+
+void
+configure_file_service(
+    boost::capy::execution_context& ctx,
+    file_service_options const& opts)
+{
+    ctx.make_service<file_service>(opts);
+}
+
+file_service_stats
+get_file_service_stats(boost::capy::execution_context& ctx)
+{
+    return ctx.use_service<file_service>().stats();
+}
+
 } // namespace nntp
 
 #elif defined(__APPLE__)
@@ -299,7 +611,8 @@ std::error_code
 file_stream::open(
     std::filesystem::path const& path,
     access_mode access,
-    creation_mode creation)
+    creation_mode creation,
+    open_flags /*options*/)
 {
     if (!impl_)
         return std::make_error_code(std::errc::bad_file_descriptor);
@@ -399,6 +712,21 @@ file_stream::cancel() noexcept
     }
 }
 
+void
+configure_file_service(
+    boost::capy::execution_context& /*ctx*/,
+    file_service_options const& /*opts*/)
+{
+    // Dispatch I/O has no submission queue to size
+}
+
+file_service_stats
+get_file_service_stats(boost::capy::execution_context& /*ctx*/)
+{
+    // Dispatch I/O issues one call per operation; nothing to count
+    return {};
+}
+
 } // namespace nntp
 
 #endif // __APPLE__
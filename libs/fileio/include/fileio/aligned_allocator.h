@@ -0,0 +1,93 @@
+#ifndef NNTP_ALIGNED_ALLOCATOR_H
+#define NNTP_ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace nntp {
+
+/** Alignment required for buffers, lengths and offsets of direct I/O.
+
+    O_DIRECT requires alignment to the logical block size of the
+    device, which is at most the page size on the devices a spool
+    lives on.
+*/
+inline constexpr std::size_t direct_io_alignment = 4096;
+
+/** Check whether a length or file offset suits direct I/O. */
+constexpr bool
+is_direct_aligned(std::uint64_t value) noexcept
+{
+    return value % direct_io_alignment == 0;
+}
+
+/** Check whether a memory address suits direct I/O. */
+inline bool
+is_direct_aligned(void const* p) noexcept
+{
+    return reinterpret_cast<std::uintptr_t>(p) % direct_io_alignment == 0;
+}
+
+/** Round a length up to the direct I/O alignment. */
+constexpr std::uint64_t
+direct_align_up(std::uint64_t value) noexcept
+{
+    return (value + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+}
+
+/** Round a length or offset down to the direct I/O alignment. */
+constexpr std::uint64_t
+direct_align_down(std::uint64_t value) noexcept
+{
+    return value / direct_io_alignment * direct_io_alignment;
+}
+
+/** Allocator returning memory aligned for direct I/O.
+
+    @tparam T The element type.
+    @tparam Alignment The alignment in bytes, a power of two.
+*/
+template<class T, std::size_t Alignment = direct_io_alignment>
+class aligned_allocator
+{
+public:
+    using value_type = T;
+
+    template<class U>
+    struct rebind
+    {
+        using other = aligned_allocator<U, Alignment>;
+    };
+
+    aligned_allocator() noexcept = default;
+
+    template<class U>
+    aligned_allocator(aligned_allocator<U, Alignment> const&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template<class U>
+    bool operator==(aligned_allocator<U, Alignment> const&) const noexcept
+    {
+        return true;
+    }
+};
+
+/** A contiguous buffer aligned for direct I/O. */
+using aligned_buffer = std::vector<std::byte, aligned_allocator<std::byte>>;
+
+} // namespace nntp
+
+#endif // NNTP_ALIGNED_ALLOCATOR_H
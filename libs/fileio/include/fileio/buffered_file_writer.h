@@ -0,0 +1,422 @@
+#ifndef NNTP_BUFFERED_FILE_WRITER_H
+#define NNTP_BUFFERED_FILE_WRITER_H
+
+#include <fileio/aligned_allocator.h>
+#include <fileio/file_stream.h>
+#include <boost/corosio/detail/platform.hpp>
+
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+
+#include <boost/capy/buffers.hpp>
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <boost/corosio/timer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <stop_token>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace nntp {
+
+/** Write-behind appender that coalesces small writes into blocks.
+
+    Overview and history files grow by records of a few dozen bytes,
+    and writing each one to the file costs a full operation. The
+    writer copies appended records into a block of block_size bytes
+    and writes the block once it fills, while the caller keeps
+    appending into the next one. Up to max_in_flight blocks are on
+    their way to the file at once; write() only waits when every
+    block is busy.
+
+    Blocks start at multiples of block_size. A partial block written
+    by flush() or the flush interval is followed by a short block
+    that ends on the next boundary, so later blocks are aligned
+    again.
+
+    The first write error is sticky: it is returned by every later
+    write() and flush(), and nothing more is written.
+
+    Writes, and the timer behind the flush interval, are started as
+    detached tasks on the executor, and writes refer to the file.
+    Call flush() before closing the file or destroying the writer,
+    so no write is left in flight.
+
+    @par Thread Safety
+    Distinct objects: Safe.
+    Shared objects: Unsafe. Only one write or flush may be
+    outstanding at a time, and the executor must be single threaded
+    or otherwise serialize the writer with its block writes and
+    flush timer.
+*/
+template<class Executor>
+class buffered_file_writer
+{
+public:
+    /** Default size of a block in bytes. */
+    static constexpr std::size_t default_block_size = 256 * 1024;
+
+    /** Construct a writer.
+
+        @param ex Executor the block writes run on.
+        @param file The open file to append to.
+        @param offset File offset of the first byte to write.
+        @param block_size Size of a block in bytes.
+        @param max_in_flight Number of blocks that may be written at
+            once. Two gives double buffering, three triple.
+
+        @throws std::invalid_argument if block_size is zero or not a
+            multiple of direct_io_alignment, or max_in_flight is zero.
+    */
+    buffered_file_writer(
+        Executor ex,
+        file_stream& file,
+        std::uint64_t offset = 0,
+        std::size_t block_size = default_block_size,
+        std::size_t max_in_flight = 2);
+
+    /** Destroy the writer, cancelling a pending flush timer. */
+    ~buffered_file_writer();
+
+    buffered_file_writer(buffered_file_writer const&) = delete;
+    buffered_file_writer& operator=(buffered_file_writer const&) = delete;
+
+    /** Append data.
+
+        The data is copied, so the caller's buffer may be reused as
+        soon as the returned task completes. The task completes once
+        the data is staged, which only waits when the block to fill
+        next is still being written.
+
+        @param data The bytes to append.
+        @param size Number of bytes to append.
+
+        @return A task yielding the first write error, if any.
+    */
+    boost::capy::task<std::error_code> write(void const* data, std::size_t size);
+
+    /** Write all staged data and wait for every block in flight.
+
+        Also cancels the flush timer, so an idle writer does not
+        keep the executor's context running.
+
+        @return A task yielding the first write error, if any.
+    */
+    boost::capy::task<std::error_code> flush();
+
+    /** Bound how long appended data may stay staged.
+
+        A timer is armed when data is staged into an empty block.
+        When it expires, the partial block is written without
+        waiting for it to fill, even if no write() follows. Zero,
+        the default, disables the timer.
+    */
+    void set_flush_interval(std::chrono::steady_clock::duration interval);
+
+    /** Get the file offset just past the last appended byte. */
+    std::uint64_t end() const noexcept { return offset_ + staged_; }
+
+    /** Get the number of bytes appended but not yet handed to the file. */
+    std::size_t staged() const noexcept { return staged_; }
+
+    /** Get the number of blocks being written. */
+    std::size_t in_flight() const noexcept;
+
+private:
+    struct block
+    {
+        aligned_buffer data;
+        std::uint64_t offset = 0;
+        std::size_t size = 0;
+        bool busy = false;
+        std::error_code ec;
+
+        /** The writer waiting for this block, if any. */
+        std::coroutine_handle<> waiter;
+    };
+
+    class wait_awaitable
+    {
+        block& b_;
+
+    public:
+        explicit wait_awaitable(block& b) noexcept : b_(b) {}
+
+        bool await_ready() const noexcept { return !b_.busy; }
+
+        template<class Ex>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> h, Ex const&, std::stop_token)
+        {
+            b_.waiter = h;
+            return std::noop_coroutine();
+        }
+
+        std::error_code await_resume() const noexcept { return b_.ec; }
+    };
+
+    /** Flush timer, shared with the task waiting on it. */
+    struct flush_timer
+    {
+        boost::corosio::timer timer;
+
+        /** The writer, or null once it has been destroyed. */
+        buffered_file_writer* owner;
+
+        /** Whether a task is waiting on the timer. */
+        bool armed = false;
+
+        flush_timer(boost::capy::execution_context& ctx, buffered_file_writer* w)
+            : timer(ctx)
+            , owner(w)
+        {
+        }
+    };
+
+    static boost::capy::task<> write_block(
+        Executor ex, file_stream& file, std::shared_ptr<block> b);
+    static boost::capy::task<> expire(std::shared_ptr<flush_timer> t);
+
+    void launch();
+    void arm();
+
+    Executor ex_;
+    file_stream& file_;
+
+    /** Shared with the block writes, which may outlive a write() call. */
+    std::vector<std::shared_ptr<block>> blocks_;
+
+    /** The block being filled. */
+    std::size_t current_ = 0;
+
+    /** File offset of the first byte of the current block. */
+    std::uint64_t offset_;
+
+    std::size_t staged_ = 0;
+
+    /** Bytes the current block may hold before it ends on a boundary. */
+    std::size_t limit_;
+
+    std::size_t block_size_;
+    std::chrono::steady_clock::duration flush_interval_{};
+    std::chrono::steady_clock::time_point staged_since_;
+    std::shared_ptr<flush_timer> timer_;
+    std::error_code error_;
+};
+
+//------------------------------------------------------------------------------
+
+template<class Executor>
+buffered_file_writer<Executor>::buffered_file_writer(
+    Executor ex,
+    file_stream& file,
+    std::uint64_t offset,
+    std::size_t block_size,
+    std::size_t max_in_flight)
+    : ex_(std::move(ex))
+    , file_(file)
+    , offset_(offset)
+    , block_size_(block_size)
+{
+    if (block_size == 0 || !is_direct_aligned(block_size))
+        throw std::invalid_argument("buffered_file_writer: block_size must be block aligned");
+    if (max_in_flight == 0)
+        throw std::invalid_argument("buffered_file_writer: max_in_flight must not be zero");
+
+    // One block fills while the others are written
+    blocks_.reserve(max_in_flight + 1);
+    for (std::size_t i = 0; i <= max_in_flight; ++i)
+    {
+        auto b = std::make_shared<block>();
+        b->data.resize(block_size);
+        blocks_.push_back(std::move(b));
+    }
+    limit_ = block_size_ - static_cast<std::size_t>(offset_ % block_size_);
+}
+
+template<class Executor>
+buffered_file_writer<Executor>::~buffered_file_writer()
+{
+    // The waiting task owns the timer and finds the writer gone
+    if (timer_)
+    {
+        timer_->owner = nullptr;
+        timer_->timer.cancel();
+    }
+}
+
+template<class Executor>
+void
+buffered_file_writer<Executor>::set_flush_interval(
+    std::chrono::steady_clock::duration interval)
+{
+    flush_interval_ = interval;
+    if (staged_ != 0 && interval.count() != 0)
+    {
+        staged_since_ = std::chrono::steady_clock::now();
+        arm();
+    }
+}
+
+template<class Executor>
+std::size_t
+buffered_file_writer<Executor>::in_flight() const noexcept
+{
+    return static_cast<std::size_t>(std::count_if(
+        blocks_.begin(), blocks_.end(), [](auto const& b) { return b->busy; }));
+}
+
+template<class Executor>
+boost::capy::task<>
+buffered_file_writer<Executor>::write_block(
+    Executor ex, file_stream& file, std::shared_ptr<block> b)
+{
+    std::size_t done = 0;
+    while (done < b->size)
+    {
+        auto [ec, n] = co_await file.write_at(
+            b->offset + done,
+            boost::capy::const_buffer(b->data.data() + done, b->size - done));
+        if (ec)
+        {
+            b->ec = ec;
+            break;
+        }
+        if (n == 0)
+        {
+            b->ec = std::make_error_code(std::errc::io_error);
+            break;
+        }
+        done += n;
+    }
+
+    // Posted rather than resumed here, so the writer does not run
+    // nested inside this task
+    b->busy = false;
+    if (auto h = std::exchange(b->waiter, nullptr))
+        ex.post(h);
+}
+
+template<class Executor>
+boost::capy::task<>
+buffered_file_writer<Executor>::expire(std::shared_ptr<flush_timer> t)
+{
+    for (;;)
+    {
+        // Cancellation is not final: flush() cancels, and data may be
+        // staged again before this task resumes
+        co_await t->timer.wait();
+
+        auto* w = t->owner;
+        if (!w)
+            co_return;
+        if (w->staged_ == 0 || w->error_ || w->flush_interval_.count() == 0)
+            break;
+
+        auto due = w->staged_since_ + w->flush_interval_;
+        if (std::chrono::steady_clock::now() >= due)
+        {
+            w->launch();
+            break;
+        }
+        t->timer.expires_at(due);
+    }
+    t->armed = false;
+}
+
+template<class Executor>
+void
+buffered_file_writer<Executor>::arm()
+{
+    if (!timer_)
+        timer_ = std::make_shared<flush_timer>(ex_.context(), this);
+    if (timer_->armed)
+        return;
+
+    // A task already waiting re-reads staged_since_ when it wakes
+    timer_->armed = true;
+    timer_->timer.expires_at(staged_since_ + flush_interval_);
+    boost::capy::run_async(ex_)(expire(timer_));
+}
+
+template<class Executor>
+void
+buffered_file_writer<Executor>::launch()
+{
+    auto& b = blocks_[current_];
+    b->offset = offset_;
+    b->size = staged_;
+    b->busy = true;
+    boost::capy::run_async(ex_)(write_block(ex_, file_, b));
+
+    offset_ += staged_;
+    staged_ = 0;
+    limit_ = block_size_ - static_cast<std::size_t>(offset_ % block_size_);
+    current_ = (current_ + 1) % blocks_.size();
+}
+
+template<class Executor>
+boost::capy::task<std::error_code>
+buffered_file_writer<Executor>::write(void const* data, std::size_t size)
+{
+    auto const* bytes = static_cast<std::byte const*>(data);
+    while (size > 0 && !error_)
+    {
+        // The block to fill may still be on its way to the file
+        auto& b = *blocks_[current_];
+        if (b.busy)
+            co_await wait_awaitable(b);
+        if (b.ec)
+        {
+            error_ = b.ec;
+            break;
+        }
+
+        if (staged_ == 0 && flush_interval_.count() != 0)
+        {
+            staged_since_ = std::chrono::steady_clock::now();
+            arm();
+        }
+
+        std::size_t n = std::min(size, limit_ - staged_);
+        std::memcpy(b.data.data() + staged_, bytes, n);
+        staged_ += n;
+        bytes += n;
+        size -= n;
+
+        if (staged_ == limit_)
+            launch();
+    }
+    co_return error_;
+}
+
+template<class Executor>
+boost::capy::task<std::error_code>
+buffered_file_writer<Executor>::flush()
+{
+    if (staged_ != 0 && !error_)
+        launch();
+    if (timer_)
+        timer_->timer.cancel();
+
+    for (auto const& b : blocks_)
+    {
+        if (b->busy)
+            co_await wait_awaitable(*b);
+        if (b->ec && !error_)
+            error_ = b->ec;
+    }
+    co_return error_;
+}
+
+} // namespace nntp
+
+#endif
+
+#endif // NNTP_BUFFERED_FILE_WRITER_H
@@ -10,6 +10,10 @@
 #include <boost/capy/coro.hpp>
 #include "src/detail/intrusive.hpp"
 #include "src/detail/cached_initiator.hpp"
+#include <liburing.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <memory>
 #include <cstdint>
 #include <stop_token>
@@ -23,19 +27,24 @@ class uring_file_impl;
 /** Internal file state for io_uring-based I/O.
 
     This class contains the actual state for a single file, including
-    the native file descriptor and pending operations. It derives from
-    enable_shared_from_this so operations can extend its lifetime.
+    the native file descriptor and pending operations. It is reference
+    counted through file_ref: the wrapper holds one reference and each
+    pending operation another, and the last to go destroys it.
 
     @note Internal implementation detail. Users interact with file_stream class.
 */
 class uring_file_impl_internal
     : public boost::corosio::detail::intrusive_list<uring_file_impl_internal>::node
-    , public std::enable_shared_from_this<uring_file_impl_internal>
 {
+    friend class file_ref;
     friend class uring_file_service;
     friend class uring_file_impl;
     friend struct file_read_op;
     friend struct file_write_op;
+    friend struct file_at_op;
+    friend struct file_ctl_op;
+    friend struct file_splice_op;
+    friend struct file_commit_group;
 
 public:
     explicit uring_file_impl_internal(uring_file_service& svc) noexcept;
@@ -63,6 +72,29 @@ public:
         std::error_code* ec,
         std::size_t* bytes_transferred);
 
+    /** Asynchronously read using a registered buffer.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param data Start of the region to read into, inside the buffer
+        @param size Number of bytes to read
+        @param buf_index Index of the registered buffer
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> read_fixed(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        void* data,
+        std::size_t size,
+        int buf_index,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred);
+
     /** Asynchronously write data to the file.
 
         @param h Coroutine handle to resume
@@ -82,6 +114,250 @@ public:
         std::error_code* ec,
         std::size_t* bytes_transferred);
 
+    /** Asynchronously write using a registered buffer.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param data Start of the region to write from, inside the buffer
+        @param size Number of bytes to write
+        @param buf_index Index of the registered buffer
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> write_fixed(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        void const* data,
+        std::size_t size,
+        int buf_index,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred);
+
+    /** Asynchronously read at an explicit offset.
+
+        Unlike read_some, any number of positional operations may be
+        in flight on the same file, and the file position is neither
+        used nor updated.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param offset Byte offset in the file to read from
+        @param buffers Buffer sequence to read into
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+        @param timeout Time limit, or zero for none. An operation
+            still running when it expires fails with
+            std::errc::timed_out.
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> read_at(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        std::uint64_t offset,
+        boost::corosio::io_buffer_param buffers,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred,
+        std::chrono::nanoseconds timeout = {});
+
+    /** Asynchronously write at an explicit offset.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param offset Byte offset in the file to write to
+        @param buffers Buffer sequence to write from
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+        @param timeout Time limit, or zero for none.
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> write_at(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        std::uint64_t offset,
+        boost::corosio::io_buffer_param buffers,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred,
+        std::chrono::nanoseconds timeout = {});
+
+    /** Asynchronously read at the file position with a time limit.
+
+        Runs as a positional operation at the current position and
+        moves the position by the bytes read, so the read can carry
+        a linked timeout. Like read_some, only one may be in flight.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param buffers Buffer sequence to read into
+        @param timeout Time limit; must be positive
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> read_some_for(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        boost::corosio::io_buffer_param buffers,
+        std::chrono::nanoseconds timeout,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred);
+
+    /** Asynchronously write at the file position with a time limit.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param buffers Buffer sequence to write from
+        @param timeout Time limit; must be positive
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> write_some_for(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        boost::corosio::io_buffer_param buffers,
+        std::chrono::nanoseconds timeout,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred);
+
+    /** Asynchronously write at an offset and make the data durable.
+
+        The write is submitted linked to an fdatasync, and durable
+        writes issued on this file during the same scheduler turn
+        share that fdatasync (group commit). Completes when both the
+        write and the fdatasync have finished. A short write reports
+        the bytes written with std::errc::io_error, since the chain
+        stops there and the data is not synced.
+
+        @param h Coroutine handle to resume
+        @param ex Executor to resume on
+        @param offset Byte offset in the file to write to
+        @param buffers Buffer sequence to write from
+        @param token Cancellation token (unused; the chain runs to completion)
+        @param ec Output error code
+        @param bytes_transferred Output bytes transferred
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> write_durable_at(
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        std::uint64_t offset,
+        boost::corosio::io_buffer_param buffers,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred);
+
+    /** Asynchronously open a file with IORING_OP_OPENAT.
+
+        A file that is already open is closed asynchronously first.
+
+        @param h Coroutine handle to resume
+        @param path Path to the file
+        @param flags POSIX open flags
+        @param mode Permissions for a created file
+        @param ec Output error code
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> open_async(
+        std::coroutine_handle<> h,
+        std::filesystem::path const& path,
+        int flags,
+        int mode,
+        std::error_code* ec);
+
+    /** Asynchronously close the file with IORING_OP_CLOSE.
+
+        Pending operations are cancelled and the descriptor is
+        detached at once, so the file reads as closed immediately.
+
+        @param h Coroutine handle to resume
+        @param ec Output error code
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> close_async(
+        std::coroutine_handle<> h,
+        std::error_code* ec);
+
+    /** Asynchronously run fsync, fdatasync, fallocate or statx.
+
+        @param h Coroutine handle to resume
+        @param what The operation to perform
+        @param offset Start of the range, for fallocate
+        @param length Length of the range, for fallocate
+        @param ec Output error code
+        @param value Output file size, for statx
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> control_async(
+        std::coroutine_handle<> h,
+        file_ctl_op::kind what,
+        std::uint64_t offset,
+        std::uint64_t length,
+        std::error_code* ec,
+        std::uint64_t* value);
+
+    /** Asynchronously give posix_fadvise advice for a range.
+
+        @param h Coroutine handle to resume
+        @param advice One of the POSIX_FADV_ constants
+        @param offset Start of the range
+        @param length Length of the range, or zero for the rest of the file
+        @param ec Output error code
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> fadvise_async(
+        std::coroutine_handle<> h,
+        int advice,
+        std::uint64_t offset,
+        std::uint64_t length,
+        std::error_code* ec);
+
+    /** Asynchronously send a range of the file to a socket.
+
+        Splices the range through a pipe, or reads and sends it
+        through a buffer where the kernel cannot splice it. Completes
+        once the whole range is delivered, the end of the file is
+        reached, or an error occurs.
+
+        @param h Coroutine handle to resume
+        @param sock_fd Socket descriptor to send to
+        @param offset Byte offset in the file of the range
+        @param length Length of the range in bytes
+        @param token Cancellation token
+        @param ec Output error code
+        @param bytes_transferred Output bytes delivered to the socket
+
+        @return Coroutine handle to resume (may be noop_coroutine if suspended)
+    */
+    std::coroutine_handle<> splice_to(
+        std::coroutine_handle<> h,
+        int sock_fd,
+        std::uint64_t offset,
+        std::uint64_t length,
+        std::stop_token token,
+        std::error_code* ec,
+        std::uint64_t* bytes_transferred);
+
     /** Get the native file descriptor. */
     int native_handle() const noexcept { return fd_; }
 
@@ -104,6 +380,73 @@ private:
     /** Set the file descriptor. */
     void set_fd(int fd) noexcept { fd_ = fd; }
 
+    /** Take ownership of a newly opened descriptor.
+
+        @param fd The open file descriptor.
+        @param flags The flags it was opened with.
+    */
+    void attach(int fd, int flags) noexcept;
+
+    /** Release the descriptor without closing it.
+
+        The registered table slot is freed.
+
+        @return The descriptor, or -1 if the file was not open.
+    */
+    int detach() noexcept;
+
+    /** Start a management operation. */
+    std::coroutine_handle<> start_ctl(
+        file_ctl_op* op,
+        std::coroutine_handle<> h,
+        std::error_code* ec,
+        std::uint64_t* value);
+
+    /** Record whether the file was opened with O_DIRECT. */
+    void set_direct(bool direct) noexcept { direct_ = direct; }
+
+    /** Check a request against the O_DIRECT alignment rules.
+
+        @return true if the file is buffered or the request is aligned.
+    */
+    bool direct_ok(
+        boost::corosio::io_buffer_param buffers,
+        std::uint64_t offset) const noexcept;
+
+    /** Set the slot in the service's registered file table. */
+    void set_file_index(int index) noexcept { file_index_ = index; }
+
+    /** Get the descriptor to place in an SQE.
+
+        @return The registered table slot if the file has one,
+            otherwise the plain file descriptor.
+    */
+    int sqe_fd() const noexcept { return file_index_ != -1 ? file_index_ : fd_; }
+
+    /** Flag an SQE prepared with sqe_fd() as using the registered table.
+
+        Must be called after the io_uring_prep_* function, which
+        resets the flags.
+    */
+    void set_sqe_flags(io_uring_sqe* sqe) const noexcept
+    {
+        if (file_index_ != -1)
+            sqe->flags |= IOSQE_FIXED_FILE;
+    }
+
+    /** Start a positional operation. */
+    std::coroutine_handle<> start_at(
+        bool write,
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        std::uint64_t offset,
+        boost::corosio::io_buffer_param buffers,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred,
+        std::chrono::nanoseconds timeout,
+        bool advance);
+
     /** Submit a read SQE to io_uring. */
     void do_read_io();
 
@@ -116,15 +459,36 @@ private:
     /** Native file descriptor. */
     int fd_ = -1;
 
+    /** Slot in the registered file table, or -1 if not registered. */
+    int file_index_ = -1;
+
     /** Current file position. */
     std::uint64_t position_ = 0;
 
+    /** Flag indicating the file bypasses the page cache. */
+    bool direct_ = false;
+
     /** Read operation state. */
     file_read_op rd_;
 
     /** Write operation state. */
     file_write_op wr_;
 
+    /** The async_open or async_close in flight, or nullptr. */
+    file_ctl_op* lifecycle_op_ = nullptr;
+
+    /** Durable writes gathered this turn, or nullptr. */
+    file_commit_group* commit_group_ = nullptr;
+
+    /** Positional operations in progress. */
+    boost::corosio::detail::intrusive_list<file_at_op> at_ops_;
+
+    /** Number of file_refs to this file. */
+    std::atomic<std::size_t> refs_{0};
+
+    /** True if file_refs may be taken and dropped on several threads. */
+    bool shared_refs_;
+
     /** Cached initiator for read operations. */
     boost::corosio::detail::cached_initiator read_initiator_;
 
@@ -135,7 +499,7 @@ private:
 /** Wrapper for file implementation (io_stream interface).
 
     This class provides the io_stream interface and delegates to
-    the internal implementation. It uses a shared_ptr to manage
+    the internal implementation. It holds a file_ref to manage
     the lifetime of the internal state.
 
     @note Internal implementation detail. Users interact with file_stream class.
@@ -147,7 +511,7 @@ class uring_file_impl
     friend class uring_file_service;
 
 public:
-    explicit uring_file_impl(std::shared_ptr<uring_file_impl_internal> internal)
+    explicit uring_file_impl(file_ref internal)
         : internal_(std::move(internal))
     {
     }
@@ -187,7 +551,7 @@ public:
     }
 
 private:
-    std::shared_ptr<uring_file_impl_internal> internal_;
+    file_ref internal_;
 };
 
 } // namespace nntp::detail
@@ -5,15 +5,25 @@
 
 #include <utility>
 
+#include <fileio/aligned_allocator.h>
 #include <boost/corosio/detail/config.hpp>
+#include <boost/capy/ex/executor_ref.hpp>
+#include "src/detail/intrusive.hpp"
 #include "src/detail/scheduler_op.hpp"
 
 #include <liburing.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <cstddef>
 #include <coroutine>
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
 #include <system_error>
+#include <vector>
 
 namespace boost::corosio::detail
 {
@@ -24,6 +34,118 @@ namespace nntp::detail
 {
 
 class uring_file_impl_internal;
+struct ring_shard;
+
+/** Owning reference to a file's internal state.
+
+    Holds one count of the file's intrusive reference count. The
+    stream and its operations may drop their references on
+    different threads, so the count is atomic. A service promised a
+    single thread updates it with plain loads and stores, so taking
+    and dropping a reference costs no read-modify-write there.
+
+    @note Internal implementation detail.
+*/
+class file_ref
+{
+public:
+    file_ref() noexcept = default;
+
+    /** Take a reference to a file.
+
+        @param p The file, or nullptr.
+    */
+    explicit file_ref(uring_file_impl_internal* p) noexcept;
+
+    file_ref(file_ref&& other) noexcept
+        : p_(std::exchange(other.p_, nullptr))
+    {
+    }
+
+    file_ref& operator=(file_ref&& other) noexcept
+    {
+        file_ref(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    file_ref(file_ref const&) = delete;
+    file_ref& operator=(file_ref const&) = delete;
+
+    ~file_ref();
+
+    /** Drop the reference, destroying the file if it was the last. */
+    void reset() noexcept
+    {
+        file_ref().swap(*this);
+    }
+
+    void swap(file_ref& other) noexcept
+    {
+        std::swap(p_, other.p_);
+    }
+
+    uring_file_impl_internal* get() const noexcept { return p_; }
+    uring_file_impl_internal* operator->() const noexcept { return p_; }
+    explicit operator bool() const noexcept { return p_ != nullptr; }
+
+private:
+    uring_file_impl_internal* p_ = nullptr;
+};
+
+/** Maximum number of buffers gathered into one readv/writev entry.
+
+    Buffers of a longer sequence are not transferred by that
+    operation, which completes as a short read or write.
+*/
+inline constexpr std::size_t max_file_iovecs = 16;
+
+/** Marks the completions of linked timeout entries.
+
+    A timeout linked to an operation posts its own completion, which
+    carries no operation. Its user_data is the address of this tag,
+    so the service can tell it from a cancellation request: unlike
+    those, the timeout was counted in the ring's operations in flight.
+*/
+inline char link_timeout_tag = 0;
+
+/** Operation that needs a submission queue entry.
+
+    The service prepares the entry through the function pointer as
+    soon as one is available. Operations that arrive while the ring
+    is full are parked on the service's overflow list instead of
+    failing, and are prepared as completions drain.
+
+    @note Internal implementation detail.
+*/
+struct sqe_waiter
+    : boost::corosio::detail::intrusive_list<sqe_waiter>::node
+{
+    /** Function that fills in the entry for this operation. */
+    using prepare_fn = void (*)(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
+    /** Prepare function for the concrete operation. */
+    prepare_fn prepare;
+
+    /** True while the operation is on the overflow list. */
+    bool parked = false;
+
+    /** Number of entries the operation prepares.
+
+        An operation submitting a linked chain needs its entries
+        contiguous in the ring. The service only starts it once this
+        many entries are free, and the prepare function takes the
+        entries after the first from the ring itself.
+    */
+    unsigned sqe_count = 1;
+
+    /** Ring the operation was started on, set by the service. */
+    ring_shard* shard = nullptr;
+
+    explicit sqe_waiter(prepare_fn fn) noexcept
+        : prepare(fn)
+    {
+    }
+};
 
 /** File read operation state for io_uring.
 
@@ -33,7 +155,9 @@ class uring_file_impl_internal;
 
     @note Internal implementation detail.
 */
-struct file_read_op : boost::corosio::detail::scheduler_op
+struct file_read_op
+    : boost::corosio::detail::scheduler_op
+    , sqe_waiter
 {
     /** Buffer pointer for the read operation. */
     void* buffer_ptr = nullptr;
@@ -44,11 +168,20 @@ struct file_read_op : boost::corosio::detail::scheduler_op
     /** File offset for this read operation. */
     off_t file_offset = 0;
 
+    /** Index of the registered buffer, or -1 for ordinary memory. */
+    int buf_index = -1;
+
+    /** Scatter/gather list, used when iovec_count is non-zero. */
+    iovec iovecs[max_file_iovecs];
+
+    /** Number of entries in iovecs, or zero for a single buffer. */
+    unsigned iovec_count = 0;
+
     /** Reference to the internal implementation. */
     uring_file_impl_internal& internal;
 
-    /** Shared pointer to keep internal alive during async operation. */
-    std::shared_ptr<uring_file_impl_internal> internal_ptr;
+    /** Reference keeping internal alive during async operation. */
+    file_ref internal_ptr;
 
     /** Output parameters for operation results. */
     std::error_code* ec_out = nullptr;
@@ -88,6 +221,13 @@ struct file_read_op : boost::corosio::detail::scheduler_op
     */
     static void do_cancel_impl(file_read_op* op) noexcept;
 
+    /** Fill in the read entry once the service has one available.
+
+        @param self Pointer to this operation
+        @param sqe Submission queue entry to prepare
+    */
+    static void do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
     /** Construct read operation.
 
         @param internal_ Reference to the file implementation
@@ -103,7 +243,9 @@ struct file_read_op : boost::corosio::detail::scheduler_op
 
     @note Internal implementation detail.
 */
-struct file_write_op : boost::corosio::detail::scheduler_op
+struct file_write_op
+    : boost::corosio::detail::scheduler_op
+    , sqe_waiter
 {
     /** Buffer pointer for the write operation. */
     const void* buffer_ptr = nullptr;
@@ -114,11 +256,20 @@ struct file_write_op : boost::corosio::detail::scheduler_op
     /** File offset for this write operation. */
     off_t file_offset = 0;
 
+    /** Index of the registered buffer, or -1 for ordinary memory. */
+    int buf_index = -1;
+
+    /** Scatter/gather list, used when iovec_count is non-zero. */
+    iovec iovecs[max_file_iovecs];
+
+    /** Number of entries in iovecs, or zero for a single buffer. */
+    unsigned iovec_count = 0;
+
     /** Reference to the internal implementation. */
     uring_file_impl_internal& internal;
 
-    /** Shared pointer to keep internal alive during async operation. */
-    std::shared_ptr<uring_file_impl_internal> internal_ptr;
+    /** Reference keeping internal alive during async operation. */
+    file_ref internal_ptr;
 
     /** Output parameters for operation results. */
     std::error_code* ec_out = nullptr;
@@ -158,6 +309,13 @@ struct file_write_op : boost::corosio::detail::scheduler_op
     */
     static void do_cancel_impl(file_write_op* op) noexcept;
 
+    /** Fill in the write entry once the service has one available.
+
+        @param self Pointer to this operation
+        @param sqe Submission queue entry to prepare
+    */
+    static void do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
     /** Construct write operation.
 
         @param internal_ Reference to the file implementation
@@ -165,6 +323,496 @@ struct file_write_op : boost::corosio::detail::scheduler_op
     explicit file_write_op(uring_file_impl_internal& internal_) noexcept;
 };
 
+/** Positional read or write operation state for io_uring.
+
+    Unlike file_read_op and file_write_op, which are embedded in the
+    file and use its shared position, these operations carry their own
+    offset and come from a pool owned by the service. Any number of
+    them may be in flight on one file at a time.
+
+    @note Internal implementation detail.
+*/
+struct file_at_op
+    : boost::corosio::detail::scheduler_op
+    , sqe_waiter
+    , boost::corosio::detail::intrusive_list<file_at_op>::node
+{
+    /** Invokes cancellation when the stop token is triggered. */
+    struct canceller
+    {
+        file_at_op* op;
+        void operator()() const noexcept { do_cancel_impl(op); }
+    };
+
+    /** True for a write, false for a read. */
+    bool write = false;
+
+    /** Buffer pointer for the operation. */
+    void* buffer_ptr = nullptr;
+
+    /** Size of the buffer in bytes. */
+    std::size_t buffer_size = 0;
+
+    /** File offset for this operation. */
+    off_t file_offset = 0;
+
+    /** Scatter/gather list, used when iovec_count is non-zero. */
+    iovec iovecs[max_file_iovecs];
+
+    /** Number of entries in iovecs, or zero for a single buffer. */
+    unsigned iovec_count = 0;
+
+    /** File the operation belongs to while it is in use. */
+    uring_file_impl_internal* internal = nullptr;
+
+    /** Reference keeping internal alive during async operation. */
+    file_ref internal_ptr;
+
+    /** Output parameters for operation results. */
+    std::error_code* ec_out = nullptr;
+    std::size_t* bytes_out = nullptr;
+
+    /** Coroutine handle to resume. Completions already run on a
+        thread of the context, so it is resumed directly. */
+    std::coroutine_handle<> handler_;
+
+    /** Cancels the operation when its stop token is triggered. */
+    std::optional<std::stop_callback<canceller>> stop_cb;
+
+    /** Result to report instead of the CQE's, for an operation
+        completed without reaching the kernel; zero if unused. */
+    std::int32_t result_override = 0;
+
+    /** Time limit of the operation, read by the kernel when the
+        linked timeout entry is submitted. */
+    __kernel_timespec timeout{};
+
+    /** True if the operation is submitted with a linked timeout. */
+    bool timed = false;
+
+    /** True if the operation was canceled rather than timed out. */
+    bool canceled = false;
+
+    /** True if the operation moves the file position by the bytes
+        transferred, as read_some and write_some do. */
+    bool advance = false;
+
+    /** Completion callback invoked when CQE arrives.
+
+        Returns the operation to the pool before resuming, so the
+        resumed coroutine can start its next operation with it.
+
+        @param owner Pointer to the service that owns this operation
+        @param base Pointer to the base scheduler_op (this operation)
+        @param res Result from io_uring CQE (bytes or -errno)
+        @param flags Flags from CQE
+    */
+    static void do_complete(
+        void* owner,
+        boost::corosio::detail::scheduler_op* base,
+        std::uint32_t res,
+        std::uint32_t flags);
+
+    /** Cancellation callback.
+
+        @param op Pointer to this operation
+    */
+    static void do_cancel_impl(file_at_op* op) noexcept;
+
+    /** Fill in the entry once the service has one available.
+
+        @param self Pointer to this operation
+        @param sqe Submission queue entry to prepare
+    */
+    static void do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
+    /** Construct an idle pooled operation. */
+    file_at_op() noexcept;
+};
+
+/** File management operation state for io_uring.
+
+    Covers the calls that manage a file rather than transfer data:
+    open, close, fsync, fdatasync, fallocate, fadvise and statx. These
+    are rare next to reads and writes, so each operation is allocated
+    for its call and frees itself on completion.
+
+    @note Internal implementation detail.
+*/
+struct file_ctl_op
+    : boost::corosio::detail::scheduler_op
+    , sqe_waiter
+{
+    /** The system call performed. */
+    enum class kind
+    {
+        open,
+        close,
+        fsync,
+        fdatasync,
+        fallocate,
+        fadvise,
+        statx
+    };
+
+    /** The system call performed. */
+    kind what;
+
+    /** Path to open, for kind::open. */
+    std::string path;
+
+    /** openat flags and mode, for kind::open. */
+    int open_flags = 0;
+    int open_mode = 0;
+
+    /** Descriptor to close, for kind::close. */
+    int close_fd = -1;
+
+    /** True if the file was closed while this open was in flight;
+        the descriptor it yields is closed rather than attached. */
+    bool abandoned = false;
+
+    /** Range to allocate or advise, for kind::fallocate and kind::fadvise. */
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+
+    /** POSIX_FADV_ advice, for kind::fadvise. */
+    int advice = 0;
+
+    /** Result buffer, for kind::statx. */
+    struct statx stx;
+
+    /** Reference to the internal implementation. */
+    uring_file_impl_internal& internal;
+
+    /** Reference keeping internal alive during async operation. */
+    file_ref internal_ptr;
+
+    /** Output parameters for operation results. */
+    std::error_code* ec_out = nullptr;
+    std::uint64_t* value_out = nullptr;
+
+    /** Coroutine handle to resume. */
+    std::coroutine_handle<> handler_;
+
+    /** Completion callback invoked when CQE arrives.
+
+        Applies the result to the file (an opened descriptor, or the
+        size reported by statx), then frees the operation.
+
+        @param owner Pointer to the service that owns this operation
+        @param base Pointer to the base scheduler_op (this operation)
+        @param res Result from io_uring CQE (descriptor, zero or -errno)
+        @param flags Flags from CQE
+    */
+    static void do_complete(
+        void* owner,
+        boost::corosio::detail::scheduler_op* base,
+        std::uint32_t res,
+        std::uint32_t flags);
+
+    /** Fill in the entry once the service has one available.
+
+        @param self Pointer to this operation
+        @param sqe Submission queue entry to prepare
+    */
+    static void do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
+    /** Construct a management operation.
+
+        @param what_ The system call to perform
+        @param internal_ Reference to the file implementation
+    */
+    file_ctl_op(kind what_, uring_file_impl_internal& internal_) noexcept;
+};
+
+/** Pipe that carries spliced file data to a socket.
+
+    @note Internal implementation detail.
+*/
+struct splice_pipe
+{
+    /** Read end, spliced into the socket. */
+    int read_fd = -1;
+
+    /** Write end, spliced into from the file. */
+    int write_fd = -1;
+
+    /** Bytes the pipe holds, the most one splice moves. */
+    std::size_t capacity = 0;
+};
+
+/** Capacity requested for a splice pipe, and so the largest chunk
+    one splice moves. Unprivileged processes may grow a pipe up to
+    /proc/sys/fs/pipe-max-size, one megabyte by default. */
+inline constexpr std::size_t splice_pipe_size = 1024 * 1024;
+
+/** Size of the buffer a splice_to transfer copies through when it
+    cannot splice. */
+inline constexpr std::size_t splice_copy_size = 256 * 1024;
+
+/** Transfer of a file range to a socket for io_uring.
+
+    The range moves in chunks of up to the pipe's capacity: one
+    splice from the file into the pipe, then splices from the pipe
+    into the socket until the pipe is empty. The data never enters
+    user space. When the first splice is refused because the file
+    system does not support it, or when splicing is turned off, each
+    chunk is instead read into a buffer and sent from it.
+
+    A socket with O_NONBLOCK makes the pipe-to-socket splice fail
+    with EAGAIN once its send buffer is full; the operation then
+    polls for POLLOUT and drains again. The buffered send needs no
+    such step, since io_uring waits for room itself.
+
+    Like file_ctl_op, the operation is allocated for its call and
+    frees itself on completion. Each stage is a separate entry, so
+    a transfer resubmits itself from its own completion handler.
+
+    @note Internal implementation detail.
+*/
+struct file_splice_op
+    : boost::corosio::detail::scheduler_op
+    , sqe_waiter
+{
+    /** Invokes cancellation when the stop token is triggered. */
+    struct canceller
+    {
+        file_splice_op* op;
+        void operator()() const noexcept { do_cancel_impl(op); }
+    };
+
+    /** The entry the next submission prepares. */
+    enum class stage
+    {
+        fill,       ///< splice from the file into the pipe
+        drain,      ///< splice from the pipe into the socket
+        wait,       ///< poll the socket for room after EAGAIN
+        read,       ///< read from the file into the buffer
+        send        ///< send from the buffer to the socket
+    };
+
+    /** Next stage to submit. */
+    stage step = stage::fill;
+
+    /** Socket descriptor receiving the data. */
+    int sock_fd = -1;
+
+    /** File offset of the next byte to take from the file. */
+    std::uint64_t offset = 0;
+
+    /** Bytes of the range not yet taken from the file. */
+    std::uint64_t remaining = 0;
+
+    /** Bytes delivered to the socket. */
+    std::uint64_t transferred = 0;
+
+    /** Bytes taken from the file but not yet delivered. */
+    std::size_t pending = 0;
+
+    /** Pipe carrying spliced data; unused when copying. */
+    splice_pipe pipe;
+
+    /** Buffer for the copying stages, aligned for O_DIRECT files. */
+    std::vector<char, aligned_allocator<char>> buffer;
+
+    /** Offset in buffer of the next byte to send. */
+    std::size_t buffer_pos = 0;
+
+    /** Reference to the internal implementation. */
+    uring_file_impl_internal& internal;
+
+    /** Reference keeping internal alive during async operation. */
+    file_ref internal_ptr;
+
+    /** Output parameters for operation results. */
+    std::error_code* ec_out = nullptr;
+    std::uint64_t* bytes_out = nullptr;
+
+    /** Coroutine handle to resume. */
+    std::coroutine_handle<> handler_;
+
+    /** Cancels the operation when its stop token is triggered. */
+    std::optional<std::stop_callback<canceller>> stop_cb;
+
+    /** Set once cancellation is requested; stops the next stage. */
+    bool canceled = false;
+
+    /** Result to report instead of the CQE's, for a stage completed
+        without reaching the kernel; zero if unused. */
+    std::int32_t result_override = 0;
+
+    /** Switch to reading into the buffer and sending from it. */
+    void use_copy();
+
+    /** Completion callback invoked when CQE arrives.
+
+        Advances to the next stage and resubmits, or finishes the
+        transfer, returns the pipe and resumes the caller.
+
+        @param owner Pointer to the service that owns this operation
+        @param base Pointer to the base scheduler_op (this operation)
+        @param res Result from io_uring CQE (bytes or -errno)
+        @param flags Flags from CQE
+    */
+    static void do_complete(
+        void* owner,
+        boost::corosio::detail::scheduler_op* base,
+        std::uint32_t res,
+        std::uint32_t flags);
+
+    /** Cancellation callback.
+
+        @param op Pointer to this operation
+    */
+    static void do_cancel_impl(file_splice_op* op) noexcept;
+
+    /** Fill in the entry for the current stage.
+
+        @param self Pointer to this operation
+        @param sqe Submission queue entry to prepare
+    */
+    static void do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
+    /** Construct a transfer.
+
+        @param internal_ Reference to the file implementation
+    */
+    explicit file_splice_op(uring_file_impl_internal& internal_) noexcept;
+};
+
+struct file_commit_group;
+
+/** One writer's part of a durable append.
+
+    @note Internal implementation detail.
+*/
+struct file_commit_write
+    : boost::corosio::detail::scheduler_op
+{
+    /** Group the write belongs to. */
+    file_commit_group* group = nullptr;
+
+    /** Buffer pointer for the write. */
+    const void* buffer_ptr = nullptr;
+
+    /** Size of the buffer in bytes. */
+    std::size_t buffer_size = 0;
+
+    /** Scatter/gather list, used when iovec_count is non-zero. */
+    iovec iovecs[max_file_iovecs];
+
+    /** Number of entries in iovecs, or zero for a single buffer. */
+    unsigned iovec_count = 0;
+
+    /** Number of bytes described by the buffers. */
+    std::size_t total_size = 0;
+
+    /** File offset for the write. */
+    off_t file_offset = 0;
+
+    /** Result of the write CQE. */
+    std::int32_t result = 0;
+
+    /** Output parameters for operation results. */
+    std::error_code* ec_out = nullptr;
+    std::size_t* bytes_out = nullptr;
+
+    /** Coroutine handle to resume. */
+    std::coroutine_handle<> handler_;
+
+    /** Record the write result and finish the group if it was last. */
+    static void do_complete(
+        void* owner,
+        boost::corosio::detail::scheduler_op* base,
+        std::uint32_t res,
+        std::uint32_t flags);
+
+    file_commit_write() noexcept;
+};
+
+/** Durable appends to one file sharing a single fdatasync.
+
+    Writers that ask for a durable write on the same file during one
+    scheduler turn join the same group. When the turn's posted work
+    reaches the group it is sealed and submitted as one linked chain:
+    every write flagged IOSQE_IO_LINK, followed by one fdatasync. The
+    kernel runs the chain in order and cancels the rest of it when a
+    write fails or comes up short, so a successful fdatasync covers
+    every write in the group. Each writer is resumed once both its
+    write and the group's fdatasync have completed.
+
+    @note Internal implementation detail.
+*/
+struct file_commit_group
+    : sqe_waiter
+{
+    /** Scheduler operation for the fdatasync CQE. */
+    struct sync_part : boost::corosio::detail::scheduler_op
+    {
+        explicit sync_part(file_commit_group& g) noexcept;
+
+        static void do_complete(
+            void* owner,
+            boost::corosio::detail::scheduler_op* base,
+            std::uint32_t res,
+            std::uint32_t flags);
+
+        file_commit_group& group;
+    };
+
+    /** Scheduler operation that seals and submits the group. */
+    struct seal_part : boost::corosio::detail::scheduler_op
+    {
+        explicit seal_part(file_commit_group& g) noexcept;
+
+        static void do_complete(
+            void* owner,
+            boost::corosio::detail::scheduler_op* base,
+            std::uint32_t res,
+            std::uint32_t flags);
+
+        file_commit_group& group;
+    };
+
+    /** Reference to the internal implementation. */
+    uring_file_impl_internal& internal;
+
+    /** Reference keeping internal alive during async operation. */
+    file_ref internal_ptr;
+
+    /** The writes, in submission order. */
+    std::vector<std::unique_ptr<file_commit_write>> writes;
+
+    /** Completion for the fdatasync. */
+    sync_part sync;
+
+    /** Posted when the group is created; seals it. */
+    seal_part seal;
+
+    /** Result of the fdatasync CQE. */
+    std::int32_t sync_result = 0;
+
+    /** Number of CQEs still expected. */
+    std::size_t pending = 0;
+
+    /** Fill in the chain once the service has room for all of it.
+
+        @param self Pointer to this group
+        @param sqe First submission queue entry of the chain
+    */
+    static void do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept;
+
+    /** Called for each CQE; resumes the writers after the last one.
+
+        @param g The group.
+        @param resume False on the shutdown path.
+    */
+    static void part_done(file_commit_group* g, bool resume) noexcept;
+
+    explicit file_commit_group(uring_file_impl_internal& internal_) noexcept;
+};
+
 } // namespace nntp::detail
 
 #endif // __linux__
@@ -3,15 +3,22 @@
 
 #ifdef __linux__
 
+#include <fileio/file_service.h>
+#include <fileio/detail/uring_file_ops.h>
 #include <boost/corosio/detail/config.hpp>
 #include <boost/capy/ex/execution_context.hpp>
 #include "src/detail/intrusive.hpp"
+#include "src/detail/scheduler_op.hpp"
 
 #include <liburing.h>
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <memory>
 #include <mutex>
 #include <system_error>
+#include <thread>
+#include <vector>
 
 namespace boost::corosio::detail
 {
@@ -23,6 +30,125 @@ namespace nntp::detail
 
 class uring_file_impl_internal;
 class uring_file_impl;
+class uring_file_service;
+
+/** One io_uring instance and the operations queued on it.
+
+    The service owns a single shard, or with
+    file_service_options::ring_per_thread one per thread that starts
+    operations. Everything here is guarded by the shard's mutex, so
+    threads using different shards never contend.
+*/
+struct ring_shard
+{
+    /** Operation posted to the scheduler to submit deferred entries.
+
+        With a ring per thread, the flush also harvests the shard's
+        completions, and on the shard's own thread completes them
+        inline.
+    */
+    struct flush_op : boost::corosio::detail::scheduler_op
+    {
+        explicit flush_op(ring_shard& shard) noexcept;
+
+        static void do_complete(
+            void* owner,
+            boost::corosio::detail::scheduler_op* base,
+            std::uint32_t res,
+            std::uint32_t flags);
+
+        ring_shard& shard;
+    };
+
+    /** A completion queue entry taken off the ring. */
+    struct harvested
+    {
+        boost::corosio::detail::scheduler_op* op;
+        std::int32_t res;
+        std::uint32_t flags;
+    };
+
+    /** Completions harvested by one poll, run by one scheduler operation.
+
+        Posting the batch instead of each operation costs one enqueue
+        per poll; the batch then completes its operations inline.
+    */
+    struct completion_batch : boost::corosio::detail::scheduler_op
+    {
+        explicit completion_batch(ring_shard& shard) noexcept;
+
+        static void do_complete(
+            void* owner,
+            boost::corosio::detail::scheduler_op* base,
+            std::uint32_t res,
+            std::uint32_t flags);
+
+        ring_shard& shard;
+        std::vector<harvested> ready;
+    };
+
+    explicit ring_shard(uring_file_service& svc) noexcept;
+
+    /** Owning service. */
+    uring_file_service& svc;
+
+    /** io_uring instance. */
+    io_uring ring;
+
+    /** io_uring file descriptor (for epoll integration). */
+    int ring_fd = -1;
+
+    /** Flag indicating if io_uring has been initialized. */
+    bool initialized = false;
+
+    /** Flag indicating a kernel thread polls the submission queue. */
+    bool sqpoll = false;
+
+    /** Flag indicating the kernel buffers completion queue overflow. */
+    bool nodrop = false;
+
+    /** Number of operations handed to the kernel and not yet completed. */
+    std::size_t in_flight = 0;
+
+    /** Limit on in_flight, derived from the ring sizes. */
+    std::size_t max_in_flight = 0;
+
+    /** Operations waiting for room in the ring. */
+    boost::corosio::detail::intrusive_list<sqe_waiter> parked;
+
+    /** Head of the overflow list, taken off it but still too big to fit. */
+    sqe_waiter* stalled = nullptr;
+
+    /** Flush operation, posted at most once per scheduler turn. */
+    flush_op flush;
+
+    /** Flag indicating the flush operation is queued. */
+    bool flush_pending = false;
+
+    /** I/O counters for this ring. */
+    file_service_stats stats;
+
+    /** Every completion batch allocated for this shard. */
+    std::vector<std::unique_ptr<completion_batch>> batches;
+
+    /** Completion batches that are not posted. */
+    std::vector<completion_batch*> free_batches;
+
+    /** Positional operations of this shard that are not in use. */
+    std::vector<file_at_op*> free_at_ops;
+
+    /** Number of positional operations this shard has allocated. */
+    std::size_t at_op_count = 0;
+
+    /** Thread the shard was created for. */
+    std::thread::id owner;
+
+    /** Next shard of the service; walked without the service mutex. */
+    std::atomic<ring_shard*> next{nullptr};
+
+    /** Mutex guarding the ring and the lists above. */
+    std::mutex mutex;
+};
 
 /** Service for managing io_uring-based file I/O operations.
 
@@ -31,11 +157,60 @@ class uring_file_impl;
     by registering the io_uring file descriptor, allowing the
     scheduler to be notified when completions are available.
 
+    Operations prepare submission queue entries without entering the
+    kernel. The entries prepared during one scheduler turn are submitted
+    together by a flush operation posted to the scheduler, so a burst of
+    reads costs one io_uring_enter instead of one per read.
+
+    With file_service_options::sqpoll, a kernel thread consumes the
+    submission queue and the flush only publishes the new tail; it
+    enters the kernel only when the thread has gone idle and flagged
+    IORING_SQ_NEED_WAKEUP.
+
+    Completions are taken off the ring in bulk with
+    io_uring_peek_batch_cqe and released with a single
+    io_uring_cq_advance. The operations harvested by one poll are
+    posted to the scheduler as one batch, which completes them inline
+    on the thread that runs it.
+
+    Operations in flight are capped at what the completion queue can
+    hold; operations beyond that, or that find the submission queue
+    full, wait on an overflow list and are started as completions drain.
+    Without IORING_FEAT_NODROP the kernel discards completions that do
+    not fit, so on such kernels the cap is the submission queue depth.
+
+    The ring state lives in a ring_shard. By default there is one,
+    shared by every thread running the context. With
+    file_service_options::ring_per_thread each thread lazily gets a
+    shard of its own on its first operation, so submission never
+    takes a lock another thread holds.
+
+    With a ring per thread, completions are harvested by the shard's
+    flush, which a thread posts for its own ring whenever it starts
+    operations. When the flush runs on that thread, it completes the
+    harvested operations inline, so a busy thread's I/O resumes on
+    the thread that started it without another thread touching the
+    ring. corosio's scheduler has one run queue shared by every
+    thread, so neither the flush nor the ring's readiness event can
+    be aimed at a particular thread. The readiness event therefore
+    remains a fallback: the thread that receives it harvests only
+    the rings without a flush queued, which are those of idle
+    threads, and posts their completions to the shared queue.
+    file_service_stats::owner_completions counts how many
+    completions resumed on their own thread.
+
     @note Internal implementation detail. Users interact with file_stream class.
 */
 class uring_file_service : public boost::capy::execution_context::service
 {
     friend class uring_file_impl_internal;
+    friend struct ring_shard;
+    friend struct file_read_op;
+    friend struct file_write_op;
+    friend struct file_at_op;
+    friend struct file_ctl_op;
+    friend struct file_splice_op;
+    friend struct file_commit_group;
 
 public:
     using key_type = uring_file_service;
@@ -43,8 +218,11 @@ public:
     /** Construct the service.
 
         @param ctx Reference to the owning execution_context.
+        @param opts Ring configuration.
     */
-    explicit uring_file_service(boost::capy::execution_context& ctx);
+    explicit uring_file_service(
+        boost::capy::execution_context& ctx,
+        file_service_options const& opts = {});
 
     /** Destroy the service. */
     ~uring_file_service();
@@ -92,17 +270,131 @@ public:
         int flags,
         int mode);
 
-    /** Get the native io_uring handle.
+    /** Start an operation that needs a submission queue entry.
+
+        The operation goes to the calling thread's shard. It is
+        prepared immediately if the ring has room, otherwise it is
+        parked on the shard's overflow list.
+
+        @param op The operation to start.
+    */
+    void start_op(sqe_waiter& op) noexcept;
+
+    /** Remove an operation from the overflow list.
+
+        @param op The operation to remove.
+        @return true if the operation was parked and has been removed.
+    */
+    bool unpark(sqe_waiter& op) noexcept;
+
+    /** Ask the kernel to cancel a started operation.
+
+        The request goes to the ring the operation was started on and
+        is submitted immediately, along with any deferred entries,
+        since the file may be closed before the next flush.
+
+        @param op The operation to cancel.
+        @param target The user data of the operation's entry.
+    */
+    void submit_cancel(
+        sqe_waiter& op,
+        boost::corosio::detail::scheduler_op* target) noexcept;
+
+    /** Lease a buffer from the registered buffer pool.
+
+        @return Index of the leased buffer, or -1 if the pool is
+            disabled or every buffer is leased.
+    */
+    int lease_buffer() noexcept;
+
+    /** Return a leased buffer to the pool.
+
+        @param index Index returned by lease_buffer().
+    */
+    void release_buffer(int index) noexcept;
+
+    /** Get the memory of a registered buffer.
+
+        @param index Index of the buffer.
+    */
+    void* buffer_data(int index) const noexcept
+    {
+        return static_cast<char*>(buffer_base_) + index * buffer_stride_;
+    }
+
+    /** Get the size of each registered buffer. */
+    std::size_t buffer_size() const noexcept { return buffer_size_; }
+
+    /** Place a descriptor in the registered file table.
+
+        @param fd The open file descriptor.
+        @return The table slot, or -1 if the table is disabled or full.
+    */
+    int register_file(int fd) noexcept;
+
+    /** Free a slot in the registered file table.
+
+        @param index Slot returned by register_file().
+    */
+    void unregister_file(int index) noexcept;
+
+    /** Check whether only one thread touches file state. */
+    bool single_threaded() const noexcept
+    {
+        return opts_.single_threaded && !opts_.ring_per_thread;
+    }
+
+    /** Check whether splice_to transfers may splice. */
+    bool splice_enabled() const noexcept { return opts_.splice; }
+
+    /** Take a pipe for splicing from the pool, creating one if none is idle.
+
+        A new pipe is grown to splice_pipe_size where the pipe size
+        limit allows.
+
+        @param p Set to the pipe.
+        @return Error code, empty if successful.
+    */
+    std::error_code lease_pipe(splice_pipe& p);
+
+    /** Return an empty pipe to the pool.
+
+        @param p Pipe from lease_pipe(), or an unused splice_pipe.
+    */
+    void release_pipe(splice_pipe const& p) noexcept;
+
+    /** Close both ends of a pipe.
 
-        @return Pointer to io_uring structure.
+        @param p Pipe from lease_pipe(), or an unused splice_pipe.
     */
-    io_uring* native_handle() noexcept { return &ring_; }
+    static void close_pipe(splice_pipe const& p) noexcept;
+
+    /** Get the longest linked chain the ring can accept. */
+    std::size_t max_chain() const noexcept { return max_chain_; }
+
+    /** Take a positional operation from the pool.
+
+        Operations are allocated on first use and recycled afterwards,
+        so a steady stream of positional I/O does not allocate.
+
+        @return An idle operation.
+    */
+    file_at_op* alloc_at_op();
+
+    /** Return a positional operation to the pool.
+
+        @param op Operation returned by alloc_at_op().
+    */
+    void free_at_op(file_at_op* op) noexcept;
+
+    /** Get the I/O counters, summed over every shard. */
+    file_service_stats stats() noexcept;
 
     /** Poll io_uring completion queue.
 
-        Called by the epoll scheduler when the io_uring fd becomes readable.
-        Processes all available completion queue entries and posts them
-        to the scheduler.
+        Called by the epoll scheduler when an io_uring fd becomes readable.
+        Processes all available completion queue entries of every shard
+        and posts them to the scheduler.
     */
     void poll_completions();
 
@@ -119,28 +411,151 @@ public:
     void work_finished() noexcept;
 
 private:
-    /** Initialize io_uring instance.
+    /** Initialize the io_uring instance of a shard.
+
+        Registers the ring with epoll and the buffer pool, if any,
+        with the ring.
+
+        @param shard The shard to initialize.
+        @param opts Ring configuration.
+        @return Error code, empty if successful.
+    */
+    std::error_code init_uring(ring_shard& shard, file_service_options const& opts);
+
+    /** Shutdown the io_uring instance of a shard. */
+    void shutdown_uring(ring_shard& shard) noexcept;
+
+    /** Shutdown every shard and release the registered resources. */
+    void shutdown_rings() noexcept;
+
+    /** Get the shard for operations started by the calling thread. */
+    ring_shard& local_shard() noexcept;
+
+    /** Get the number of prepared entries not yet handed to the kernel. */
+    unsigned unsubmitted(ring_shard& shard) const noexcept;
 
+    /** Create the sparse registered file table.
+
+        @param count Number of slots.
         @return Error code, empty if successful.
     */
-    std::error_code init_uring();
+    std::error_code init_files(unsigned count);
+
+    /** Allocate the buffer pool.
+
+        @param count Number of buffers.
+        @param size Size of each buffer.
+        @return Error code, empty if successful.
+    */
+    std::error_code init_buffers(unsigned count, std::size_t size);
+
+    /** Register the buffer pool with a shard's ring.
+
+        @return Error code, empty if successful.
+    */
+    std::error_code register_buffers(ring_shard& shard);
+
+    /** Prepare an operation if the ring has room for all its entries.
+
+        @return true if the operation was prepared.
+    */
+    bool try_prepare(ring_shard& shard, sqe_waiter& op) noexcept;
 
-    /** Shutdown io_uring instance. */
-    void shutdown_uring();
+    /** Start parked operations while the ring has room. */
+    void start_parked(ring_shard& shard) noexcept;
+
+    /** Request submission of the prepared entries.
+
+        The first request in a scheduler turn posts the flush operation;
+        later requests are absorbed by it.
+    */
+    void defer_submit(ring_shard& shard) noexcept;
+
+    /** Submit the prepared entries immediately.
+
+        @return Number of entries submitted, or -errno on failure.
+    */
+    int submit(ring_shard& shard) noexcept;
+
+    /** Submit a shard's prepared entries and wait for the kernel to take them.
+
+        Called with the shard's mutex held. A submitted entry holds
+        its file, so once this returns none of the shard's entries
+        can pick up a descriptor number or table slot that is reused
+        afterwards. Entries the kernel refuses to take (EBUSY) stay
+        queued.
+    */
+    void drain(ring_shard& shard) noexcept;
+
+    /** Drain every shard, before a descriptor is closed. */
+    void drain_submissions() noexcept;
+
+    /** Harvest the completions of one shard. */
+    void poll_completions(ring_shard& shard);
+
+    /** Take a shard's completions off its ring and start parked operations.
+
+        Called with the shard's mutex held.
+
+        @return The harvested operations, or null if there were none.
+    */
+    ring_shard::completion_batch* harvest(ring_shard& shard);
+
+    /** Get an idle completion batch of a shard, allocating if none is.
+
+        Called with the shard's mutex held.
+    */
+    ring_shard::completion_batch* take_batch(ring_shard& shard);
 
     /** Reference to the scheduler. */
     boost::corosio::detail::scheduler& sched_;
 
-    /** io_uring instance. */
-    io_uring ring_;
+    /** Ring configuration, kept for shards created later. */
+    file_service_options opts_;
 
-    /** io_uring file descriptor (for epoll integration). */
-    int ring_fd_ = -1;
+    /** Identifies the service in the per-thread shard cache. */
+    std::uint64_t id_;
 
-    /** Flag indicating if io_uring has been initialized. */
-    bool uring_initialized_ = false;
+    /** First shard; never null once constructed. */
+    ring_shard* shards_ = nullptr;
+
+    /** Longest linked chain a shard accepts. */
+    std::size_t max_chain_ = 0;
+
+    /** Memory backing the registered buffers, or nullptr. */
+    void* buffer_base_ = nullptr;
+
+    /** Size of each registered buffer. */
+    std::size_t buffer_size_ = 0;
+
+    /** Distance between buffers: buffer_size_ rounded up to a page. */
+    std::size_t buffer_stride_ = 0;
+
+    /** Total size of the buffer pool mapping. */
+    std::size_t buffer_bytes_ = 0;
+
+    /** Indices of registered buffers that are not leased. */
+    std::vector<int> free_buffers_;
+
+    /** Flag indicating the registered file table exists. */
+    bool files_registered_ = false;
+
+    /** Registered file table slots that are not in use. */
+    std::vector<int> free_files_;
+
+    /** Pipes that are not carrying a transfer. */
+    std::vector<splice_pipe> free_pipes_;
+
+    /** Number of pipes the pool has created and not closed. */
+    std::size_t pipe_count_ = 0;
+
+    /** Every positional operation allocated by the pool. */
+    std::vector<std::unique_ptr<file_at_op>> at_ops_;
+
+    /** Counters kept outside the shards. */
+    file_service_stats stats_;
 
-    /** Mutex for thread-safe access to file lists. */
+    /** Mutex for thread-safe access to file lists and the shard list. */
     std::mutex mutex_;
 
     /** List of active file implementations. */
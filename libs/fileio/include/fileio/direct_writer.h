@@ -0,0 +1,93 @@
+#ifndef NNTP_DIRECT_WRITER_H
+#define NNTP_DIRECT_WRITER_H
+
+#include <fileio/aligned_allocator.h>
+#include <fileio/file_stream.h>
+#include <boost/corosio/detail/platform.hpp>
+
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+
+#include <boost/capy/task.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+
+namespace nntp {
+
+/** Append-only writer for files opened with file_stream::direct.
+
+    O_DIRECT writes must cover whole aligned blocks from aligned
+    memory, while spool records have arbitrary lengths. The writer
+    copies appended data into an aligned staging buffer and writes
+    it out in whole blocks once the buffer fills, so callers never
+    deal with alignment.
+
+    flush() writes the staged data immediately, padding the final
+    partial block with zeros. That block stays staged, and the next
+    flush rewrites it in place with whatever was appended since, so
+    the file may extend up to one block past end(). Callers track the
+    logical end themselves, as a cyclic spool does anyway.
+
+    @par Thread Safety
+    Distinct objects: Safe.
+    Shared objects: Unsafe. Only one write or flush may be
+    outstanding at a time.
+*/
+class direct_writer
+{
+public:
+    /** Construct a writer.
+
+        @param file The open file to append to.
+        @param offset File offset of the first byte to write.
+        @param capacity Size of the staging buffer in bytes.
+
+        @throws std::invalid_argument if offset or capacity is not a
+            multiple of direct_io_alignment, or capacity is zero.
+    */
+    explicit direct_writer(
+        file_stream& file,
+        std::uint64_t offset = 0,
+        std::size_t capacity = 1024 * 1024);
+
+    direct_writer(direct_writer const&) = delete;
+    direct_writer& operator=(direct_writer const&) = delete;
+
+    /** Append data.
+
+        The data is copied, so the caller's buffer may be reused as
+        soon as the returned task completes.
+
+        @param data The bytes to append.
+        @param size Number of bytes to append.
+
+        @return A task yielding the first write error, if any.
+    */
+    boost::capy::task<std::error_code> write(void const* data, std::size_t size);
+
+    /** Write all staged data to the file.
+
+        @return A task yielding the first write error, if any.
+    */
+    boost::capy::task<std::error_code> flush();
+
+    /** Get the file offset just past the last appended byte. */
+    std::uint64_t end() const noexcept { return offset_ + staged_; }
+
+    /** Get the number of bytes appended but not yet fully written. */
+    std::size_t staged() const noexcept { return staged_; }
+
+private:
+    boost::capy::task<std::error_code> write_staged(std::size_t length);
+
+    file_stream& file_;
+    aligned_buffer buffer_;
+    std::uint64_t offset_;
+    std::size_t staged_ = 0;
+};
+
+} // namespace nntp
+
+#endif
+
+#endif // NNTP_DIRECT_WRITER_H
@@ -0,0 +1,181 @@
+#ifndef NNTP_FILE_SERVICE_H
+#define NNTP_FILE_SERVICE_H
+
+#include <boost/capy/ex/execution_context.hpp>
+#include <cstddef>
+#include <cstdint>
+
+namespace nntp {
+
+/** Configuration for the file service of an execution context.
+
+    Backends without a submission ring ignore these settings.
+*/
+struct file_service_options
+{
+    /** Number of io_uring submission queue entries.
+
+        Rounded up to a power of two by the kernel; the completion
+        queue is twice this size. Operations beyond what the ring
+        can hold wait in a queue instead of failing.
+    */
+    unsigned queue_depth = 64;
+
+    /** Number of buffers in the registered buffer pool.
+
+        Zero, the default, disables the pool. Registered buffers are
+        pinned once when the service starts instead of on every
+        operation, and count against RLIMIT_MEMLOCK.
+    */
+    unsigned fixed_buffer_count = 0;
+
+    /** Size in bytes of each registered buffer.
+
+        Every buffer starts on a page boundary. A size that is not a
+        multiple of the page size still occupies whole pages.
+    */
+    std::size_t fixed_buffer_size = 4096;
+
+    /** Number of slots in the registered file table.
+
+        Zero, the default, disables the table. Files opened while a
+        slot is free are registered and their operations skip the
+        kernel's per-operation descriptor lookup; once the table is
+        full, files use their plain descriptor. Intended for
+        long-lived files such as spools and overview databases.
+    */
+    unsigned registered_files = 0;
+
+    /** Create the ring with IORING_SETUP_SQPOLL.
+
+        A kernel thread polls the submission queue, so steady-state
+        I/O is submitted without system calls; one is only made to
+        wake the thread after it has idled. The thread spins on a
+        CPU while active. The service falls back to a normal ring if
+        the kernel refuses SQPOLL (before Linux 5.11 it needs
+        CAP_SYS_NICE) or grants it only for registered files, as
+        kernels before 5.11 do.
+    */
+    bool sqpoll = false;
+
+    /** CPU to pin the SQPOLL thread to, or -1 to let it float. */
+    int sqpoll_cpu = -1;
+
+    /** Milliseconds the SQPOLL thread spins without work before it sleeps. */
+    unsigned sqpoll_idle_ms = 1000;
+
+    /** Give each thread running the context its own ring.
+
+        With one ring, threads submitting concurrently serialize on
+        it. With a ring per thread, created on a thread's first
+        operation, submission only locks the thread's own ring. Each
+        ring gets queue_depth entries and its own SQPOLL thread, and
+        the registered file table is not used since its slots
+        belong to a single ring.
+    */
+    bool ring_per_thread = false;
+
+    /** Promise that only one thread ever runs the context.
+
+        File state is reference counted by the file_stream and each
+        of its pending operations. With several threads running the
+        context, a stream may be destroyed on one thread while an
+        operation completes on another, so the count is atomic. When
+        this is set, and ring_per_thread is not, the count is
+        updated with plain loads and stores instead.
+    */
+    bool single_threaded = false;
+
+    /** Move file_stream::splice_to transfers with splice.
+
+        The data goes from the file to the socket through a pipe
+        without being copied into user space. When false, or when
+        the kernel cannot splice from the file, each chunk is read
+        into a buffer and sent from there instead.
+    */
+    bool splice = true;
+};
+
+/** Counters describing the file I/O performed by an execution context.
+
+    The counters are maintained by the io_uring backend on Linux.
+    Other backends issue one system call per operation and report
+    zero for every counter.
+*/
+struct file_service_stats
+{
+    /** Number of io_uring_enter calls made to submit entries. */
+    std::uint64_t submit_calls = 0;
+
+    /** Number of submission queue entries handed to the kernel. */
+    std::uint64_t submitted = 0;
+
+    /** Number of completion queue entries processed. */
+    std::uint64_t completions = 0;
+
+    /** Number of completion batches posted to the scheduler.
+
+        Completions divided by this is the average batch size.
+    */
+    std::uint64_t completion_batches = 0;
+
+    /** Number of completions run on the thread whose ring they came from.
+
+        Only counted with file_service_options::ring_per_thread.
+    */
+    std::uint64_t owner_completions = 0;
+
+    /** Number of operations that waited for room in the ring. */
+    std::uint64_t parked = 0;
+
+    /** Number of files opened into the registered file table. */
+    std::uint64_t registered_opens = 0;
+
+    /** Number of files opened with a plain descriptor because the
+        registered file table was full. */
+    std::uint64_t unregistered_opens = 0;
+
+    /** Number of io_uring_enter calls that woke an idle SQPOLL thread.
+
+        Also counted in submit_calls. Zero when SQPOLL is off.
+    */
+    std::uint64_t sqpoll_wakeups = 0;
+
+    /** Number of splice_to transfers that copied through a buffer
+        because the kernel could not splice them. */
+    std::uint64_t splice_fallbacks = 0;
+
+    /** Whether the ring is running with SQPOLL. */
+    bool sqpoll = false;
+
+    /** Number of rings, one unless file_service_options::ring_per_thread
+        is set. */
+    std::uint64_t rings = 0;
+};
+
+/** Configure the file service of an execution context.
+
+    Must be called before the first file_stream is constructed on
+    the context, since the service is created with these options.
+
+    @param ctx The execution context to configure.
+    @param opts The options to use.
+
+    @throws std::system_error if the service cannot be created.
+*/
+void
+configure_file_service(
+    boost::capy::execution_context& ctx,
+    file_service_options const& opts);
+
+/** Get the file I/O counters for an execution context.
+
+    @param ctx The execution context whose file service is queried.
+    @return A snapshot of the counters.
+*/
+file_service_stats
+get_file_service_stats(boost::capy::execution_context& ctx);
+
+} // namespace nntp
+
+#endif // NNTP_FILE_SERVICE_H
@@ -8,6 +8,17 @@
 #include <system_error>
 #include <cstdint>
 
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+#include <boost/capy/ex/executor_ref.hpp>
+#include <boost/capy/io_result.hpp>
+#include <boost/corosio/io_buffer_param.hpp>
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <stop_token>
+#endif
+
 namespace nntp {
 
 namespace detail {
@@ -75,6 +86,13 @@ public:
         open_always         ///< Open existing or create new
     };
 
+    /** File open option flags. */
+    enum open_flags
+    {
+        no_flags = 0,       ///< Buffered I/O through the page cache
+        direct = 1          ///< Bypass the page cache (O_DIRECT on Linux)
+    };
+
     /** Construct file stream.
 
         @param ctx The execution context to bind this stream to.
@@ -89,16 +107,23 @@ public:
         Opens the specified file for asynchronous operations. The file
         is opened with FILE_FLAG_OVERLAPPED on Windows to enable async I/O.
 
+        With the direct flag on Linux, every buffer address, buffer
+        length and file offset must be a multiple of
+        direct_io_alignment; misaligned operations complete with
+        std::errc::invalid_argument. Other platforms ignore the flag.
+
         @param path Path to the file to open
         @param access Access mode (read_only, write_only, read_write)
         @param creation How to create/open the file
+        @param flags Open options
 
         @return Error code indicating success or failure
     */
     std::error_code open(
         std::filesystem::path const& path,
         access_mode access,
-        creation_mode creation = open_existing);
+        creation_mode creation = open_existing,
+        open_flags flags = no_flags);
 
     /** Check if the file is open.
 
@@ -137,7 +162,415 @@ public:
     /** Cancel pending I/O operations. */
     void cancel() noexcept;
 
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+    class fixed_buffer;
+    class fixed_awaitable;
+    template<class Buffers>
+    class at_awaitable;
+    class control_awaitable;
+    class splice_awaitable;
+
+    /** Expected access pattern for advise(). */
+    enum access_pattern
+    {
+        normal,             ///< Default readahead
+        sequential,         ///< Read ahead aggressively
+        random,             ///< Disable readahead
+        willneed,           ///< Start reading the range into the page cache now
+        dontneed            ///< Drop the range from the page cache
+    };
+
+    /** Open a file without blocking the calling thread.
+
+        Like open(), but the openat runs through io_uring. A file
+        that is already open is closed asynchronously first. Only
+        one async_open or async_close may be in flight; another
+        completes at once with std::errc::operation_in_progress.
+        If the file is closed or opened synchronously meanwhile, the
+        new descriptor is closed and the open completes as canceled.
+
+        @param path Path to the file to open
+        @param access Access mode (read_only, write_only, read_write)
+        @param creation How to create/open the file
+        @param flags Open options
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable async_open(
+        std::filesystem::path path,
+        access_mode access,
+        creation_mode creation = open_existing,
+        open_flags flags = no_flags);
+
+    /** Close the file without blocking the calling thread.
+
+        Pending operations are cancelled and the stream reads as
+        closed at once; the close itself runs through io_uring.
+        Completes with std::errc::operation_in_progress while an
+        async_open or async_close is in flight.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable async_close();
+
+    /** Flush file data and metadata to stable storage.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable fsync();
+
+    /** Flush file data, and only the metadata needed to read it back.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable fdatasync();
+
+    /** Allocate disk space for a range of the file.
+
+        The file grows if the range extends past its end.
+
+        @param offset Start of the range.
+        @param length Length of the range in bytes.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable fallocate(std::uint64_t offset, std::uint64_t length);
+
+    /** Advise the kernel how a range of the file will be read.
+
+        The advice is given with an io_uring fadvise operation, so
+        the calling thread never blocks on it. It only affects
+        buffered I/O; a file opened with the direct flag bypasses the
+        page cache the advice applies to.
+
+        @param pattern The expected access pattern.
+        @param offset Start of the range.
+        @param length Length of the range in bytes, or zero for
+            everything from offset to the end of the file. A range
+            over 2 GiB is advised in 2 GiB pieces, one after another.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable advise(
+        access_pattern pattern,
+        std::uint64_t offset = 0,
+        std::uint64_t length = 0);
+
+    /** Start reading a range of the file into the page cache.
+
+        Equivalent to advise(willneed, offset, length). The awaitable
+        completes once the readahead has been queued, not once the
+        data is resident, so a read issued afterwards may still wait
+        for the disk; it will not have to start the read itself.
+
+        @param offset Start of the range.
+        @param length Length of the range in bytes.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`;
+            the value is unused.
+    */
+    control_awaitable prefetch(std::uint64_t offset, std::uint64_t length);
+
+    /** Get the file size with statx without blocking.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`
+            with the size in bytes.
+    */
+    control_awaitable async_size();
+
+    /** Read at an explicit offset.
+
+        Positional operations neither use nor move the file position,
+        and each carries its own state, so a single file_stream can
+        have many of them in flight at once. They may run alongside
+        read_some and write_some.
+
+        @param offset Byte offset in the file to read from.
+        @param buffers The buffer sequence to read into. A sequence
+            of several buffers is filled by a single readv.
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    template<class MutableBuffers>
+    at_awaitable<MutableBuffers> read_at(std::uint64_t offset, MutableBuffers buffers)
+    {
+        return at_awaitable<MutableBuffers>(*this, offset, std::move(buffers), at_kind::read);
+    }
+
+    /** Write at an explicit offset.
+
+        @param offset Byte offset in the file to write to.
+        @param buffers The buffer sequence to write from. A sequence
+            of several buffers is gathered by a single writev.
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    template<class ConstBuffers>
+    at_awaitable<ConstBuffers> write_at(std::uint64_t offset, ConstBuffers buffers)
+    {
+        return at_awaitable<ConstBuffers>(*this, offset, std::move(buffers), at_kind::write);
+    }
+
+    /** Read at an explicit offset within a time limit.
+
+        The read is submitted linked to an IORING_OP_LINK_TIMEOUT, so
+        a stalled device cannot hold it past the limit: once the
+        timeout expires the kernel cancels the read, and the
+        awaitable yields std::errc::timed_out. A read that finishes
+        first is unaffected. Cancellation through the stop token
+        still yields capy::cond::canceled.
+
+        @param offset Byte offset in the file to read from.
+        @param buffers The buffer sequence to read into.
+        @param timeout Time limit for the read. A limit of zero or
+            less leaves the read one nanosecond, so it only succeeds
+            if it completes without waiting.
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    template<class MutableBuffers>
+    at_awaitable<MutableBuffers> read_at(
+        std::uint64_t offset,
+        MutableBuffers buffers,
+        std::chrono::nanoseconds timeout)
+    {
+        return at_awaitable<MutableBuffers>(
+            *this, offset, std::move(buffers), at_kind::read, time_limit(timeout));
+    }
+
+    /** Write at an explicit offset within a time limit.
+
+        @param offset Byte offset in the file to write to.
+        @param buffers The buffer sequence to write from.
+        @param timeout Time limit for the write, as for read_at.
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    template<class ConstBuffers>
+    at_awaitable<ConstBuffers> write_at(
+        std::uint64_t offset,
+        ConstBuffers buffers,
+        std::chrono::nanoseconds timeout)
+    {
+        return at_awaitable<ConstBuffers>(
+            *this, offset, std::move(buffers), at_kind::write, time_limit(timeout));
+    }
+
+    using io_stream::read_some;
+    using io_stream::write_some;
+
+    /** Read at the file position within a time limit.
+
+        Like read_some, but bounded by a linked timeout as read_at
+        is. The read moves the file position by the bytes read.
+
+        @param buffers The buffer sequence to read into.
+        @param timeout Time limit for the read.
+
+        @return An awaitable yielding `(error_code, std::size_t)`;
+            std::errc::timed_out if the limit expired first.
+    */
+    template<class MutableBuffers>
+    at_awaitable<MutableBuffers> read_some(MutableBuffers buffers, std::chrono::nanoseconds timeout)
+    {
+        return at_awaitable<MutableBuffers>(
+            *this, 0, std::move(buffers), at_kind::read_some, time_limit(timeout));
+    }
+
+    /** Read at the file position before a deadline.
+
+        @param buffers The buffer sequence to read into.
+        @param deadline Time by which the read must complete.
+
+        @return An awaitable yielding `(error_code, std::size_t)`;
+            std::errc::timed_out if the deadline passed first.
+    */
+    template<class MutableBuffers>
+    at_awaitable<MutableBuffers> read_some(
+        MutableBuffers buffers,
+        std::chrono::steady_clock::time_point deadline)
+    {
+        return read_some(std::move(buffers), deadline - std::chrono::steady_clock::now());
+    }
+
+    /** Write at the file position within a time limit.
+
+        @param buffers The buffer sequence to write from.
+        @param timeout Time limit for the write.
+
+        @return An awaitable yielding `(error_code, std::size_t)`;
+            std::errc::timed_out if the limit expired first.
+    */
+    template<class ConstBuffers>
+    at_awaitable<ConstBuffers> write_some(ConstBuffers buffers, std::chrono::nanoseconds timeout)
+    {
+        return at_awaitable<ConstBuffers>(
+            *this, 0, std::move(buffers), at_kind::write_some, time_limit(timeout));
+    }
+
+    /** Write at the file position before a deadline.
+
+        @param buffers The buffer sequence to write from.
+        @param deadline Time by which the write must complete.
+
+        @return An awaitable yielding `(error_code, std::size_t)`;
+            std::errc::timed_out if the deadline passed first.
+    */
+    template<class ConstBuffers>
+    at_awaitable<ConstBuffers> write_some(
+        ConstBuffers buffers,
+        std::chrono::steady_clock::time_point deadline)
+    {
+        return write_some(std::move(buffers), deadline - std::chrono::steady_clock::now());
+    }
+
+    /** Write at an explicit offset and make the data durable.
+
+        The write is submitted linked to an fdatasync (IOSQE_IO_LINK),
+        so a durable append costs one submission and one resumption.
+        Durable writes issued on the same file during one scheduler
+        turn share a single fdatasync, which lets concurrent writers
+        commit as a group.
+
+        If the write is short the chain stops there: the awaitable
+        yields the bytes written with std::errc::io_error, and none of
+        the data is known to be durable. Durable writes run to
+        completion and ignore cancellation.
+
+        @param offset Byte offset in the file to write to.
+        @param buffers The buffer sequence to write from.
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    template<class ConstBuffers>
+    at_awaitable<ConstBuffers> write_durable_at(std::uint64_t offset, ConstBuffers buffers)
+    {
+        return at_awaitable<ConstBuffers>(*this, offset, std::move(buffers), at_kind::write_durable);
+    }
+
+    /** Send a range of the file to a socket.
+
+        The bytes go from the page cache to the socket through a pipe
+        with splice, without being copied into user space; serving an
+        article from the spool costs no read into a buffer and no
+        write out of it. Where the kernel cannot splice from the
+        file, or file_service_options::splice is off, the range is
+        read into a buffer and sent from it instead.
+
+        The transfer completes once the whole range has been sent. If
+        the file ends first, the awaitable yields the bytes sent with
+        capy::cond::eof. Nothing else may write to the socket until
+        the transfer completes.
+
+        @param sock The socket to send to; anything with a
+            native_handle() returning a descriptor, such as a corosio
+            socket.
+        @param offset Byte offset in the file of the range.
+        @param length Length of the range in bytes.
+
+        @return An awaitable yielding `(error_code, std::uint64_t)`
+            with the bytes sent.
+    */
+    template<class Socket>
+    splice_awaitable splice_to(Socket& sock, std::uint64_t offset, std::uint64_t length);
+
+    /** Lease a buffer from the registered buffer pool.
+
+        The pool is enabled with file_service_options::fixed_buffer_count.
+        Reads and writes through a leased buffer use READ_FIXED and
+        WRITE_FIXED, so the kernel does not pin and unpin its pages on
+        every operation. The lease must end before the execution
+        context is destroyed.
+
+        @return The leased buffer, which is empty if the pool is
+            disabled or exhausted.
+    */
+    fixed_buffer lease_buffer() noexcept;
+
+    /** Read into a leased buffer at the current file position.
+
+        @param buf The leased buffer to read into.
+        @param size Number of bytes to read, at most buf.size().
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    fixed_awaitable read_fixed(fixed_buffer& buf, std::size_t size) noexcept;
+
+    /** Write from a leased buffer at the current file position.
+
+        @param buf The leased buffer to write from.
+        @param size Number of bytes to write, at most buf.size().
+
+        @return An awaitable yielding `(error_code, std::size_t)`.
+    */
+    fixed_awaitable write_fixed(fixed_buffer const& buf, std::size_t size) noexcept;
+#endif
+
 private:
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+    std::coroutine_handle<> start_fixed(
+        bool write,
+        fixed_buffer const& buf,
+        std::size_t size,
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred);
+
+    enum class at_kind
+    {
+        read,
+        write,
+        write_durable,
+        read_some,
+        write_some
+    };
+
+    /** Keep a time limit positive; zero means no limit internally. */
+    static std::chrono::nanoseconds time_limit(std::chrono::nanoseconds timeout) noexcept
+    {
+        return (std::max)(timeout, std::chrono::nanoseconds(1));
+    }
+
+    enum class control_kind
+    {
+        open,
+        close,
+        fsync,
+        fdatasync,
+        fallocate,
+        fadvise,
+        size
+    };
+
+    std::coroutine_handle<> start_splice(
+        splice_awaitable& aw,
+        std::coroutine_handle<> h,
+        std::stop_token token);
+
+    std::coroutine_handle<> start_control(
+        control_awaitable& aw,
+        std::coroutine_handle<> h);
+
+    std::coroutine_handle<> start_at(
+        at_kind kind,
+        std::uint64_t offset,
+        boost::corosio::io_buffer_param buffers,
+        std::coroutine_handle<> h,
+        boost::capy::executor_ref ex,
+        std::stop_token token,
+        std::error_code* ec,
+        std::size_t* bytes_transferred,
+        std::chrono::nanoseconds timeout);
+#endif
+
 #if BOOST_COROSIO_HAS_IOCP
     detail::win_file_service* svc_ = nullptr;
     detail::win_file_impl* impl_ = nullptr;
@@ -150,6 +583,251 @@ private:
 #endif
 };
 
+#if defined(__linux__) && !BOOST_COROSIO_HAS_IOCP
+
+//------------------------------------------------------------------------------
+
+/** A buffer leased from the registered buffer pool.
+
+    Move-only; the buffer returns to the pool when the lease is
+    destroyed.
+*/
+class file_stream::fixed_buffer
+{
+public:
+    fixed_buffer() noexcept = default;
+    fixed_buffer(fixed_buffer&& other) noexcept;
+    fixed_buffer& operator=(fixed_buffer&& other) noexcept;
+    ~fixed_buffer();
+
+    /** Check whether a buffer is leased. */
+    explicit operator bool() const noexcept { return data_ != nullptr; }
+
+    /** Get the buffer memory. */
+    void* data() const noexcept { return data_; }
+
+    /** Get the buffer size in bytes. */
+    std::size_t size() const noexcept { return size_; }
+
+private:
+    friend class file_stream;
+
+    fixed_buffer(
+        detail::uring_file_service* svc,
+        int index,
+        void* data,
+        std::size_t size) noexcept
+        : svc_(svc)
+        , index_(index)
+        , data_(data)
+        , size_(size)
+    {
+    }
+
+    void release() noexcept;
+
+    detail::uring_file_service* svc_ = nullptr;
+    int index_ = -1;
+    void* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+//------------------------------------------------------------------------------
+
+/** Awaitable for read_fixed and write_fixed. */
+class file_stream::fixed_awaitable
+{
+    file_stream* fs_;
+    fixed_buffer const* buf_;
+    std::size_t size_;
+    bool write_;
+    std::error_code ec_;
+    std::size_t n_ = 0;
+
+public:
+    fixed_awaitable(
+        file_stream& fs,
+        fixed_buffer const& buf,
+        std::size_t size,
+        bool write) noexcept
+        : fs_(&fs)
+        , buf_(&buf)
+        , size_(size)
+        , write_(write)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template<class Ex>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> h,
+        Ex const& ex,
+        std::stop_token token)
+    {
+        return fs_->start_fixed(
+            write_, *buf_, size_, h, ex, std::move(token), &ec_, &n_);
+    }
+
+    boost::capy::io_result<std::size_t> await_resume() const noexcept
+    {
+        return {ec_, n_};
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** Awaitable for the positional and timed operations. */
+template<class Buffers>
+class file_stream::at_awaitable
+{
+    file_stream* fs_;
+    std::uint64_t offset_;
+    Buffers buffers_;
+    at_kind kind_;
+    std::chrono::nanoseconds timeout_;
+    std::error_code ec_;
+    std::size_t n_ = 0;
+
+public:
+    at_awaitable(
+        file_stream& fs,
+        std::uint64_t offset,
+        Buffers buffers,
+        at_kind kind,
+        std::chrono::nanoseconds timeout = {}) noexcept
+        : fs_(&fs)
+        , offset_(offset)
+        , buffers_(std::move(buffers))
+        , kind_(kind)
+        , timeout_(timeout)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template<class Ex>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> h,
+        Ex const& ex,
+        std::stop_token token)
+    {
+        return fs_->start_at(
+            kind_, offset_, buffers_, h, ex, std::move(token), &ec_, &n_, timeout_);
+    }
+
+    boost::capy::io_result<std::size_t> await_resume() const noexcept
+    {
+        return {ec_, n_};
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** Awaitable for the file management operations. */
+class file_stream::control_awaitable
+{
+    friend class file_stream;
+
+    file_stream* fs_;
+    control_kind what_;
+    std::filesystem::path path_;
+    int flags_ = 0;
+    std::uint64_t offset_ = 0;
+    std::uint64_t length_ = 0;
+    access_pattern pattern_ = normal;
+    std::error_code ec_;
+    std::uint64_t value_ = 0;
+
+public:
+    control_awaitable(file_stream& fs, control_kind what) noexcept
+        : fs_(&fs)
+        , what_(what)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template<class Ex>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> h,
+        Ex const&,
+        std::stop_token)
+    {
+        return fs_->start_control(*this, h);
+    }
+
+    boost::capy::io_result<std::uint64_t> await_resume() const noexcept
+    {
+        return {ec_, value_};
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** Awaitable for splice_to. */
+class file_stream::splice_awaitable
+{
+    friend class file_stream;
+
+    file_stream* fs_;
+    int sock_fd_;
+    std::uint64_t offset_;
+    std::uint64_t length_;
+    std::error_code ec_;
+    std::uint64_t n_ = 0;
+
+public:
+    splice_awaitable(
+        file_stream& fs,
+        int sock_fd,
+        std::uint64_t offset,
+        std::uint64_t length) noexcept
+        : fs_(&fs)
+        , sock_fd_(sock_fd)
+        , offset_(offset)
+        , length_(length)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template<class Ex>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> h,
+        Ex const&,
+        std::stop_token token)
+    {
+        return fs_->start_splice(*this, h, std::move(token));
+    }
+
+    boost::capy::io_result<std::uint64_t> await_resume() const noexcept
+    {
+        return {ec_, n_};
+    }
+};
+
+template<class Socket>
+file_stream::splice_awaitable
+file_stream::splice_to(Socket& sock, std::uint64_t offset, std::uint64_t length)
+{
+    return splice_awaitable(*this, static_cast<int>(sock.native_handle()), offset, length);
+}
+
+#endif
+
 } // namespace nntp
 
 #endif // NNTP_FILE_STREAM_H
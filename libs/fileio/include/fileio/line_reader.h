@@ -0,0 +1,228 @@
+#ifndef NNTP_LINE_READER_H
+#define NNTP_LINE_READER_H
+
+#include <boost/capy/buffers.hpp>
+#include <boost/capy/cond.hpp>
+#include <boost/capy/error.hpp>
+#include <boost/capy/task.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace nntp {
+
+/** Reads a stream one line at a time through a large buffer.
+
+    Text files such as the access file and newsrc files are read
+    line by line, but reading them that way from the stream would
+    cost an operation per handful of bytes. The reader instead
+    fills its buffer with reads of up to read_size bytes and hands
+    out lines as views into it.
+
+    Lines end with LF or CRLF; the terminator is not part of the
+    line. A final line without a terminator is returned as is. A
+    line that straddles two reads is completed in place: before each
+    read, the unfinished line is moved to the front of the buffer,
+    so only that partial line is ever copied. A line longer than the
+    buffer doubles it, up to the maximum line length; a longer line
+    is an error rather than a reason to buffer the whole stream.
+
+    Works with any stream whose read_some(mutable_buffer) yields
+    `(error_code, std::size_t)` and reports the end with
+    capy::cond::eof, such as file_stream and test::mock_file_stream.
+
+    @par Thread Safety
+    Distinct objects: Safe.
+    Shared objects: Unsafe. Only one read_line may be outstanding at
+    a time.
+*/
+template<class Stream>
+class line_reader
+{
+public:
+    /** Default number of bytes requested per read. */
+    static constexpr std::size_t default_read_size = 256 * 1024;
+
+    /** Default limit on the length of a line. */
+    static constexpr std::size_t default_max_line_length = 1024 * 1024;
+
+    /** Construct a reader.
+
+        @param stream The stream to read from, positioned where
+            reading should start.
+        @param read_size Number of bytes requested per read, and the
+            initial size of the buffer.
+        @param max_line_length Longest line accepted, in bytes,
+            not counting its terminator.
+
+        @throws std::invalid_argument if read_size or max_line_length
+            is zero.
+    */
+    explicit line_reader(
+        Stream& stream,
+        std::size_t read_size = default_read_size,
+        std::size_t max_line_length = default_max_line_length);
+
+    line_reader(line_reader const&) = delete;
+    line_reader& operator=(line_reader const&) = delete;
+
+    /** Read the next line.
+
+        @param line Set to the line, without its terminator. The view
+            points into the reader's buffer and stays valid until
+            the next call to read_line.
+
+        @return A task yielding an empty error code when a line was
+            read, capy::error::eof once every line has been read,
+            std::errc::value_too_large if the next line is longer
+            than the maximum line length, or the stream's error.
+            After an error other than eof, the reader must not be
+            used again.
+    */
+    boost::capy::task<std::error_code> read_line(std::string_view& line);
+
+    /** Get the number of lines read so far. */
+    std::size_t line_number() const noexcept { return lines_; }
+
+private:
+    std::string_view take(std::size_t length, std::size_t next) noexcept;
+    bool too_long(std::size_t length) const noexcept;
+
+    Stream& stream_;
+    std::vector<char> buffer_;
+    std::size_t max_line_length_;
+
+    /** Start of the first unread line. */
+    std::size_t begin_ = 0;
+
+    /** End of the buffered data. */
+    std::size_t end_ = 0;
+
+    /** Where the search for the next LF resumes. */
+    std::size_t scan_ = 0;
+
+    std::size_t lines_ = 0;
+    bool eof_ = false;
+};
+
+//------------------------------------------------------------------------------
+
+template<class Stream>
+line_reader<Stream>::line_reader(
+    Stream& stream,
+    std::size_t read_size,
+    std::size_t max_line_length)
+    : stream_(stream)
+    // Leave room to add the terminator without overflowing
+    , max_line_length_(std::min(max_line_length, std::size_t(-1) - 2))
+{
+    if (read_size == 0)
+        throw std::invalid_argument("line_reader: read_size must not be zero");
+    if (max_line_length == 0)
+        throw std::invalid_argument("line_reader: max_line_length must not be zero");
+    buffer_.resize(read_size);
+}
+
+template<class Stream>
+std::string_view
+line_reader<Stream>::take(std::size_t length, std::size_t next) noexcept
+{
+    std::string_view line(buffer_.data() + begin_, length);
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    begin_ = next;
+    scan_ = next;
+    ++lines_;
+    return line;
+}
+
+template<class Stream>
+bool
+line_reader<Stream>::too_long(std::size_t length) const noexcept
+{
+    // A CR before the LF belongs to the terminator
+    if (length > 0 && buffer_[begin_ + length - 1] == '\r')
+        --length;
+    return length > max_line_length_;
+}
+
+template<class Stream>
+boost::capy::task<std::error_code>
+line_reader<Stream>::read_line(std::string_view& line)
+{
+    for (;;)
+    {
+        // Only bytes not searched before are scanned
+        if (auto const* lf = static_cast<char const*>(
+                std::memchr(buffer_.data() + scan_, '\n', end_ - scan_)))
+        {
+            auto pos = static_cast<std::size_t>(lf - buffer_.data());
+            if (too_long(pos - begin_))
+            {
+                line = {};
+                co_return std::make_error_code(std::errc::value_too_large);
+            }
+            line = take(pos - begin_, pos + 1);
+            co_return std::error_code();
+        }
+        scan_ = end_;
+
+        if (eof_)
+        {
+            if (begin_ == end_)
+            {
+                line = {};
+                co_return boost::capy::error::eof;
+            }
+            if (too_long(end_ - begin_))
+            {
+                line = {};
+                co_return std::make_error_code(std::errc::value_too_large);
+            }
+            line = take(end_ - begin_, end_);
+            co_return std::error_code();
+        }
+
+        // The unfinished line is already too long, bar a CR that may
+        // turn out to start its terminator
+        if (end_ - begin_ > max_line_length_ + 1)
+        {
+            line = {};
+            co_return std::make_error_code(std::errc::value_too_large);
+        }
+
+        // Keep the unfinished line and make room after it
+        if (begin_ != 0)
+        {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            scan_ = end_;
+            begin_ = 0;
+        }
+        // Room for the longest line and its CRLF is all a line needs
+        if (end_ == buffer_.size())
+            buffer_.resize(std::min(buffer_.size() * 2, max_line_length_ + 2));
+
+        auto [ec, n] = co_await stream_.read_some(
+            boost::capy::mutable_buffer(buffer_.data() + end_, buffer_.size() - end_));
+        end_ += n;
+        if (ec == boost::capy::cond::eof || (!ec && n == 0))
+        {
+            eof_ = true;
+        }
+        else if (ec)
+        {
+            line = {};
+            co_return ec;
+        }
+    }
+}
+
+} // namespace nntp
+
+#endif // NNTP_LINE_READER_H
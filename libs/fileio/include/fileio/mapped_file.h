@@ -0,0 +1,207 @@
+#ifndef NNTP_MAPPED_FILE_H
+#define NNTP_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <system_error>
+#include <vector>
+
+namespace nntp {
+
+/** Read-only memory mapping of a file.
+
+    Lookups into an overview database or history file touch a few
+    bytes at scattered offsets. Reading them through a mapping costs
+    no system call once the page is resident, where a file_stream
+    read costs a submission and a completion per lookup.
+
+    The file is mapped in full. When it grows, remap() extends the
+    view. Bytes past the end of the file at the time of the last
+    open() or remap() are not visible.
+
+    On Linux and macOS each mapping reserves address space for twice
+    the file's size, so a growing file is only mapped again once it
+    has doubled; until then remap() just extends the view. When the
+    file is mapped again, views taken before stay valid because the
+    old mapping is kept rather than moved. Old mappings are released
+    by release_old_mappings() or close(). Without releasing them,
+    the address space held is bounded by four times the current
+    file size, since each mapping is at least twice the one before.
+
+    On Linux and macOS the file is mapped with mmap and advice is
+    given with madvise. On Windows it is mapped with a file mapping
+    object; only willneed advice has an effect there.
+
+    @par Thread Safety
+    Distinct objects: Safe.
+    Shared objects: Safe for concurrent data(), view() and advise().
+    open(), remap() and close() must not run concurrently with any
+    other member function.
+*/
+class mapped_file
+{
+public:
+    /** Options applied when mapping. */
+    enum map_flags
+    {
+        no_flags = 0,
+
+        /** Fault the whole file in while mapping (MAP_POPULATE). Linux only. */
+        populate = 1,
+
+        /** Ask for transparent huge pages (MADV_HUGEPAGE). Linux only,
+            and only effective where the kernel supports huge pages
+            for the file's filesystem. */
+        huge_pages = 2
+    };
+
+    /** Expected access pattern for advise(). */
+    enum access_pattern
+    {
+        /** Default readahead. */
+        normal,
+
+        /** Aggressive readahead; pages behind the reader may be dropped. */
+        sequential,
+
+        /** No readahead; each fault reads only the page it needs. */
+        random,
+
+        /** Start reading the range in now. */
+        willneed,
+
+        /** The range will not be needed soon. */
+        dontneed
+    };
+
+    /** Construct a closed mapping. */
+    mapped_file() noexcept = default;
+
+    /** Unmap the file. */
+    ~mapped_file();
+
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    /** Map a file read-only.
+
+        Any file already mapped is closed first. An empty file opens
+        successfully with an empty view.
+
+        @param path Path to the file.
+        @param flags Mapping options.
+
+        @return Error code, empty if successful.
+    */
+    std::error_code open(std::filesystem::path const& path, map_flags flags = no_flags);
+
+    /** Unmap the file and invalidate every view. */
+    void close() noexcept;
+
+    /** Check whether a file is mapped. */
+    bool is_open() const noexcept;
+
+    /** Get the number of mapped bytes. */
+    std::uint64_t size() const noexcept { return size_; }
+
+    /** Get the whole mapped file. */
+    std::span<std::byte const> data() const noexcept
+    {
+        return {data_, static_cast<std::size_t>(size_)};
+    }
+
+    /** Get part of the mapped file.
+
+        The view is clipped to the mapped size, so a range starting
+        at or past the end yields an empty span.
+
+        @param offset Offset of the first byte.
+        @param length Number of bytes.
+    */
+    std::span<std::byte const> view(std::uint64_t offset, std::size_t length) const noexcept
+    {
+        if (offset >= size_)
+            return {};
+        std::uint64_t avail = size_ - offset;
+        if (length > avail)
+            length = static_cast<std::size_t>(avail);
+        return {data_ + offset, length};
+    }
+
+    /** Advise the kernel how the whole mapping will be read.
+
+        @param pattern The expected access pattern.
+
+        @return Error code, empty if successful.
+    */
+    std::error_code advise(access_pattern pattern) noexcept;
+
+    /** Advise the kernel how a range of the mapping will be read.
+
+        The range is clipped to the mapped size and widened to page
+        boundaries.
+
+        @param pattern The expected access pattern.
+        @param offset Offset of the first byte.
+        @param length Number of bytes.
+
+        @return Error code, empty if successful.
+    */
+    std::error_code advise(access_pattern pattern, std::uint64_t offset, std::uint64_t length) noexcept;
+
+    /** Extend the mapping to the file's current size.
+
+        Does nothing if the file has not grown. A file that grew
+        within the address space already reserved is only exposed
+        further. Otherwise the file is mapped again at its new size;
+        views taken before stay valid until release_old_mappings()
+        or close(). A file that shrank keeps its old mapping, and
+        reading pages past the new end faults.
+
+        @param grew Set to whether the mapping was extended, if not null.
+
+        @return Error code, empty if successful.
+    */
+    std::error_code remap(bool* grew = nullptr);
+
+    /** Release the mappings left behind by remap().
+
+        Views taken before the file was last mapped again become
+        invalid; views of the current mapping stay valid. Call it
+        once no such view is in use.
+    */
+    void release_old_mappings() noexcept;
+
+private:
+    struct region
+    {
+        void* base;
+        std::size_t size;
+    };
+
+    std::error_code map(std::uint64_t size);
+    static void unmap(region r) noexcept;
+
+    std::byte const* data_ = nullptr;
+    std::uint64_t size_ = 0;
+    map_flags flags_ = no_flags;
+
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+    /** The current mapping followed by older ones kept for their
+        views. A region's size is the address space it reserves. */
+    std::vector<region> regions_;
+};
+
+} // namespace nntp
+
+#endif // NNTP_MAPPED_FILE_H
@@ -0,0 +1,388 @@
+#include <fileio/mapped_file.h>
+
+#include "src/detail/make_err.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace nntp {
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , flags_(other.flags_)
+#ifdef _WIN32
+    , handle_(std::exchange(other.handle_, nullptr))
+#else
+    , fd_(std::exchange(other.fd_, -1))
+#endif
+    , regions_(std::move(other.regions_))
+{
+    other.regions_.clear();
+}
+
+mapped_file&
+mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        flags_ = other.flags_;
+#ifdef _WIN32
+        handle_ = std::exchange(other.handle_, nullptr);
+#else
+        fd_ = std::exchange(other.fd_, -1);
+#endif
+        regions_ = std::move(other.regions_);
+        other.regions_.clear();
+    }
+    return *this;
+}
+
+void
+mapped_file::close() noexcept
+{
+    for (auto r : regions_)
+        unmap(r);
+    regions_.clear();
+    data_ = nullptr;
+    size_ = 0;
+
+#ifdef _WIN32
+    if (handle_)
+    {
+        ::CloseHandle(static_cast<HANDLE>(handle_));
+        handle_ = nullptr;
+    }
+#else
+    if (fd_ != -1)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+#ifdef _WIN32
+
+//------------------------------------------------------------------------------
+// Windows implementation
+
+bool
+mapped_file::is_open() const noexcept
+{
+    return handle_ != nullptr;
+}
+
+std::error_code
+mapped_file::open(std::filesystem::path const& path, map_flags flags)
+{
+    close();
+
+    // Writers may keep appending while the file is mapped
+    HANDLE h = ::CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+        nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return boost::corosio::detail::make_err(::GetLastError());
+
+    handle_ = h;
+    flags_ = flags;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(h, &size))
+    {
+        auto ec = boost::corosio::detail::make_err(::GetLastError());
+        close();
+        return ec;
+    }
+
+    auto ec = map(static_cast<std::uint64_t>(size.QuadPart));
+    if (ec)
+        close();
+    return ec;
+}
+
+std::error_code
+mapped_file::map(std::uint64_t size)
+{
+    // A file mapping object cannot be empty
+    if (size == 0)
+        return {};
+
+    if (size > SIZE_MAX)
+        return std::make_error_code(std::errc::value_too_large);
+
+    // Room to record the view, so it cannot leak
+    regions_.reserve(regions_.size() + 1);
+
+    HANDLE mapping = ::CreateFileMappingW(
+        static_cast<HANDLE>(handle_), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+        return boost::corosio::detail::make_err(::GetLastError());
+
+    // The view keeps the mapping object alive
+    void* base = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size));
+    DWORD err = ::GetLastError();
+    ::CloseHandle(mapping);
+    if (!base)
+        return boost::corosio::detail::make_err(err);
+
+    regions_.insert(regions_.begin(), region{base, static_cast<std::size_t>(size)});
+    data_ = static_cast<std::byte const*>(base);
+    size_ = size;
+    return {};
+}
+
+void
+mapped_file::unmap(region r) noexcept
+{
+    ::UnmapViewOfFile(r.base);
+}
+
+std::error_code
+mapped_file::advise(access_pattern pattern, std::uint64_t offset, std::uint64_t length) noexcept
+{
+    if (offset >= size_)
+        return {};
+    if (length > size_ - offset)
+        length = size_ - offset;
+
+    // Windows only takes prefetch requests for mapped memory
+    if (pattern != willneed)
+        return {};
+
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<std::byte*>(data_ + offset);
+    range.NumberOfBytes = static_cast<SIZE_T>(length);
+    if (!::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0))
+        return boost::corosio::detail::make_err(::GetLastError());
+    return {};
+}
+
+std::error_code
+mapped_file::remap(bool* grew)
+{
+    if (grew)
+        *grew = false;
+    if (!handle_)
+        return std::make_error_code(std::errc::bad_file_descriptor);
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(static_cast<HANDLE>(handle_), &size))
+        return boost::corosio::detail::make_err(::GetLastError());
+
+    auto new_size = static_cast<std::uint64_t>(size.QuadPart);
+    if (new_size <= size_)
+        return {};
+
+    auto ec = map(new_size);
+    if (!ec && grew)
+        *grew = true;
+    return ec;
+}
+
+#else
+
+//------------------------------------------------------------------------------
+// POSIX implementation
+
+namespace {
+
+int
+to_madvise(mapped_file::access_pattern pattern) noexcept
+{
+    switch (pattern)
+    {
+    case mapped_file::sequential:
+        return MADV_SEQUENTIAL;
+    case mapped_file::random:
+        return MADV_RANDOM;
+    case mapped_file::willneed:
+        return MADV_WILLNEED;
+    case mapped_file::dontneed:
+        return MADV_DONTNEED;
+    case mapped_file::normal:
+    default:
+        return MADV_NORMAL;
+    }
+}
+
+} // namespace
+
+bool
+mapped_file::is_open() const noexcept
+{
+    return fd_ != -1;
+}
+
+std::error_code
+mapped_file::open(std::filesystem::path const& path, map_flags flags)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return boost::corosio::detail::make_err(errno);
+
+    fd_ = fd;
+    flags_ = flags;
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1)
+    {
+        auto ec = boost::corosio::detail::make_err(errno);
+        close();
+        return ec;
+    }
+
+    auto ec = map(static_cast<std::uint64_t>(st.st_size));
+    if (ec)
+        close();
+    return ec;
+}
+
+std::error_code
+mapped_file::map(std::uint64_t size)
+{
+    // mmap rejects empty mappings
+    if (size == 0)
+        return {};
+
+    if (size > SIZE_MAX)
+        return std::make_error_code(std::errc::value_too_large);
+
+    int mmap_flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (flags_ & populate)
+        mmap_flags |= MAP_POPULATE;
+#endif
+
+    // Room to record the mapping, so it cannot leak
+    regions_.reserve(regions_.size() + 1);
+
+    // Reserve room for the file to double. Pages past its end fault
+    // until the file grows over them, and remap() then only has to
+    // extend the view
+    static std::size_t const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto bytes = static_cast<std::size_t>(size);
+    if (bytes <= (SIZE_MAX - page) / 2)
+        bytes = (bytes * 2 + page - 1) & ~(page - 1);
+
+    void* base = ::mmap(nullptr, bytes, PROT_READ, mmap_flags, fd_, 0);
+    if (base == MAP_FAILED)
+        return boost::corosio::detail::make_err(errno);
+
+#ifdef MADV_HUGEPAGE
+    // Only a hint: filesystems without huge page support refuse it
+    if (flags_ & huge_pages)
+        ::madvise(base, bytes, MADV_HUGEPAGE);
+#endif
+
+    // Older mappings stay behind the current one until released
+    regions_.insert(regions_.begin(), region{base, bytes});
+    data_ = static_cast<std::byte const*>(base);
+    size_ = size;
+    return {};
+}
+
+void
+mapped_file::unmap(region r) noexcept
+{
+    ::munmap(r.base, r.size);
+}
+
+std::error_code
+mapped_file::advise(access_pattern pattern, std::uint64_t offset, std::uint64_t length) noexcept
+{
+    if (offset >= size_)
+        return {};
+    if (length > size_ - offset)
+        length = size_ - offset;
+
+    // madvise needs a page aligned start
+    static std::size_t const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t begin = static_cast<std::size_t>(offset) & ~(page - 1);
+    std::size_t end = static_cast<std::size_t>(offset + length);
+
+    void* addr = const_cast<std::byte*>(data_ + begin);
+    if (::madvise(addr, end - begin, to_madvise(pattern)) == -1)
+        return boost::corosio::detail::make_err(errno);
+    return {};
+}
+
+std::error_code
+mapped_file::remap(bool* grew)
+{
+    if (grew)
+        *grew = false;
+    if (fd_ == -1)
+        return std::make_error_code(std::errc::bad_file_descriptor);
+
+    struct stat st;
+    if (::fstat(fd_, &st) == -1)
+        return boost::corosio::detail::make_err(errno);
+
+    auto new_size = static_cast<std::uint64_t>(st.st_size);
+    if (new_size <= size_)
+        return {};
+
+    if (!regions_.empty() && new_size <= regions_.front().size)
+    {
+        size_ = new_size;
+        if (grew)
+            *grew = true;
+        return {};
+    }
+
+    auto ec = map(new_size);
+    if (!ec && grew)
+        *grew = true;
+    return ec;
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// Common
+
+std::error_code
+mapped_file::advise(access_pattern pattern) noexcept
+{
+    return advise(pattern, 0, size_);
+}
+
+void
+mapped_file::release_old_mappings() noexcept
+{
+    if (regions_.size() <= 1)
+        return;
+    for (std::size_t i = 1; i < regions_.size(); ++i)
+        unmap(regions_[i]);
+    regions_.resize(1);
+}
+
+} // namespace nntp
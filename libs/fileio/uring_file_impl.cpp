@@ -2,24 +2,99 @@
 
 #include <fileio/detail/uring_file_impl.h>
 #include <fileio/detail/uring_file_service.h>
+#include <fileio/aligned_allocator.h>
 #include <boost/corosio/detail/platform.hpp>
 
 #if BOOST_COROSIO_HAS_EPOLL
 
 #include "src/detail/make_err.hpp"
+#include <boost/capy/cond.hpp>
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <liburing.h>
 
+#include <memory>
+
 namespace nntp::detail {
 
+namespace {
+
+// Store a buffer sequence in an operation. A single buffer uses the
+// plain read/write entry; longer sequences fill the operation's iovec
+// array so the whole sequence goes out as one readv/writev entry.
+// Returns the number of bytes described.
+template<class Op>
+std::size_t
+set_buffers(Op& op, boost::corosio::io_buffer_param buffers) noexcept
+{
+    boost::capy::mutable_buffer bufs[max_file_iovecs];
+    auto buf_count = buffers.copy_to(bufs, max_file_iovecs);
+
+    op.iovec_count = 0;
+    if (buf_count == 0)
+        return 0;
+
+    op.buffer_ptr = bufs[0].data();
+    op.buffer_size = bufs[0].size();
+    if (buf_count == 1)
+        return bufs[0].size();
+
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < buf_count; ++i)
+    {
+        op.iovecs[i].iov_base = bufs[i].data();
+        op.iovecs[i].iov_len = bufs[i].size();
+        total += bufs[i].size();
+    }
+    op.iovec_count = static_cast<unsigned>(buf_count);
+    return total;
+}
+
+// Complete a rejected request without suspending
+std::coroutine_handle<>
+reject(
+    std::coroutine_handle<> h,
+    std::error_code* ec,
+    std::size_t* bytes_transferred) noexcept
+{
+    if (ec)
+        *ec = std::make_error_code(std::errc::invalid_argument);
+    if (bytes_transferred)
+        *bytes_transferred = 0;
+    return h;
+}
+
+} // namespace
+
 //------------------------------------------------------------------------------
 // uring_file_impl_internal
 
+bool
+uring_file_impl_internal::direct_ok(
+    boost::corosio::io_buffer_param buffers,
+    std::uint64_t offset) const noexcept
+{
+    if (!direct_)
+        return true;
+    if (!is_direct_aligned(offset))
+        return false;
+
+    boost::capy::mutable_buffer bufs[max_file_iovecs];
+    auto buf_count = buffers.copy_to(bufs, max_file_iovecs);
+    for (std::size_t i = 0; i < buf_count; ++i)
+    {
+        if (!is_direct_aligned(bufs[i].data()) || !is_direct_aligned(bufs[i].size()))
+            return false;
+    }
+    return true;
+}
+
 uring_file_impl_internal::uring_file_impl_internal(uring_file_service& svc) noexcept
     : svc_(svc)
     , rd_(*this)
     , wr_(*this)
+    , shared_refs_(!svc.single_threaded())
 {
 }
 
@@ -48,8 +123,12 @@ uring_file_impl_internal::read_some(
     std::error_code* ec,
     std::size_t* bytes_transferred)
 {
+    // O_DIRECT transfers must be aligned in memory and in the file
+    if (!direct_ok(buffers, position_))
+        return reject(h, ec, bytes_transferred);
+
     // Keep internal alive during I/O
-    rd_.internal_ptr = shared_from_this();
+    rd_.internal_ptr = file_ref(this);
 
     auto& op = rd_;
     op.reset();
@@ -59,12 +138,8 @@ uring_file_impl_internal::read_some(
     op.bytes_out = bytes_transferred;
     op.start(token);
 
-    // Prepare buffer (files use single buffer)
-    boost::capy::mutable_buffer bufs[1];
-    auto buf_count = buffers.copy_to(bufs, 1);
-
     // Handle empty buffer: complete with 0 bytes via post for consistency
-    if (buf_count == 0)
+    if (set_buffers(op, buffers) == 0)
     {
         op.bytes_transferred = 0;
         op.empty_buffer = true;
@@ -77,61 +152,62 @@ uring_file_impl_internal::read_some(
         return std::noop_coroutine();
     }
 
-    // Store buffer information in operation
-    op.buffer_ptr = bufs[0].data();
-    op.buffer_size = bufs[0].size();
+    // Buffers were stored by set_buffers above
     op.file_offset = position_;
+    op.buf_index = -1;
 
     // Symmetric transfer to initiator - I/O starts after caller is suspended
     return read_initiator_.start<&uring_file_impl_internal::do_read_io>(this);
 }
 
-void
-uring_file_impl_internal::do_read_io()
+std::coroutine_handle<>
+uring_file_impl_internal::read_fixed(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    void* data,
+    std::size_t size,
+    int buf_index,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred)
 {
-    auto& op = rd_;
+    // O_DIRECT transfers must be aligned in memory and in the file
+    if (!direct_ok(boost::capy::mutable_buffer(const_cast<void*>(data), size), position_))
+        return reject(h, ec, bytes_transferred);
 
-    svc_.work_started();
+    // Keep internal alive during I/O
+    rd_.internal_ptr = file_ref(this);
 
-    // Get io_uring instance
-    io_uring* ring = svc_.native_handle();
+    auto& op = rd_;
+    op.reset();
+    op.h = h;
+    op.ex = ex;
+    op.ec_out = ec;
+    op.bytes_out = bytes_transferred;
+    op.start(token);
 
-    // Get SQE (Submission Queue Entry) from io_uring
-    io_uring_sqe* sqe = io_uring_get_sqe(ring);
-    if (!sqe)
-    {
-        // No SQE available - this is a fatal error
-        svc_.work_finished();
-        if (op.ec_out)
-            *op.ec_out = boost::corosio::detail::make_err(ENOMEM);
-        if (op.bytes_out)
-            *op.bytes_out = 0;
-        svc_.sched_.post(&op);
-        return;
-    }
+    // Registered buffer: the kernel already holds its pages
+    op.buffer_ptr = data;
+    op.buffer_size = size;
+    op.file_offset = position_;
+    op.buf_index = buf_index;
+    op.iovec_count = 0;
 
-    // Prepare read operation at specified file offset
-    io_uring_prep_read(sqe, fd_, op.buffer_ptr, op.buffer_size, op.file_offset);
+    // Symmetric transfer to initiator - I/O starts after caller is suspended
+    return read_initiator_.start<&uring_file_impl_internal::do_read_io>(this);
+}
 
-    // Set user_data to operation pointer for completion identification
-    io_uring_sqe_set_data(sqe, &op);
+void
+uring_file_impl_internal::do_read_io()
+{
+    auto& op = rd_;
 
-    // Submit to kernel
-    int ret = io_uring_submit(ring);
-    if (ret < 0)
-    {
-        // Submission failed - complete with error
-        svc_.work_finished();
-        if (op.ec_out)
-            *op.ec_out = boost::corosio::detail::make_err(-ret);
-        if (op.bytes_out)
-            *op.bytes_out = 0;
-        svc_.sched_.post(&op);
-        return;
-    }
+    svc_.work_started();
 
-    // Successfully submitted - kernel will perform async I/O
-    // Completion will be delivered via io_uring CQ and processed by poll_completions()
+    // Prepared now if the ring has room, otherwise parked until
+    // completions drain. Either way it is submitted with the rest
+    // of the scheduler turn's entries and completes via poll_completions()
+    svc_.start_op(op);
 }
 
 std::coroutine_handle<>
@@ -143,8 +219,12 @@ uring_file_impl_internal::write_some(
     std::error_code* ec,
     std::size_t* bytes_transferred)
 {
+    // O_DIRECT transfers must be aligned in memory and in the file
+    if (!direct_ok(buffers, position_))
+        return reject(h, ec, bytes_transferred);
+
     // Keep internal alive during I/O
-    wr_.internal_ptr = shared_from_this();
+    wr_.internal_ptr = file_ref(this);
 
     auto& op = wr_;
     op.reset();
@@ -154,12 +234,8 @@ uring_file_impl_internal::write_some(
     op.bytes_out = bytes_transferred;
     op.start(token);
 
-    // Prepare buffer
-    boost::capy::mutable_buffer bufs[1];
-    auto buf_count = buffers.copy_to(bufs, 1);
-
     // Handle empty buffer: complete immediately with 0 bytes
-    if (buf_count == 0)
+    if (set_buffers(op, buffers) == 0)
     {
         op.bytes_transferred = 0;
         op.empty_buffer = true;
@@ -171,10 +247,46 @@ uring_file_impl_internal::write_some(
         return std::noop_coroutine();
     }
 
-    // Store buffer information in operation
-    op.buffer_ptr = bufs[0].data();
-    op.buffer_size = bufs[0].size();
+    // Buffers were stored by set_buffers above
+    op.file_offset = position_;
+    op.buf_index = -1;
+
+    // Symmetric transfer to initiator - I/O starts after caller is suspended
+    return write_initiator_.start<&uring_file_impl_internal::do_write_io>(this);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::write_fixed(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    void const* data,
+    std::size_t size,
+    int buf_index,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred)
+{
+    // O_DIRECT transfers must be aligned in memory and in the file
+    if (!direct_ok(boost::capy::mutable_buffer(const_cast<void*>(data), size), position_))
+        return reject(h, ec, bytes_transferred);
+
+    // Keep internal alive during I/O
+    wr_.internal_ptr = file_ref(this);
+
+    auto& op = wr_;
+    op.reset();
+    op.h = h;
+    op.ex = ex;
+    op.ec_out = ec;
+    op.bytes_out = bytes_transferred;
+    op.start(token);
+
+    // Registered buffer: the kernel already holds its pages
+    op.buffer_ptr = data;
+    op.buffer_size = size;
     op.file_offset = position_;
+    op.buf_index = buf_index;
+    op.iovec_count = 0;
 
     // Symmetric transfer to initiator - I/O starts after caller is suspended
     return write_initiator_.start<&uring_file_impl_internal::do_write_io>(this);
@@ -187,45 +299,180 @@ uring_file_impl_internal::do_write_io()
 
     svc_.work_started();
 
-    // Get io_uring instance
-    io_uring* ring = svc_.native_handle();
+    // Prepared now if the ring has room, otherwise parked until
+    // completions drain. Either way it is submitted with the rest
+    // of the scheduler turn's entries and completes via poll_completions()
+    svc_.start_op(op);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::read_at(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    std::uint64_t offset,
+    boost::corosio::io_buffer_param buffers,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred,
+    std::chrono::nanoseconds timeout)
+{
+    return start_at(false, h, ex, offset, buffers, std::move(token), ec, bytes_transferred,
+        timeout, false);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::write_at(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    std::uint64_t offset,
+    boost::corosio::io_buffer_param buffers,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred,
+    std::chrono::nanoseconds timeout)
+{
+    return start_at(true, h, ex, offset, buffers, std::move(token), ec, bytes_transferred,
+        timeout, false);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::read_some_for(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    boost::corosio::io_buffer_param buffers,
+    std::chrono::nanoseconds timeout,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred)
+{
+    return start_at(false, h, ex, position_, buffers, std::move(token), ec, bytes_transferred,
+        timeout, true);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::write_some_for(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref ex,
+    boost::corosio::io_buffer_param buffers,
+    std::chrono::nanoseconds timeout,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred)
+{
+    return start_at(true, h, ex, position_, buffers, std::move(token), ec, bytes_transferred,
+        timeout, true);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::start_at(
+    bool write,
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref /*ex*/,
+    std::uint64_t offset,
+    boost::corosio::io_buffer_param buffers,
+    std::stop_token token,
+    std::error_code* ec,
+    std::size_t* bytes_transferred,
+    std::chrono::nanoseconds timeout,
+    bool advance)
+{
+    // O_DIRECT transfers must be aligned in memory and in the file
+    if (!direct_ok(buffers, offset))
+        return reject(h, ec, bytes_transferred);
 
-    // Get SQE (Submission Queue Entry) from io_uring
-    io_uring_sqe* sqe = io_uring_get_sqe(ring);
-    if (!sqe)
+    // A stop callback registered on a stopped token runs at once,
+    // before the operation is queued, and would find nothing to cancel
+    if (token.stop_requested())
     {
-        // No SQE available - this is a fatal error
-        svc_.work_finished();
-        if (op.ec_out)
-            *op.ec_out = boost::corosio::detail::make_err(ENOMEM);
-        if (op.bytes_out)
-            *op.bytes_out = 0;
-        svc_.sched_.post(&op);
-        return;
+        if (ec)
+            *ec = std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                                  boost::capy::detail::cond_cat);
+        if (bytes_transferred)
+            *bytes_transferred = 0;
+        return h;
     }
 
-    // Prepare write operation at specified file offset
-    io_uring_prep_write(sqe, fd_, op.buffer_ptr, op.buffer_size, op.file_offset);
+    // Each positional operation has its own state, so any number of
+    // them can be in flight on this file at once
+    file_at_op* op = svc_.alloc_at_op();
 
-    // Set user_data to operation pointer for completion identification
-    io_uring_sqe_set_data(sqe, &op);
+    // Nothing to transfer: complete inline
+    if (set_buffers(*op, buffers) == 0)
+    {
+        svc_.free_at_op(op);
+        if (ec)
+            *ec = std::error_code();
+        if (bytes_transferred)
+            *bytes_transferred = 0;
+        return h;
+    }
 
-    // Submit to kernel
-    int ret = io_uring_submit(ring);
-    if (ret < 0)
+    op->write = write;
+    op->file_offset = static_cast<off_t>(offset);
+    op->internal = this;
+    op->internal_ptr = file_ref(this);
+    op->ec_out = ec;
+    op->bytes_out = bytes_transferred;
+    op->handler_ = h;
+    op->result_override = 0;
+    op->canceled = false;
+    op->advance = advance;
+
+    // A timed operation is a chain of two entries: the transfer and
+    // the IORING_OP_LINK_TIMEOUT that bounds it
+    op->timed = timeout.count() > 0;
+    op->sqe_count = op->timed ? 2 : 1;
+    if (op->timed)
     {
-        // Submission failed - complete with error
-        svc_.work_finished();
-        if (op.ec_out)
-            *op.ec_out = boost::corosio::detail::make_err(-ret);
-        if (op.bytes_out)
-            *op.bytes_out = 0;
-        svc_.sched_.post(&op);
-        return;
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        op->timeout.tv_sec = secs.count();
+        op->timeout.tv_nsec = (timeout - secs).count();
     }
+    at_ops_.push_back(op);
 
-    // Successfully submitted - kernel will perform async I/O
-    // Completion will be delivered via io_uring CQ and processed by poll_completions()
+    if (token.stop_possible())
+        op->stop_cb.emplace(token, file_at_op::canceller{op});
+
+    svc_.work_started();
+    svc_.start_op(*op);
+    return std::noop_coroutine();
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::write_durable_at(
+    std::coroutine_handle<> h,
+    boost::capy::executor_ref /*ex*/,
+    std::uint64_t offset,
+    boost::corosio::io_buffer_param buffers,
+    std::stop_token /*token*/,
+    std::error_code* ec,
+    std::size_t* bytes_transferred)
+{
+    // O_DIRECT transfers must be aligned in memory and in the file
+    if (!direct_ok(buffers, offset))
+        return reject(h, ec, bytes_transferred);
+
+    auto w = std::make_unique<file_commit_write>();
+    w->total_size = set_buffers(*w, buffers);
+    w->file_offset = static_cast<off_t>(offset);
+    w->ec_out = ec;
+    w->bytes_out = bytes_transferred;
+    w->handler_ = h;
+
+    // Join this turn's group unless it is as long as the ring allows.
+    // A new group seals itself once the work already posted has run,
+    // so writers resumed in the meantime share its fdatasync
+    if (!commit_group_ || commit_group_->writes.size() + 2 > svc_.max_chain())
+    {
+        auto* g = new file_commit_group(*this);
+        g->internal_ptr = file_ref(this);
+        commit_group_ = g;
+        svc_.sched_.post(&g->seal);
+    }
+
+    w->group = commit_group_;
+    commit_group_->writes.push_back(std::move(w));
+    return std::noop_coroutine();
 }
 
 void
@@ -236,18 +483,251 @@ uring_file_impl_internal::cancel() noexcept
         // Submit cancel operations for pending I/O
         file_read_op::do_cancel_impl(&rd_);
         file_write_op::do_cancel_impl(&wr_);
+
+        // Positional operations stay listed until they complete, so
+        // rotate them through a local list while cancelling each
+        boost::corosio::detail::intrusive_list<file_at_op> pending;
+        while (auto* op = at_ops_.pop_front())
+            pending.push_back(op);
+        while (auto* op = pending.pop_front())
+        {
+            at_ops_.push_back(op);
+            file_at_op::do_cancel_impl(op);
+        }
     }
 }
 
 void
 uring_file_impl_internal::close_file() noexcept
 {
-    if (fd_ != -1)
+    // An open in flight would otherwise undo this close when it lands
+    if (lifecycle_op_ && lifecycle_op_->what == file_ctl_op::kind::open)
+        lifecycle_op_->abandoned = true;
+
+    int fd = detach();
+    if (fd != -1)
+        ::close(fd);
+}
+
+void
+uring_file_impl_internal::attach(int fd, int flags) noexcept
+{
+    fd_ = fd;
+    direct_ = (flags & O_DIRECT) != 0;
+    file_index_ = svc_.register_file(fd);
+    position_ = 0;
+}
+
+int
+uring_file_impl_internal::detach() noexcept
+{
+    int fd = fd_;
+    if (fd != -1)
     {
-        ::close(fd_);
+        // Entries are only prepared until the posted flush runs, and
+        // one still naming this descriptor would otherwise be handed
+        // to the kernel after the number has gone to another file
+        svc_.drain_submissions();
+
+        // Free the table slot before the descriptor number can be reused
+        if (file_index_ != -1)
+        {
+            svc_.unregister_file(file_index_);
+            file_index_ = -1;
+        }
         fd_ = -1;
     }
     position_ = 0;
+    direct_ = false;
+    return fd;
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::open_async(
+    std::coroutine_handle<> h,
+    std::filesystem::path const& path,
+    int flags,
+    int mode,
+    std::error_code* ec)
+{
+    // The descriptor of one open or close at a time can be tracked
+    if (lifecycle_op_)
+    {
+        if (ec)
+            *ec = std::make_error_code(std::errc::operation_in_progress);
+        return h;
+    }
+
+    // Close a previous file without waiting for it
+    cancel();
+    int old_fd = detach();
+    if (old_fd != -1)
+    {
+        auto* close_op = new file_ctl_op(file_ctl_op::kind::close, *this);
+        close_op->close_fd = old_fd;
+        start_ctl(close_op, {}, nullptr, nullptr);
+    }
+
+    auto* op = new file_ctl_op(file_ctl_op::kind::open, *this);
+    op->path = path.string();
+    op->open_flags = flags;
+    op->open_mode = mode;
+    lifecycle_op_ = op;
+    return start_ctl(op, h, ec, nullptr);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::close_async(
+    std::coroutine_handle<> h,
+    std::error_code* ec)
+{
+    if (lifecycle_op_)
+    {
+        if (ec)
+            *ec = std::make_error_code(std::errc::operation_in_progress);
+        return h;
+    }
+
+    cancel();
+    int fd = detach();
+    if (fd == -1)
+    {
+        if (ec)
+            *ec = std::error_code();
+        return h;
+    }
+
+    auto* op = new file_ctl_op(file_ctl_op::kind::close, *this);
+    op->close_fd = fd;
+    lifecycle_op_ = op;
+    return start_ctl(op, h, ec, nullptr);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::control_async(
+    std::coroutine_handle<> h,
+    file_ctl_op::kind what,
+    std::uint64_t offset,
+    std::uint64_t length,
+    std::error_code* ec,
+    std::uint64_t* value)
+{
+    if (fd_ == -1)
+    {
+        if (ec)
+            *ec = std::make_error_code(std::errc::bad_file_descriptor);
+        if (value)
+            *value = 0;
+        return h;
+    }
+
+    auto* op = new file_ctl_op(what, *this);
+    op->offset = offset;
+    op->length = length;
+    return start_ctl(op, h, ec, value);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::fadvise_async(
+    std::coroutine_handle<> h,
+    int advice,
+    std::uint64_t offset,
+    std::uint64_t length,
+    std::error_code* ec)
+{
+    if (fd_ == -1)
+    {
+        if (ec)
+            *ec = std::make_error_code(std::errc::bad_file_descriptor);
+        return h;
+    }
+
+    auto* op = new file_ctl_op(file_ctl_op::kind::fadvise, *this);
+    op->offset = offset;
+    op->length = length;
+    op->advice = advice;
+    return start_ctl(op, h, ec, nullptr);
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::splice_to(
+    std::coroutine_handle<> h,
+    int sock_fd,
+    std::uint64_t offset,
+    std::uint64_t length,
+    std::stop_token token,
+    std::error_code* ec,
+    std::uint64_t* bytes_transferred)
+{
+    if (fd_ == -1 || sock_fd == -1)
+    {
+        if (ec)
+            *ec = std::make_error_code(std::errc::bad_file_descriptor);
+        if (bytes_transferred)
+            *bytes_transferred = 0;
+        return h;
+    }
+
+    // The copying path reads into an aligned buffer, but the range
+    // itself must start on a block for O_DIRECT
+    if (direct_ && !is_direct_aligned(offset))
+    {
+        if (ec)
+            *ec = std::make_error_code(std::errc::invalid_argument);
+        if (bytes_transferred)
+            *bytes_transferred = 0;
+        return h;
+    }
+
+    if (length == 0)
+    {
+        if (ec)
+            *ec = std::error_code();
+        if (bytes_transferred)
+            *bytes_transferred = 0;
+        return h;
+    }
+
+    auto op = std::make_unique<file_splice_op>(*this);
+    op->sock_fd = sock_fd;
+    op->offset = offset;
+    op->remaining = length;
+
+    // Without a pipe the transfer copies from the start
+    if (!svc_.splice_enabled() || svc_.lease_pipe(op->pipe))
+        op->use_copy();
+
+    op->internal_ptr = file_ref(this);
+    op->ec_out = ec;
+    op->bytes_out = bytes_transferred;
+    op->handler_ = h;
+
+    // A token already stopped only sets the flag, and the transfer
+    // ends after its first stage
+    auto* p = op.release();
+    if (token.stop_possible())
+        p->stop_cb.emplace(token, file_splice_op::canceller{p});
+
+    svc_.work_started();
+    svc_.start_op(*p);
+    return std::noop_coroutine();
+}
+
+std::coroutine_handle<>
+uring_file_impl_internal::start_ctl(
+    file_ctl_op* op,
+    std::coroutine_handle<> h,
+    std::error_code* ec,
+    std::uint64_t* value)
+{
+    op->internal_ptr = file_ref(this);
+    op->handler_ = h;
+    op->ec_out = ec;
+    op->value_out = value;
+
+    svc_.work_started();
+    svc_.start_op(*op);
+    return std::noop_coroutine();
 }
 
 //------------------------------------------------------------------------------
@@ -12,21 +12,121 @@
 #include <boost/capy/cond.hpp>
 
 #include <liburing.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
 
 namespace nntp::detail {
 
+namespace {
+
+// Length advised by one fadvise entry, whose length field is 32 bits
+constexpr std::uint64_t fadvise_piece = std::uint64_t(1) << 31;
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// file_ref
+
+file_ref::file_ref(uring_file_impl_internal* p) noexcept
+    : p_(p)
+{
+    if (!p_)
+        return;
+    if (p_->shared_refs_)
+        p_->refs_.fetch_add(1, std::memory_order_relaxed);
+    else
+        p_->refs_.store(p_->refs_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+file_ref::~file_ref()
+{
+    if (!p_)
+        return;
+
+    // The last reference must see every write made through the others
+    std::size_t left;
+    if (p_->shared_refs_)
+    {
+        left = p_->refs_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+    else
+    {
+        left = p_->refs_.load(std::memory_order_relaxed) - 1;
+        p_->refs_.store(left, std::memory_order_relaxed);
+    }
+    if (left == 0)
+        delete p_;
+}
+
 //------------------------------------------------------------------------------
 // Operation constructors
 
 file_read_op::file_read_op(uring_file_impl_internal& internal_) noexcept
     : boost::corosio::detail::scheduler_op(&do_complete)
+    , sqe_waiter(&do_prepare)
     , internal(internal_)
 {
 }
 
 file_write_op::file_write_op(uring_file_impl_internal& internal_) noexcept
     : boost::corosio::detail::scheduler_op(&do_complete)
+    , sqe_waiter(&do_prepare)
+    , internal(internal_)
+{
+}
+
+file_ctl_op::file_ctl_op(kind what_, uring_file_impl_internal& internal_) noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , sqe_waiter(&do_prepare)
+    , what(what_)
+    , internal(internal_)
+{
+}
+
+file_splice_op::file_splice_op(uring_file_impl_internal& internal_) noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , sqe_waiter(&do_prepare)
+    , internal(internal_)
+{
+}
+
+file_commit_write::file_commit_write() noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+{
+}
+
+file_commit_group::sync_part::sync_part(file_commit_group& g) noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , group(g)
+{
+}
+
+file_commit_group::seal_part::seal_part(file_commit_group& g) noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , group(g)
+{
+}
+
+file_commit_group::file_commit_group(uring_file_impl_internal& internal_) noexcept
+    : sqe_waiter(&do_prepare)
     , internal(internal_)
+    , sync(*this)
+    , seal(*this)
+{
+}
+
+file_at_op::file_at_op() noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , sqe_waiter(&do_prepare)
 {
 }
 
@@ -37,41 +137,277 @@ void file_read_op::do_cancel_impl(file_read_op* op) noexcept
 {
     // Cancel the I/O operation using io_uring
     // io_uring_prep_cancel submits a cancellation request
-    if (op->internal.is_open())
-    {
-        io_uring* ring = op->internal.svc_.native_handle();
-
-        // Get an SQE for the cancel operation
-        io_uring_sqe* sqe = io_uring_get_sqe(ring);
-        if (sqe)
-        {
-            // Prepare cancel operation targeting this operation
-            io_uring_prep_cancel(sqe, op, 0);
+    auto& svc = op->internal.svc_;
 
-            // Submit the cancel request
-            io_uring_submit(ring);
-        }
+    // An operation still on the overflow list never reached the kernel,
+    // so it completes here rather than through a CQE
+    if (svc.unpark(*op))
+    {
+        if (op->ec_out)
+            *op->ec_out = std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                                           boost::capy::detail::cond_cat);
+        if (op->bytes_out)
+            *op->bytes_out = 0;
+        svc.work_finished();
+        svc.sched_.post(op);
+        return;
     }
+
+    // Ask the ring the operation was started on to cancel it
+    if (op->internal.is_open())
+        svc.submit_cancel(*op, op);
 }
 
 void file_write_op::do_cancel_impl(file_write_op* op) noexcept
 {
     // Cancel the I/O operation using io_uring
+    auto& svc = op->internal.svc_;
+
+    // An operation still on the overflow list never reached the kernel,
+    // so it completes here rather than through a CQE
+    if (svc.unpark(*op))
+    {
+        if (op->ec_out)
+            *op->ec_out = std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                                           boost::capy::detail::cond_cat);
+        if (op->bytes_out)
+            *op->bytes_out = 0;
+        svc.work_finished();
+        svc.sched_.post(op);
+        return;
+    }
+
+    // Ask the ring the operation was started on to cancel it
     if (op->internal.is_open())
+        svc.submit_cancel(*op, op);
+}
+
+void file_at_op::do_cancel_impl(file_at_op* op) noexcept
+{
+    auto& svc = op->internal->svc_;
+
+    // ECANCELED from a timed operation is then not its timeout
+    op->canceled = true;
+
+    // An operation still on the overflow list never reached the kernel,
+    // so it completes here rather than through a CQE
+    if (svc.unpark(*op))
     {
-        io_uring* ring = op->internal.svc_.native_handle();
+        op->result_override = -ECANCELED;
+        svc.work_finished();
+        svc.sched_.post(op);
+        return;
+    }
 
-        // Get an SQE for the cancel operation
-        io_uring_sqe* sqe = io_uring_get_sqe(ring);
-        if (sqe)
-        {
-            // Prepare cancel operation targeting this operation
-            io_uring_prep_cancel(sqe, op, 0);
+    if (op->internal->is_open())
+        svc.submit_cancel(*op, op);
+}
 
-            // Submit the cancel request
-            io_uring_submit(ring);
-        }
+void file_splice_op::do_cancel_impl(file_splice_op* op) noexcept
+{
+    auto& svc = op->internal.svc_;
+
+    // Between stages the flag stops the next one from starting
+    op->canceled = true;
+
+    if (svc.unpark(*op))
+    {
+        op->result_override = -ECANCELED;
+        svc.work_finished();
+        svc.sched_.post(op);
+        return;
     }
+
+    // The socket may still be open after the file has closed
+    svc.submit_cancel(*op, op);
+}
+
+//------------------------------------------------------------------------------
+// Submission queue entry preparation
+
+void file_read_op::do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept
+{
+    auto* op = static_cast<file_read_op*>(self);
+
+    // Prepare read operation at specified file offset; registered
+    // buffers skip the per-operation page pinning
+    int fd = op->internal.sqe_fd();
+    if (op->buf_index >= 0)
+        io_uring_prep_read_fixed(sqe, fd, op->buffer_ptr,
+            op->buffer_size, op->file_offset, op->buf_index);
+    else if (op->iovec_count)
+        io_uring_prep_readv(sqe, fd, op->iovecs, op->iovec_count, op->file_offset);
+    else
+        io_uring_prep_read(sqe, fd, op->buffer_ptr, op->buffer_size, op->file_offset);
+    op->internal.set_sqe_flags(sqe);
+
+    // Set user_data to operation pointer for completion identification
+    io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(op));
+}
+
+void file_write_op::do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept
+{
+    auto* op = static_cast<file_write_op*>(self);
+
+    // Prepare write operation at specified file offset; registered
+    // buffers skip the per-operation page pinning
+    int fd = op->internal.sqe_fd();
+    if (op->buf_index >= 0)
+        io_uring_prep_write_fixed(sqe, fd, op->buffer_ptr,
+            op->buffer_size, op->file_offset, op->buf_index);
+    else if (op->iovec_count)
+        io_uring_prep_writev(sqe, fd, op->iovecs, op->iovec_count, op->file_offset);
+    else
+        io_uring_prep_write(sqe, fd, op->buffer_ptr, op->buffer_size, op->file_offset);
+    op->internal.set_sqe_flags(sqe);
+
+    // Set user_data to operation pointer for completion identification
+    io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(op));
+}
+
+void file_at_op::do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept
+{
+    auto* op = static_cast<file_at_op*>(self);
+
+    // The offset travels with the operation, not the file
+    int fd = op->internal->sqe_fd();
+    if (op->iovec_count && op->write)
+        io_uring_prep_writev(sqe, fd, op->iovecs, op->iovec_count, op->file_offset);
+    else if (op->iovec_count)
+        io_uring_prep_readv(sqe, fd, op->iovecs, op->iovec_count, op->file_offset);
+    else if (op->write)
+        io_uring_prep_write(sqe, fd, op->buffer_ptr, op->buffer_size, op->file_offset);
+    else
+        io_uring_prep_read(sqe, fd, op->buffer_ptr, op->buffer_size, op->file_offset);
+    op->internal->set_sqe_flags(sqe);
+    io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(op));
+
+    // The timeout follows in the entry the service reserved for it.
+    // Once it expires the kernel cancels the operation
+    if (op->timed)
+    {
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe* timeout = io_uring_get_sqe(&op->shard->ring);
+        io_uring_prep_link_timeout(timeout, &op->timeout, 0);
+        io_uring_sqe_set_data(timeout, &link_timeout_tag);
+    }
+}
+
+void file_ctl_op::do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept
+{
+    auto* op = static_cast<file_ctl_op*>(self);
+
+    // openat, close and statx take a plain descriptor; fsync,
+    // fallocate and fadvise can use the registered file table
+    switch (op->what)
+    {
+    case kind::open:
+        io_uring_prep_openat(sqe, AT_FDCWD, op->path.c_str(), op->open_flags, op->open_mode);
+        break;
+    case kind::close:
+        io_uring_prep_close(sqe, op->close_fd);
+        break;
+    case kind::fsync:
+        io_uring_prep_fsync(sqe, op->internal.sqe_fd(), 0);
+        op->internal.set_sqe_flags(sqe);
+        break;
+    case kind::fdatasync:
+        io_uring_prep_fsync(sqe, op->internal.sqe_fd(), IORING_FSYNC_DATASYNC);
+        op->internal.set_sqe_flags(sqe);
+        break;
+    case kind::fallocate:
+        io_uring_prep_fallocate(sqe, op->internal.sqe_fd(), 0, op->offset, op->length);
+        op->internal.set_sqe_flags(sqe);
+        break;
+    case kind::fadvise:
+    {
+        // The entry carries a 32-bit length; do_complete advises
+        // longer ranges a piece at a time
+        auto len = static_cast<std::uint32_t>(
+            std::min<std::uint64_t>(op->length, fadvise_piece));
+        io_uring_prep_fadvise(sqe, op->internal.sqe_fd(), op->offset, len, op->advice);
+        op->internal.set_sqe_flags(sqe);
+        break;
+    }
+    case kind::statx:
+        io_uring_prep_statx(sqe, op->internal.native_handle(), "",
+            AT_EMPTY_PATH, STATX_SIZE, &op->stx);
+        break;
+    }
+
+    io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(op));
+}
+
+void file_splice_op::do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept
+{
+    auto* op = static_cast<file_splice_op*>(self);
+
+    switch (op->step)
+    {
+    case stage::fill:
+    {
+        // A registered file is named by its slot through the splice
+        // flags; IOSQE_FIXED_FILE would apply to the pipe instead
+        auto len = static_cast<unsigned>(
+            std::min<std::uint64_t>(op->remaining, op->pipe.capacity));
+        unsigned flags = op->internal.file_index_ != -1 ? SPLICE_F_FD_IN_FIXED : 0;
+        io_uring_prep_splice(sqe, op->internal.sqe_fd(), static_cast<std::int64_t>(op->offset),
+            op->pipe.write_fd, -1, len, flags);
+        break;
+    }
+    case stage::drain:
+        io_uring_prep_splice(sqe, op->pipe.read_fd, -1, op->sock_fd, -1,
+            static_cast<unsigned>(op->pending), 0);
+        break;
+    case stage::wait:
+        io_uring_prep_poll_add(sqe, op->sock_fd, POLLOUT);
+        break;
+    case stage::read:
+    {
+        // O_DIRECT reads whole blocks; bytes past the range are dropped
+        auto len = static_cast<std::size_t>(
+            std::min<std::uint64_t>(op->remaining, op->buffer.size()));
+        if (op->internal.direct_)
+            len = static_cast<std::size_t>(
+                std::min<std::uint64_t>(direct_align_up(len), op->buffer.size()));
+        io_uring_prep_read(sqe, op->internal.sqe_fd(), op->buffer.data(),
+            static_cast<unsigned>(len), op->offset);
+        op->internal.set_sqe_flags(sqe);
+        break;
+    }
+    case stage::send:
+        io_uring_prep_send(sqe, op->sock_fd, op->buffer.data() + op->buffer_pos,
+            op->pending, MSG_NOSIGNAL);
+        break;
+    }
+
+    io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(op));
+}
+
+void file_commit_group::do_prepare(sqe_waiter* self, io_uring_sqe* sqe) noexcept
+{
+    auto* g = static_cast<file_commit_group*>(self);
+    io_uring* ring = &g->shard->ring;
+
+    // Each write links to the next entry, ending at the fdatasync.
+    // The service reserved room for the whole chain, so the ring
+    // hands out contiguous entries
+    int fd = g->internal.sqe_fd();
+    for (auto& w : g->writes)
+    {
+        if (w->iovec_count)
+            io_uring_prep_writev(sqe, fd, w->iovecs, w->iovec_count, w->file_offset);
+        else
+            io_uring_prep_write(sqe, fd, w->buffer_ptr, w->buffer_size, w->file_offset);
+        g->internal.set_sqe_flags(sqe);
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(w.get()));
+        sqe = io_uring_get_sqe(ring);
+    }
+
+    io_uring_prep_fsync(sqe, fd, IORING_FSYNC_DATASYNC);
+    g->internal.set_sqe_flags(sqe);
+    io_uring_sqe_set_data(sqe, static_cast<boost::corosio::detail::scheduler_op*>(&g->sync));
 }
 
 //------------------------------------------------------------------------------
@@ -101,7 +437,7 @@ std::uint32_t /*flags*/)
     // - Negative value: -errno error code
     auto result = static_cast<std::int32_t>(res);
 
-    // Hold shared_ptr to prevent premature destruction of internal
+    // Hold a reference to prevent premature destruction of internal
     auto prevent_premature_destruction = std::move(op->internal_ptr);
 
     // Process result
@@ -181,7 +517,7 @@ std::uint32_t /*flags*/)
     // - Negative value: -errno
     auto result = static_cast<std::int32_t>(res);
 
-    // Hold shared_ptr to prevent premature destruction of internal
+    // Hold a reference to prevent premature destruction of internal
     auto prevent_premature_destruction = std::move(op->internal_ptr);
 
     // Process result
@@ -225,6 +561,425 @@ std::uint32_t /*flags*/)
     op->invoke_handler();
 }
 
+//------------------------------------------------------------------------------
+// file_at_op completion handler
+
+void
+file_at_op::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t res,
+std::uint32_t /*flags*/)
+{
+    auto* op = static_cast<file_at_op*>(base);
+    auto& internal = *op->internal;
+    auto& svc = internal.svc_;
+
+    op->stop_cb.reset();
+    internal.at_ops_.remove(op);
+
+    // Hold a reference to prevent premature destruction of internal
+    auto prevent_premature_destruction = std::move(op->internal_ptr);
+
+    // Destroy path - called when the io_context is shutting down
+    if (!owner)
+    {
+        svc.free_at_op(op);
+        return;
+    }
+
+    auto result = op->result_override != 0
+        ? op->result_override
+        : static_cast<std::int32_t>(res);
+
+    std::error_code ec;
+    std::size_t bytes = 0;
+    if (result > 0)
+    {
+        bytes = static_cast<std::size_t>(result);
+        if (op->advance)
+            internal.position_ += bytes;
+    }
+    else if (result == 0)
+    {
+        // A read of a non-empty buffer that returns nothing is at EOF
+        if (!op->write)
+            ec = std::error_code(static_cast<int>(boost::capy::cond::eof),
+                                 boost::capy::detail::cond_cat);
+    }
+    else if (op->timed && !op->canceled && (-result == ECANCELED || -result == EINTR))
+    {
+        // The linked timeout expired: a queued operation is canceled,
+        // one the kernel had already started is interrupted
+        ec = std::make_error_code(std::errc::timed_out);
+    }
+    else if (-result == ECANCELED)
+    {
+        ec = std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                             boost::capy::detail::cond_cat);
+    }
+    else
+    {
+        ec = boost::corosio::detail::make_err(-result);
+    }
+
+    if (op->ec_out)
+        *op->ec_out = ec;
+    if (op->bytes_out)
+        *op->bytes_out = bytes;
+
+    // Recycle before resuming so the coroutine can reuse the operation
+    auto h = op->handler_;
+    svc.free_at_op(op);
+    h.resume();
+}
+
+//------------------------------------------------------------------------------
+// file_ctl_op completion handler
+
+void
+file_ctl_op::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t res,
+std::uint32_t /*flags*/)
+{
+    // Freed on every path, including shutdown
+    std::unique_ptr<file_ctl_op> op(static_cast<file_ctl_op*>(base));
+
+    // Hold a reference to prevent premature destruction of internal
+    auto prevent_premature_destruction = std::move(op->internal_ptr);
+
+    auto result = static_cast<std::int32_t>(res);
+
+    if (op->internal.lifecycle_op_ == op.get())
+        op->internal.lifecycle_op_ = nullptr;
+
+    // Destroy path - called when the io_context is shutting down
+    if (!owner)
+    {
+        // A descriptor opened after shutdown began has no owner
+        if (op->what == kind::open && result >= 0)
+            ::close(result);
+        return;
+    }
+
+    // Advice for a range too long for one entry continues with the rest
+    if (op->what == kind::fadvise && result >= 0 && op->length > fadvise_piece)
+    {
+        op->offset += fadvise_piece;
+        op->length -= fadvise_piece;
+        op->internal_ptr = std::move(prevent_premature_destruction);
+        auto& svc = op->internal.svc_;
+        svc.work_started();
+        svc.start_op(*op.release());
+        return;
+    }
+
+    std::error_code ec;
+    std::uint64_t value = 0;
+    if (result < 0)
+    {
+        ec = boost::corosio::detail::make_err(-result);
+    }
+    else if (op->what == kind::open && op->abandoned)
+    {
+        // The file was closed or reopened while this open ran
+        ::close(result);
+        ec = std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                             boost::capy::detail::cond_cat);
+    }
+    else if (op->what == kind::open)
+    {
+        op->internal.attach(result, op->open_flags);
+    }
+    else if (op->what == kind::statx)
+    {
+        value = op->stx.stx_size;
+    }
+
+    if (op->ec_out)
+        *op->ec_out = ec;
+    if (op->value_out)
+        *op->value_out = value;
+
+    // A close issued on behalf of a reopen has no one waiting
+    auto h = op->handler_;
+    op.reset();
+    if (h)
+        h.resume();
+}
+
+//------------------------------------------------------------------------------
+// file_splice_op completion handler
+
+void
+file_splice_op::use_copy()
+{
+    buffer.resize(static_cast<std::size_t>(
+        std::min<std::uint64_t>(direct_align_up(remaining), splice_copy_size)));
+    buffer_pos = 0;
+    step = stage::read;
+}
+
+void
+file_splice_op::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t res,
+std::uint32_t /*flags*/)
+{
+    auto* op = static_cast<file_splice_op*>(base);
+    auto& svc = op->internal.svc_;
+
+    auto result = op->result_override != 0
+        ? op->result_override
+        : static_cast<std::int32_t>(res);
+    op->result_override = 0;
+
+    // Destroy path - called when the io_context is shutting down
+    if (!owner)
+    {
+        file_ref prevent_premature_destruction = std::move(op->internal_ptr);
+        uring_file_service::close_pipe(op->pipe);
+        delete op;
+        return;
+    }
+
+    int error = 0;
+    bool done = false;
+    if (result < 0)
+    {
+        error = -result;
+
+        // Nothing has moved yet, so the whole range can still be copied
+        bool unsupported = error == EINVAL || error == EOPNOTSUPP || error == ENOSYS;
+        if (op->step == stage::fill && unsupported && op->transferred == 0)
+        {
+            uring_file_service::close_pipe(op->pipe);
+            op->pipe = splice_pipe();
+            {
+                std::lock_guard<std::mutex> lock(svc.mutex_);
+                ++svc.stats_.splice_fallbacks;
+            }
+            try
+            {
+                op->use_copy();
+                error = 0;
+            }
+            catch (std::bad_alloc const&)
+            {
+                error = ENOMEM;
+            }
+        }
+        else if (op->step == stage::drain && error == EAGAIN)
+        {
+            op->step = stage::wait;
+            error = 0;
+        }
+        done = error != 0;
+    }
+    else
+    {
+        auto n = static_cast<std::size_t>(result);
+        switch (op->step)
+        {
+        case stage::fill:
+        case stage::read:
+            if (n == 0)
+            {
+                // The range runs past the end of the file
+                done = true;
+                break;
+            }
+            n = static_cast<std::size_t>(std::min<std::uint64_t>(n, op->remaining));
+            op->pending = n;
+            op->offset += n;
+            op->remaining -= n;
+            op->buffer_pos = 0;
+            op->step = op->step == stage::fill ? stage::drain : stage::send;
+            break;
+        case stage::drain:
+        case stage::send:
+            if (n == 0)
+            {
+                error = EPIPE;
+                done = true;
+                break;
+            }
+            op->pending -= n;
+            op->transferred += n;
+            op->buffer_pos += n;
+            if (op->pending == 0)
+            {
+                if (op->remaining == 0)
+                    done = true;
+                else
+                    op->step = op->step == stage::drain ? stage::fill : stage::read;
+            }
+            break;
+        case stage::wait:
+            op->step = stage::drain;
+            break;
+        }
+    }
+
+    if (!done && op->canceled)
+    {
+        error = ECANCELED;
+        done = true;
+    }
+
+    if (!done)
+    {
+        svc.work_started();
+        svc.start_op(*op);
+        return;
+    }
+
+    op->stop_cb.reset();
+
+    // Hold a reference to prevent premature destruction of internal
+    auto prevent_premature_destruction = std::move(op->internal_ptr);
+
+    std::error_code ec;
+    if (error == ECANCELED)
+        ec = std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                             boost::capy::detail::cond_cat);
+    else if (error != 0)
+        ec = boost::corosio::detail::make_err(error);
+    else if (op->remaining != 0)
+        ec = std::error_code(static_cast<int>(boost::capy::cond::eof),
+                             boost::capy::detail::cond_cat);
+
+    if (op->ec_out)
+        *op->ec_out = ec;
+    if (op->bytes_out)
+        *op->bytes_out = op->transferred;
+
+    // A pipe still holding bytes cannot be handed to another transfer
+    if (op->pending == 0)
+        svc.release_pipe(op->pipe);
+    else
+        uring_file_service::close_pipe(op->pipe);
+
+    auto h = op->handler_;
+    delete op;
+    h.resume();
+}
+
+//------------------------------------------------------------------------------
+// file_commit_group completion handlers
+
+void
+file_commit_group::seal_part::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t /*res*/,
+std::uint32_t /*flags*/)
+{
+    auto& g = static_cast<seal_part*>(base)->group;
+    auto& internal = g.internal;
+
+    // Later writers start a new group
+    if (internal.commit_group_ == &g)
+        internal.commit_group_ = nullptr;
+
+    // Destroy path - the group was never submitted
+    if (!owner)
+    {
+        delete &g;
+        return;
+    }
+
+    auto& svc = internal.svc_;
+    g.sqe_count = static_cast<unsigned>(g.writes.size() + 1);
+    g.pending = g.sqe_count;
+    for (unsigned i = 0; i < g.sqe_count; ++i)
+        svc.work_started();
+    svc.start_op(g);
+}
+
+void
+file_commit_write::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t res,
+std::uint32_t /*flags*/)
+{
+    auto* w = static_cast<file_commit_write*>(base);
+    w->result = static_cast<std::int32_t>(res);
+    file_commit_group::part_done(w->group, owner != nullptr);
+}
+
+void
+file_commit_group::sync_part::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t res,
+std::uint32_t /*flags*/)
+{
+    auto& g = static_cast<sync_part*>(base)->group;
+    g.sync_result = static_cast<std::int32_t>(res);
+    file_commit_group::part_done(&g, owner != nullptr);
+}
+
+void
+file_commit_group::part_done(file_commit_group* g, bool resume) noexcept
+{
+    if (--g->pending != 0)
+        return;
+
+    std::unique_ptr<file_commit_group> group(g);
+
+    // Hold a reference to prevent premature destruction of internal
+    auto prevent_premature_destruction = std::move(g->internal_ptr);
+
+    // Destroy path - called when the io_context is shutting down
+    if (!resume)
+        return;
+
+    auto to_error = [](std::int32_t result)
+    {
+        // ECANCELED means an earlier link in the chain failed
+        if (-result == ECANCELED)
+            return std::error_code(static_cast<int>(boost::capy::cond::canceled),
+                                   boost::capy::detail::cond_cat);
+        return boost::corosio::detail::make_err(-result);
+    };
+
+    for (auto& w : g->writes)
+    {
+        std::error_code ec;
+        std::size_t bytes = 0;
+        if (w->result < 0)
+        {
+            ec = to_error(w->result);
+        }
+        else
+        {
+            bytes = static_cast<std::size_t>(w->result);
+
+            // A short write broke the chain; the rest was not synced
+            if (bytes < w->total_size)
+                ec = std::make_error_code(std::errc::io_error);
+            else if (g->sync_result < 0)
+                ec = to_error(g->sync_result);
+        }
+
+        if (w->ec_out)
+            *w->ec_out = ec;
+        if (w->bytes_out)
+            *w->bytes_out = bytes;
+    }
+
+    // Free the group before resuming, since a writer may start the next
+    auto writes = std::move(g->writes);
+    group.reset();
+    for (auto& w : writes)
+        w->handler_.resume();
+}
+
 } // namespace nntp::detail
 
 #endif // BOOST_COROSIO_HAS_EPOLL
@@ -9,69 +9,377 @@
 #include "src/detail/epoll/scheduler.hpp"
 #include "src/detail/make_err.hpp"
 
+#include <algorithm>
+#include <new>
+
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 
 namespace nntp::detail
 {
 
-uring_file_service::uring_file_service(boost::capy::execution_context& ctx)
+namespace {
+
+// Services are told apart by id rather than address, so a cache
+// entry left by a destroyed service never matches a new one
+std::atomic<std::uint64_t> next_service_id{1};
+
+struct shard_cache
+{
+    std::uint64_t service_id = 0;
+    ring_shard* shard = nullptr;
+};
+
+thread_local shard_cache local_cache;
+
+// Completion queue entries taken off the ring per peek
+constexpr unsigned harvest_batch = 64;
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// ring_shard
+
+ring_shard::ring_shard(uring_file_service& svc_) noexcept
+    : svc(svc_)
+    , ring{}
+    , flush(*this)
+{
+}
+
+ring_shard::flush_op::flush_op(ring_shard& shard_) noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , shard(shard_)
+{
+}
+
+void
+ring_shard::flush_op::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t /*res*/,
+std::uint32_t /*flags*/)
+{
+    auto& shard = static_cast<flush_op*>(base)->shard;
+    auto& svc = shard.svc;
+    ring_shard::completion_batch* batch = nullptr;
+    bool inline_completion = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.flush_pending = false;
+
+        // Destroy path - nothing to submit into a ring that is going away
+        if (!owner)
+            return;
+
+        svc.submit(shard);
+        if (!svc.opts_.ring_per_thread)
+            return;
+
+        // The fallback harvest skipped this ring because this flush
+        // was queued, so whatever completed meanwhile is taken here
+        batch = svc.harvest(shard);
+        if (svc.unsubmitted(shard) > 0)
+            svc.submit(shard);
+
+        inline_completion = batch && shard.owner == std::this_thread::get_id();
+        if (inline_completion)
+            shard.stats.owner_completions += batch->ready.size();
+    }
+
+    if (inline_completion)
+        ring_shard::completion_batch::do_complete(owner, batch, 0, 0);
+    else if (batch)
+        svc.sched_.post(batch);
+}
+
+ring_shard::completion_batch::completion_batch(ring_shard& shard_) noexcept
+    : boost::corosio::detail::scheduler_op(&do_complete)
+    , shard(shard_)
+{
+}
+
+void
+ring_shard::completion_batch::do_complete(
+void* owner,
+boost::corosio::detail::scheduler_op* base,
+std::uint32_t /*res*/,
+std::uint32_t /*flags*/)
+{
+    auto* batch = static_cast<completion_batch*>(base);
+    auto& shard = batch->shard;
+
+    for (auto& c : batch->ready)
+    {
+        // Destroy path - the operations are destroyed with the batch
+        if (!owner)
+        {
+            c.op->destroy();
+            continue;
+        }
+
+        // The operation's work was counted when it started and ends
+        // here rather than in a scheduler turn of its own
+        c.op->complete(owner, static_cast<std::uint32_t>(c.res), c.flags);
+        shard.svc.work_finished();
+    }
+    batch->ready.clear();
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Capacity was reserved for every batch, so this cannot throw
+    shard.free_batches.push_back(batch);
+}
+
+//------------------------------------------------------------------------------
+// uring_file_service
+
+uring_file_service::uring_file_service(
+    boost::capy::execution_context& ctx,
+    file_service_options const& opts)
     : sched_(ctx.use_service<boost::corosio::detail::epoll_scheduler>())
+    , opts_(opts)
+    , id_(next_service_id.fetch_add(1, std::memory_order_relaxed))
 {
+    // The first shard always exists; with a ring per thread it serves
+    // the constructing thread, and any thread whose own ring fails
+    auto shard = std::make_unique<ring_shard>(*this);
+    shard->owner = std::this_thread::get_id();
+
     // Initialize io_uring instance
-    auto ec = init_uring();
+    auto ec = init_uring(*shard, opts);
     if (ec)
     {
         // If io_uring initialization fails, we can't proceed
         throw std::system_error(ec, "Failed to initialize io_uring");
     }
+
+    shards_ = shard.release();
+    max_chain_ = std::min<std::size_t>(
+        shards_->ring.sq.ring_entries, shards_->max_in_flight);
+
+    if (opts.fixed_buffer_count != 0)
+    {
+        ec = init_buffers(opts.fixed_buffer_count, opts.fixed_buffer_size);
+        if (ec)
+        {
+            shutdown_rings();
+            delete shards_;
+            throw std::system_error(ec, "Failed to register io_uring buffers");
+        }
+    }
+
+    // Without a file table every file simply uses its plain descriptor.
+    // Table slots belong to one ring, so sharded rings go without.
+    if (opts.registered_files != 0 && !opts.ring_per_thread)
+        init_files(opts.registered_files);
 }
 
 uring_file_service::~uring_file_service()
 {
-    shutdown_uring();
+    shutdown_rings();
+
+    for (auto* shard = shards_; shard != nullptr;)
+    {
+        auto* next = shard->next.load(std::memory_order_relaxed);
+        delete shard;
+        shard = next;
+    }
 }
 
 void
 uring_file_service::shutdown()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-
     // Close all files and remove from list
-    // The shared_ptrs held by file objects and operations will handle destruction
-    for (auto* impl = file_list_.pop_front(); impl != nullptr;
-         impl = file_list_.pop_front())
+    // The file_refs held by file objects and operations will handle destruction
+    for (;;)
     {
+        uring_file_impl_internal* impl;
+        {
+            // Not held while closing, which frees the file's table slot
+            std::lock_guard<std::mutex> lock(mutex_);
+            impl = file_list_.pop_front();
+        }
+        if (!impl)
+            break;
         impl->close_file();
-        // Note: impl may still be alive if operations hold shared_ptr
+        // Note: impl may still be alive if operations hold a file_ref
     }
 
-    // Cleanup wrappers
-    for (auto* w = wrapper_list_.pop_front(); w != nullptr;
-         w = wrapper_list_.pop_front())
+    // Operations still waiting for a ring will never be submitted
+    for (auto* shard = shards_; shard != nullptr;
+         shard = shard->next.load(std::memory_order_acquire))
     {
+        std::lock_guard<std::mutex> shard_lock(shard->mutex);
+        for (auto* op = shard->parked.pop_front(); op != nullptr;
+             op = shard->parked.pop_front())
+        {
+            op->parked = false;
+        }
+        if (shard->stalled)
+        {
+            shard->stalled->parked = false;
+            shard->stalled = nullptr;
+        }
+    }
+
+    // Cleanup wrappers, outside the lock since the last reference to
+    // an implementation unregisters it
+    for (;;)
+    {
+        uring_file_impl* w;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            w = wrapper_list_.pop_front();
+        }
+        if (!w)
+            break;
         delete w;
     }
 
     // Shutdown io_uring
-    shutdown_uring();
+    shutdown_rings();
+}
+
+std::error_code
+uring_file_service::init_files(unsigned count)
+{
+    // A table of -1 entries is sparse: slots are filled as files open
+    std::vector<int> fds(count, -1);
+    int ret = io_uring_register_files(&shards_->ring, fds.data(), count);
+    if (ret < 0)
+        return boost::corosio::detail::make_err(-ret);
+
+    files_registered_ = true;
+
+    // Use low slots first
+    free_files_.reserve(count);
+    for (unsigned i = count; i != 0; --i)
+        free_files_.push_back(static_cast<int>(i - 1));
+
+    return {};
+}
+
+std::error_code
+uring_file_service::init_buffers(unsigned count, std::size_t size)
+{
+    if (size == 0)
+        return boost::corosio::detail::make_err(EINVAL);
+
+    // One anonymous mapping with each buffer starting on a page
+    // boundary; a size that is not a page multiple leaves a gap
+    std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t stride = (size + page - 1) / page * page;
+    std::size_t bytes = static_cast<std::size_t>(count) * stride;
+    void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return boost::corosio::detail::make_err(errno);
+
+    buffer_base_ = base;
+    buffer_size_ = size;
+    buffer_stride_ = stride;
+    buffer_bytes_ = bytes;
+
+    auto ec = register_buffers(*shards_);
+    if (ec)
+    {
+        ::munmap(base, bytes);
+        buffer_base_ = nullptr;
+        return ec;
+    }
+
+    // Lease low indices first
+    free_buffers_.reserve(count);
+    for (unsigned i = count; i != 0; --i)
+        free_buffers_.push_back(static_cast<int>(i - 1));
+
+    return {};
 }
 
 std::error_code
-uring_file_service::init_uring()
+uring_file_service::register_buffers(ring_shard& shard)
 {
-    // Initialize io_uring with 64 entry queue
-    int ret = io_uring_queue_init(64, &ring_, 0);
+    // Every ring registers the same memory in the same order, so a
+    // buffer index means the same thing whichever ring an operation uses
+    unsigned count = static_cast<unsigned>(buffer_bytes_ / buffer_stride_);
+    std::vector<iovec> iovs(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        iovs[i].iov_base = static_cast<char*>(buffer_base_) + i * buffer_stride_;
+        iovs[i].iov_len = buffer_size_;
+    }
+
+    int ret = io_uring_register_buffers(&shard.ring, iovs.data(), count);
+    if (ret < 0)
+        return boost::corosio::detail::make_err(-ret);
+    return {};
+}
+
+std::error_code
+uring_file_service::init_uring(ring_shard& shard, file_service_options const& opts)
+{
+    io_uring_params params{};
+    if (opts.sqpoll)
+    {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = opts.sqpoll_idle_ms;
+        if (opts.sqpoll_cpu >= 0)
+        {
+            params.flags |= IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = static_cast<unsigned>(opts.sqpoll_cpu);
+        }
+    }
+
+    int ret = io_uring_queue_init_params(opts.queue_depth, &shard.ring, &params);
+    if (ret < 0 && opts.sqpoll)
+    {
+        // SQPOLL is an optimization; run without it if not permitted
+        params = io_uring_params{};
+        ret = io_uring_queue_init_params(opts.queue_depth, &shard.ring, &params);
+    }
+    else if (ret == 0 && (params.flags & IORING_SETUP_SQPOLL) != 0 &&
+        (params.features & IORING_FEAT_SQPOLL_NONFIXED) == 0)
+    {
+        // Before 5.11 an SQPOLL ring only accepts registered files,
+        // and every operation on a plain descriptor fails with EBADF
+        io_uring_queue_exit(&shard.ring);
+        params = io_uring_params{};
+        ret = io_uring_queue_init_params(opts.queue_depth, &shard.ring, &params);
+    }
     if (ret < 0)
     {
         return boost::corosio::detail::make_err(-ret);
     }
 
-    uring_initialized_ = true;
+    shard.sqpoll = (params.flags & IORING_SETUP_SQPOLL) != 0;
+    shard.stats.sqpoll = shard.sqpoll;
+
+    // Keep operations in flight within what the CQ can hold, so bursts
+    // queue here rather than in the kernel's overflow list. Without
+    // NODROP, completions that do not fit are lost and strand their
+    // operations, so only fill half the CQ and leave the rest for
+    // cancellation completions.
+    shard.nodrop = (shard.ring.features & IORING_FEAT_NODROP) != 0;
+    shard.max_in_flight = shard.nodrop
+        ? shard.ring.cq.ring_entries : shard.ring.sq.ring_entries;
+
+    // Rings created after the buffer pool need it registered too
+    if (buffer_base_)
+    {
+        auto ec = register_buffers(shard);
+        if (ec)
+        {
+            io_uring_queue_exit(&shard.ring);
+            return ec;
+        }
+    }
 
     // Get ring fd for epoll integration
-    ring_fd_ = ring_.ring_fd;
+    shard.ring_fd = shard.ring.ring_fd;
 
     // Register with epoll to get notification when CQ has entries
     epoll_event ev;
@@ -79,76 +387,617 @@ uring_file_service::init_uring()
     ev.data.ptr = this;
 
     int epoll_fd = sched_.epoll_fd();
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring_fd_, &ev) == -1)
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shard.ring_fd, &ev) == -1)
     {
         int err = errno;
-        io_uring_queue_exit(&ring_);
-        uring_initialized_ = false;
+        io_uring_queue_exit(&shard.ring);
+        shard.ring_fd = -1;
         return boost::corosio::detail::make_err(err);
     }
 
+    shard.initialized = true;
     return {};
 }
 
 void
-uring_file_service::shutdown_uring()
+uring_file_service::shutdown_uring(ring_shard& shard) noexcept
 {
-    if (uring_initialized_)
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!shard.initialized)
+        return;
+
+    // Release the registered file table, which only the first ring has
+    if (files_registered_ && &shard == shards_)
+        io_uring_unregister_files(&shard.ring);
+
+    // Release the registered buffer pool
+    if (buffer_base_)
+        io_uring_unregister_buffers(&shard.ring);
+
+    // Unregister from epoll
+    if (shard.ring_fd != -1)
     {
-        // Unregister from epoll
-        if (ring_fd_ != -1)
+        int epoll_fd = sched_.epoll_fd();
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, shard.ring_fd, nullptr);
+        shard.ring_fd = -1;
+    }
+
+    // Exit io_uring
+    io_uring_queue_exit(&shard.ring);
+    shard.initialized = false;
+}
+
+void
+uring_file_service::shutdown_rings() noexcept
+{
+    for (auto* shard = shards_; shard != nullptr;
+         shard = shard->next.load(std::memory_order_acquire))
+    {
+        shutdown_uring(*shard);
+    }
+
+    files_registered_ = false;
+    free_files_.clear();
+
+    for (auto const& p : free_pipes_)
+        close_pipe(p);
+    free_pipes_.clear();
+    pipe_count_ = 0;
+
+    if (buffer_base_)
+    {
+        ::munmap(buffer_base_, buffer_bytes_);
+        buffer_base_ = nullptr;
+        free_buffers_.clear();
+    }
+}
+
+ring_shard&
+uring_file_service::local_shard() noexcept
+{
+    if (!opts_.ring_per_thread)
+        return *shards_;
+
+    if (local_cache.service_id == id_)
+        return *local_cache.shard;
+
+    auto self = std::this_thread::get_id();
+    ring_shard* found = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto* shard = shards_; shard != nullptr;
+             shard = shard->next.load(std::memory_order_relaxed))
         {
-            int epoll_fd = sched_.epoll_fd();
-            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ring_fd_, nullptr);
-            ring_fd_ = -1;
+            if (shard->owner == self)
+            {
+                found = shard;
+                break;
+            }
         }
 
-        // Exit io_uring
-        io_uring_queue_exit(&ring_);
-        uring_initialized_ = false;
+        if (!found)
+        {
+            // A thread whose ring cannot be created shares the first one
+            found = shards_;
+            try
+            {
+                auto shard = std::make_unique<ring_shard>(*this);
+                shard->owner = self;
+                if (!init_uring(*shard, opts_))
+                {
+                    // Publish fully built; completion harvesting walks
+                    // the list without the service mutex
+                    shard->next.store(
+                        shards_->next.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+                    shards_->next.store(shard.get(), std::memory_order_release);
+                    found = shard.release();
+                }
+            }
+            catch (std::bad_alloc const&)
+            {
+            }
+        }
     }
+
+    local_cache.service_id = id_;
+    local_cache.shard = found;
+    return *found;
+}
+
+bool
+uring_file_service::try_prepare(ring_shard& shard, sqe_waiter& op) noexcept
+{
+    if (shard.in_flight + op.sqe_count > shard.max_in_flight)
+        return false;
+
+    // A linked chain must not be split by a full submission queue
+    if (io_uring_sq_space_left(&shard.ring) < op.sqe_count)
+    {
+        submit(shard);
+        if (io_uring_sq_space_left(&shard.ring) < op.sqe_count)
+            return false;
+    }
+
+    op.prepare(&op, io_uring_get_sqe(&shard.ring));
+    shard.in_flight += op.sqe_count;
+    return true;
 }
 
 void
-uring_file_service::poll_completions()
+uring_file_service::start_op(sqe_waiter& op) noexcept
+{
+    ring_shard& shard = local_shard();
+    op.shard = &shard;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Parked operations go first to preserve submission order
+    if (shard.parked.empty() && !shard.stalled && try_prepare(shard, op))
+    {
+        defer_submit(shard);
+        return;
+    }
+
+    op.parked = true;
+    shard.parked.push_back(&op);
+    ++shard.stats.parked;
+}
+
+bool
+uring_file_service::unpark(sqe_waiter& op) noexcept
+{
+    ring_shard* shard = op.shard;
+    if (!shard)
+        return false;
+
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if (!op.parked)
+        return false;
+
+    op.parked = false;
+    if (&op == shard->stalled)
+        shard->stalled = nullptr;
+    else
+        shard->parked.remove(&op);
+    return true;
+}
+
+void
+uring_file_service::submit_cancel(
+    sqe_waiter& op,
+    boost::corosio::detail::scheduler_op* target) noexcept
 {
-    if (!uring_initialized_)
+    ring_shard* shard = op.shard;
+    if (!shard)
         return;
 
-    io_uring_cqe* cqe;
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if (!shard->initialized)
+        return;
 
-    // Process all available completions
-    while (io_uring_peek_cqe(&ring_, &cqe) == 0)
+    io_uring_sqe* sqe = io_uring_get_sqe(&shard->ring);
+    if (!sqe)
     {
-        // Extract operation from user_data
-        auto* op = static_cast<boost::corosio::detail::scheduler_op*>(
-            io_uring_cqe_get_data(cqe));
+        // Submission queue is full: hand the batch to the kernel now
+        submit(*shard);
+        sqe = io_uring_get_sqe(&shard->ring);
+        if (!sqe)
+            return;
+    }
+
+    io_uring_prep_cancel(sqe, target, 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+    submit(*shard);
+}
 
-        if (op)
+void
+uring_file_service::start_parked(ring_shard& shard) noexcept
+{
+    while (shard.stalled || !shard.parked.empty())
+    {
+        sqe_waiter* op = shard.stalled ? shard.stalled : shard.parked.pop_front();
+        shard.stalled = nullptr;
+
+        // An operation that does not fit keeps its place at the head
+        if (!try_prepare(shard, *op))
         {
-            // Store result in operation (will be processed by do_complete)
-            // The result is stored in cqe->res (bytes transferred or -errno)
-            // We'll pass it to the scheduler via post
+            shard.stalled = op;
+            break;
+        }
+        op->parked = false;
+    }
+}
 
-            // Mark CQE as seen
-            io_uring_cqe_seen(&ring_, cqe);
+int
+uring_file_service::lease_buffer() noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_buffers_.empty())
+        return -1;
+
+    int index = free_buffers_.back();
+    free_buffers_.pop_back();
+    return index;
+}
+
+void
+uring_file_service::release_buffer(int index) noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex_);
 
-            // Post to scheduler for completion
-            // The scheduler will call the operation's completion handler
-            sched_.post(op);
+    // Capacity was reserved for every buffer, so this cannot throw
+    free_buffers_.push_back(index);
+}
+
+std::error_code
+uring_file_service::lease_pipe(splice_pipe& p)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_pipes_.empty())
+        {
+            p = free_pipes_.back();
+            free_pipes_.pop_back();
+            return {};
         }
-        else
+    }
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) == -1)
+        return boost::corosio::detail::make_err(errno);
+
+    // Larger pipes move a whole article per splice. The size is only
+    // a request: past the limit the default stays
+    ::fcntl(fds[1], F_SETPIPE_SZ, static_cast<int>(splice_pipe_size));
+    int size = ::fcntl(fds[1], F_GETPIPE_SZ);
+
+    p.read_fd = fds[0];
+    p.write_fd = fds[1];
+    p.capacity = size > 0 ? static_cast<std::size_t>(size) : 65536;
+
+    // Room for every pipe the pool has made, so release_pipe cannot throw
+    try
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_pipes_.reserve(pipe_count_ + 1);
+        ++pipe_count_;
+    }
+    catch (std::bad_alloc const&)
+    {
+        close_pipe(p);
+        p = splice_pipe();
+        return std::make_error_code(std::errc::not_enough_memory);
+    }
+    return {};
+}
+
+void
+uring_file_service::release_pipe(splice_pipe const& p) noexcept
+{
+    if (p.read_fd == -1)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_pipes_.push_back(p);
+}
+
+void
+uring_file_service::close_pipe(splice_pipe const& p) noexcept
+{
+    if (p.read_fd != -1)
+        ::close(p.read_fd);
+    if (p.write_fd != -1)
+        ::close(p.write_fd);
+}
+
+file_at_op*
+uring_file_service::alloc_at_op()
+{
+    ring_shard& shard = local_shard();
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.free_at_ops.empty())
         {
-            // No operation associated, just mark as seen
-            io_uring_cqe_seen(&ring_, cqe);
+            auto* op = shard.free_at_ops.back();
+            shard.free_at_ops.pop_back();
+            return op;
         }
     }
+
+    file_at_op* op;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        at_ops_.push_back(std::make_unique<file_at_op>());
+        op = at_ops_.back().get();
+    }
+
+    // The operation returns to this shard's pool when it is freed
+    op->shard = &shard;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Room for every operation the shard owns, so free_at_op cannot throw
+    shard.free_at_ops.reserve(++shard.at_op_count);
+    return op;
+}
+
+void
+uring_file_service::free_at_op(file_at_op* op) noexcept
+{
+    op->internal = nullptr;
+    op->handler_ = {};
+
+    ring_shard& shard = *op->shard;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.free_at_ops.push_back(op);
+}
+
+int
+uring_file_service::register_file(int fd) noexcept
+{
+    if (!files_registered_)
+        return -1;
+
+    int index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_files_.empty())
+        {
+            ++stats_.unregistered_opens;
+            return -1;
+        }
+        index = free_files_.back();
+        free_files_.pop_back();
+    }
+
+    if (io_uring_register_files_update(
+            &shards_->ring, static_cast<unsigned>(index), &fd, 1) < 0)
+    {
+        unregister_file(index);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.registered_opens;
+    return index;
+}
+
+void
+uring_file_service::unregister_file(int index) noexcept
+{
+    // Free slots are reused last in, first out, so an entry still
+    // waiting to be submitted with IOSQE_FIXED_FILE would reach the
+    // next file opened. Submitted entries hold the file they named.
+    {
+        std::lock_guard<std::mutex> lock(shards_->mutex);
+        drain(*shards_);
+    }
+
+    // Clear the slot so the table does not keep the file open
+    int none = -1;
+    io_uring_register_files_update(
+        &shards_->ring, static_cast<unsigned>(index), &none, 1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Capacity was reserved for every slot, so this cannot throw
+    free_files_.push_back(index);
+}
+
+void
+uring_file_service::defer_submit(ring_shard& shard) noexcept
+{
+    if (shard.flush_pending)
+        return;
+
+    shard.flush_pending = true;
+    sched_.post(&shard.flush);
+}
+
+unsigned
+uring_file_service::unsubmitted(ring_shard& shard) const noexcept
+{
+    // With SQPOLL, io_uring_sq_ready also counts published entries
+    // the kernel thread has yet to consume
+    if (shard.sqpoll)
+        return shard.ring.sq.sqe_tail - shard.ring.sq.sqe_head;
+    return io_uring_sq_ready(&shard.ring);
+}
+
+int
+uring_file_service::submit(ring_shard& shard) noexcept
+{
+    if (unsubmitted(shard) == 0)
+        return 0;
+
+    // io_uring_submit only enters the kernel under SQPOLL when the
+    // thread has gone to sleep and needs waking
+    bool enters = !shard.sqpoll ||
+        (IO_URING_READ_ONCE(*shard.ring.sq.kflags) & IORING_SQ_NEED_WAKEUP) != 0;
+
+    int ret = io_uring_submit(&shard.ring);
+    if (enters)
+        ++shard.stats.submit_calls;
+    if (enters && shard.sqpoll)
+        ++shard.stats.sqpoll_wakeups;
+    if (ret > 0)
+        shard.stats.submitted += static_cast<std::uint64_t>(ret);
+
+    // On failure (typically EAGAIN or EBUSY) the entries stay queued;
+    // poll_completions retries once completions have freed resources.
+    return ret;
+}
+
+void
+uring_file_service::drain(ring_shard& shard) noexcept
+{
+    if (!shard.initialized)
+        return;
+
+    while (unsubmitted(shard) > 0)
+    {
+        if (submit(shard) < 0 && !shard.sqpoll)
+            break;
+
+        // An SQPOLL thread takes published entries in its own time
+        if (unsubmitted(shard) > 0)
+            std::this_thread::yield();
+    }
+}
+
+void
+uring_file_service::drain_submissions() noexcept
+{
+    // A file's operations may sit in any thread's ring
+    for (auto* shard = shards_; shard != nullptr;
+         shard = shard->next.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        drain(*shard);
+    }
+}
+
+void
+uring_file_service::poll_completions()
+{
+    // Every ring shares the readiness notification, so each is checked
+    for (auto* shard = shards_; shard != nullptr;
+         shard = shard->next.load(std::memory_order_acquire))
+    {
+        poll_completions(*shard);
+    }
+}
+
+void
+uring_file_service::poll_completions(ring_shard& shard)
+{
+    ring_shard::completion_batch* batch = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.initialized)
+            return;
+
+        // A ring whose thread has a flush queued is harvested by that
+        // flush, on its own thread if the scheduler runs it there
+        if (opts_.ring_per_thread && shard.flush_pending)
+            return;
+
+        batch = harvest(shard);
+        if (batch && opts_.ring_per_thread && shard.owner == std::this_thread::get_id())
+            shard.stats.owner_completions += batch->ready.size();
+
+        // Submit operations started from the overflow list, and retry
+        // entries left behind by a failed submission
+        if (unsubmitted(shard) > 0)
+            defer_submit(shard);
+    }
+
+    // One enqueue for everything harvested
+    if (batch)
+        sched_.post(batch);
+}
+
+ring_shard::completion_batch*
+uring_file_service::harvest(ring_shard& shard)
+{
+    ring_shard::completion_batch* batch = nullptr;
+
+    // Take entries off the ring a batch at a time and release each
+    // batch with one update of the CQ head. When the kernel has
+    // buffered overflowed completions (IORING_FEAT_NODROP), peeking
+    // an empty queue flushes them into it, so the loop drains those too.
+    io_uring_cqe* cqes[harvest_batch];
+    unsigned n;
+    while ((n = io_uring_peek_batch_cqe(&shard.ring, cqes, harvest_batch)) != 0)
+    {
+        for (unsigned i = 0; i < n; ++i)
+        {
+            // Cancellation requests carry no operation
+            void* data = io_uring_cqe_get_data(cqes[i]);
+            if (!data)
+                continue;
+
+            // Neither do linked timeouts, but they took a slot
+            if (data == &link_timeout_tag)
+            {
+                --shard.in_flight;
+                continue;
+            }
+            auto* op = static_cast<boost::corosio::detail::scheduler_op*>(data);
+
+            if (!batch)
+                batch = take_batch(shard);
+
+            // Operations in flight never exceed the reserved capacity
+            batch->ready.push_back({op, cqes[i]->res, cqes[i]->flags});
+            --shard.in_flight;
+        }
+
+        io_uring_cq_advance(&shard.ring, n);
+        shard.stats.completions += n;
+    }
+
+    if (batch)
+        ++shard.stats.completion_batches;
+
+    // Completions made room for parked operations
+    start_parked(shard);
+    return batch;
+}
+
+ring_shard::completion_batch*
+uring_file_service::take_batch(ring_shard& shard)
+{
+    if (!shard.free_batches.empty())
+    {
+        auto* batch = shard.free_batches.back();
+        shard.free_batches.pop_back();
+        return batch;
+    }
+
+    // A batch holds at most the operations in flight when it was filled
+    auto batch = std::make_unique<ring_shard::completion_batch>(shard);
+    batch->ready.reserve(shard.max_in_flight);
+
+    // Room for every batch, so returning one cannot throw
+    shard.free_batches.reserve(shard.batches.size() + 1);
+    shard.batches.push_back(std::move(batch));
+    return shard.batches.back().get();
+}
+
+file_service_stats
+uring_file_service::stats() noexcept
+{
+    file_service_stats total;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total.registered_opens = stats_.registered_opens;
+        total.unregistered_opens = stats_.unregistered_opens;
+        total.splice_fallbacks = stats_.splice_fallbacks;
+    }
+
+    for (auto* shard = shards_; shard != nullptr;
+         shard = shard->next.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.submit_calls += shard->stats.submit_calls;
+        total.submitted += shard->stats.submitted;
+        total.completions += shard->stats.completions;
+        total.completion_batches += shard->stats.completion_batches;
+        total.owner_completions += shard->stats.owner_completions;
+        total.parked += shard->stats.parked;
+        total.sqpoll_wakeups += shard->stats.sqpoll_wakeups;
+        total.sqpoll = total.sqpoll || shard->stats.sqpoll;
+        ++total.rings;
+    }
+    return total;
 }
 
 uring_file_impl&
 uring_file_service::create_impl()
 {
-    auto internal = std::make_shared<uring_file_impl_internal>(*this);
+    file_ref internal(new uring_file_impl_internal(*this));
 
     {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -195,8 +1044,7 @@ uring_file_service::open_file(
     if (fd == -1)
         return boost::corosio::detail::make_err(errno);
 
-    impl.set_fd(fd);
-    impl.set_position(0);
+    impl.attach(fd, flags);
     return {};
 }
 
@@ -0,0 +1,138 @@
+#include <nntp/CommandPipeline.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace nntp
+{
+
+namespace
+{
+
+// RFC 3977 section 3.1: command lines are at most 512 octets including CRLF
+constexpr std::size_t MAX_COMMAND_LINE{512};
+
+} // namespace
+
+CommandPipeline::CommandPipeline(const PipelineLimits &limits) :
+    m_window(limits)
+{
+}
+
+RequestId CommandPipeline::submit(std::string_view command, std::stop_token token)
+{
+    if (command.empty())
+    {
+        throw std::invalid_argument("CommandPipeline: command cannot be empty");
+    }
+    if (command.find_first_of("\r\n") != std::string_view::npos)
+    {
+        throw std::invalid_argument("CommandPipeline: command cannot contain CR or LF");
+    }
+    if (command.size() + 2 > MAX_COMMAND_LINE)
+    {
+        throw std::invalid_argument("CommandPipeline: command exceeds 512 octets");
+    }
+
+    std::string line;
+    line.reserve(command.size() + 2);
+    line.append(command);
+    line.append("\r\n");
+
+    const RequestId id = m_next_id++;
+    m_queued.push_back({id, std::move(line), std::move(token), {}, false});
+    return id;
+}
+
+bool CommandPipeline::cancel(RequestId id)
+{
+    const auto matches = [id](const Entry &entry) { return entry.id == id; };
+
+    if (auto it = std::find_if(m_queued.begin(), m_queued.end(), matches); it != m_queued.end())
+    {
+        m_queued.erase(it);
+        ++m_dropped;
+        return true;
+    }
+
+    if (auto it = std::find_if(m_in_flight.begin(), m_in_flight.end(), matches); it != m_in_flight.end())
+    {
+        it->cancelled = true;
+        return true;
+    }
+
+    return false;
+}
+
+std::size_t CommandPipeline::purge()
+{
+    const auto stopped = [](const Entry &entry) { return entry.stopped(); };
+    const auto first = std::remove_if(m_queued.begin(), m_queued.end(), stopped);
+    const auto count = static_cast<std::size_t>(std::distance(first, m_queued.end()));
+    m_queued.erase(first, m_queued.end());
+    m_dropped += count;
+    return count;
+}
+
+std::optional<OutgoingCommand> CommandPipeline::send_next(Clock::time_point now)
+{
+    while (!m_queued.empty() && m_queued.front().stopped())
+    {
+        m_queued.pop_front();
+        ++m_dropped;
+    }
+    if (m_queued.empty() || !m_window.can_send())
+    {
+        return std::nullopt;
+    }
+
+    // References to deque elements survive push_back and pop_front of other
+    // elements, so the line view stays valid while the command is in flight.
+    m_in_flight.push_back(std::move(m_queued.front()));
+    m_queued.pop_front();
+    Entry &entry = m_in_flight.back();
+    entry.sent = now;
+    m_window.on_send();
+    return OutgoingCommand{entry.id, entry.line};
+}
+
+bool CommandPipeline::discarding() const noexcept
+{
+    return !m_in_flight.empty() && m_in_flight.front().stopped();
+}
+
+ResponseSkipper CommandPipeline::skip_response() const
+{
+    if (m_in_flight.empty())
+    {
+        throw std::logic_error("CommandPipeline: no command in flight");
+    }
+
+    return ResponseSkipper(m_in_flight.front().line);
+}
+
+RequestId CommandPipeline::complete(Clock::time_point now, std::size_t response_bytes)
+{
+    if (m_in_flight.empty())
+    {
+        throw std::logic_error("CommandPipeline: response without command in flight");
+    }
+
+    // A discarded response still crossed the wire, so it is a valid RTT sample
+    const Entry &entry = m_in_flight.front();
+    const RequestId id = entry.id;
+    if (entry.stopped())
+    {
+        ++m_discarded;
+    }
+    m_window.on_response(entry.sent, now, response_bytes);
+    m_in_flight.pop_front();
+    return id;
+}
+
+void CommandPipeline::on_overload(Clock::time_point now) noexcept
+{
+    m_window.on_overload(now);
+}
+
+} // namespace nntp
@@ -0,0 +1,343 @@
+#include <nntp/FeedSender.h>
+
+#include "ascii.h"
+
+#include <stdexcept>
+
+namespace nntp
+{
+
+namespace
+{
+
+constexpr std::string_view CRLF{"\r\n"};
+constexpr std::string_view TERMINATOR{".\r\n"};
+
+std::string_view first_token(std::string_view line) noexcept
+{
+    const std::size_t begin = line.find_first_not_of(' ');
+    if (begin == std::string_view::npos)
+    {
+        return {};
+    }
+    line.remove_prefix(begin);
+    return line.substr(0, line.find(' '));
+}
+
+int parse_status(std::string_view line) noexcept
+{
+    if (line.size() < 3)
+    {
+        return 0;
+    }
+    int status = 0;
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        if (line[i] < '0' || line[i] > '9')
+        {
+            return 0;
+        }
+        status = status * 10 + (line[i] - '0');
+    }
+    return status;
+}
+
+} // namespace
+
+FeedMode feed_mode(std::string_view capabilities) noexcept
+{
+    while (!capabilities.empty())
+    {
+        const std::size_t eol = capabilities.find('\n');
+        std::string_view line = capabilities.substr(0, eol);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        if (iequals(first_token(line), "STREAMING"))
+        {
+            return FeedMode::STREAMING;
+        }
+        if (eol == std::string_view::npos)
+        {
+            break;
+        }
+        capabilities.remove_prefix(eol + 1);
+    }
+    return FeedMode::IHAVE;
+}
+
+FeedSender::FeedSender(FeedMode mode, std::size_t window) :
+    m_mode(mode),
+    m_window(mode == FeedMode::IHAVE ? 1 : window),
+    m_handshake(mode == FeedMode::STREAMING ? Handshake::UNSENT : Handshake::NONE)
+{
+    if (mode == FeedMode::STREAMING && window < 1)
+    {
+        throw std::invalid_argument("FeedSender: window must be at least 1");
+    }
+}
+
+void FeedSender::offer(MessageId id, std::string_view article)
+{
+    if (article.size() < CRLF.size() || article.substr(article.size() - CRLF.size()) != CRLF)
+    {
+        throw std::invalid_argument("FeedSender: article must end with CRLF");
+    }
+
+    if (m_desynchronized)
+    {
+        finish({std::move(id), article}, FeedOutcome::DEFERRED, 0);
+        return;
+    }
+    m_queued.push_back({std::move(id), article});
+}
+
+const std::vector<std::string_view> &FeedSender::prepare()
+{
+    m_scratch.clear();
+    m_segments.clear();
+    m_buffers.clear();
+    if (m_desynchronized || m_handshake == Handshake::AWAITING)
+    {
+        return m_buffers;
+    }
+    if (m_handshake == Handshake::UNSENT)
+    {
+        // CHECK and TAKETHIS wait for the peer to permit streaming
+        emit_command("MODE", "STREAM");
+        m_handshake = Handshake::AWAITING;
+        m_buffers.emplace_back(m_scratch);
+        return m_buffers;
+    }
+
+    // Articles the peer asked for go first: their CHECK or IHAVE has
+    // already been answered.  In streaming mode the window bounds only
+    // unanswered CHECKs, so TAKETHIS transfers never hold offers back;
+    // IHAVE is lock-step and counts every command in flight.
+    while (!m_wanted.empty())
+    {
+        Offer offer = std::move(m_wanted.front());
+        m_wanted.pop_front();
+        if (m_mode == FeedMode::STREAMING)
+        {
+            emit_command("TAKETHIS", offer.id.value());
+            emit_article(offer.article);
+            m_in_flight.push_back({Stage::TAKETHIS, std::move(offer)});
+        }
+        else
+        {
+            emit_article(offer.article);
+            m_in_flight.push_back({Stage::IHAVE_ARTICLE, std::move(offer)});
+        }
+    }
+
+    while (!m_queued.empty() && (m_mode == FeedMode::STREAMING ? m_checks : m_in_flight.size()) < m_window)
+    {
+        Offer offer = std::move(m_queued.front());
+        m_queued.pop_front();
+        const Stage stage = m_mode == FeedMode::STREAMING ? Stage::CHECK : Stage::IHAVE;
+        if (stage == Stage::CHECK)
+        {
+            ++m_checks;
+        }
+        emit_command(stage == Stage::CHECK ? "CHECK" : "IHAVE", offer.id.value());
+        m_in_flight.push_back({stage, std::move(offer)});
+    }
+
+    m_buffers.reserve(m_segments.size());
+    for (const Segment &segment : m_segments)
+    {
+        const char *data = segment.data ? segment.data : m_scratch.data() + segment.offset;
+        m_buffers.emplace_back(data, segment.size);
+    }
+    return m_buffers;
+}
+
+std::size_t FeedSender::receive(std::string_view data)
+{
+    std::size_t used = 0;
+    while (used < data.size())
+    {
+        const std::size_t eol = data.find('\n', used);
+        if (eol == std::string_view::npos)
+        {
+            break;
+        }
+
+        std::string_view line = data.substr(used, eol - used);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        used = eol + 1;
+
+        // Responses arrive in command order; anything unsolicited, such as
+        // a 400 announcing shutdown, has no command to apply to.
+        if (m_handshake == Handshake::AWAITING)
+        {
+            on_mode_stream(parse_status(line));
+        }
+        else if (!m_in_flight.empty())
+        {
+            const std::string_view rest = line.size() > 3 ? line.substr(3) : std::string_view{};
+            on_response(parse_status(line), first_token(rest));
+        }
+    }
+    return used;
+}
+
+std::vector<FeedResult> FeedSender::take_results()
+{
+    std::vector<FeedResult> results;
+    results.swap(m_results);
+    return results;
+}
+
+void FeedSender::emit_command(std::string_view verb, std::string_view argument)
+{
+    const std::size_t offset = m_scratch.size();
+    m_scratch.append(verb);
+    m_scratch.push_back(' ');
+    m_scratch.append(argument);
+    m_scratch.append(CRLF);
+
+    // Adjacent command lines coalesce into one buffer
+    if (!m_segments.empty() && !m_segments.back().data)
+    {
+        m_segments.back().size += m_scratch.size() - offset;
+    }
+    else
+    {
+        m_segments.push_back({nullptr, offset, m_scratch.size() - offset});
+    }
+}
+
+void FeedSender::emit_article(std::string_view article)
+{
+    m_segments.push_back({article.data(), 0, article.size()});
+    m_segments.push_back({TERMINATOR.data(), 0, TERMINATOR.size()});
+}
+
+void FeedSender::on_mode_stream(int status)
+{
+    m_handshake = Handshake::NONE;
+    if (status != 203)
+    {
+        m_mode = FeedMode::IHAVE;
+        m_window = 1;
+    }
+}
+
+void FeedSender::on_response(int status, std::string_view id)
+{
+    Command command = std::move(m_in_flight.front());
+    m_in_flight.pop_front();
+    Offer &offer = command.offer;
+    if (command.stage == Stage::CHECK)
+    {
+        --m_checks;
+    }
+
+    // RFC 4644 responses echo the message-id; a mismatch means the
+    // conversation is out of step, so no later response can be matched
+    // to its command either.
+    const bool streaming = command.stage == Stage::CHECK || command.stage == Stage::TAKETHIS;
+    if (streaming && id != offer.id.value())
+    {
+        finish(offer, FeedOutcome::FAILED, status);
+        desynchronize(status);
+        return;
+    }
+
+    switch (command.stage)
+    {
+    case Stage::CHECK:
+        switch (status)
+        {
+        case 238:
+            m_wanted.push_back(std::move(offer));
+            return;
+        case 431:
+            finish(offer, FeedOutcome::DEFERRED, status);
+            return;
+        case 438:
+            finish(offer, FeedOutcome::REFUSED, status);
+            return;
+        }
+        break;
+
+    case Stage::TAKETHIS:
+        switch (status)
+        {
+        case 239:
+            finish(offer, FeedOutcome::ACCEPTED, status);
+            return;
+        case 439:
+            finish(offer, FeedOutcome::REJECTED, status);
+            return;
+        }
+        break;
+
+    case Stage::IHAVE:
+        switch (status)
+        {
+        case 335:
+            m_wanted.push_back(std::move(offer));
+            return;
+        case 435:
+            finish(offer, FeedOutcome::REFUSED, status);
+            return;
+        case 436:
+            finish(offer, FeedOutcome::DEFERRED, status);
+            return;
+        }
+        break;
+
+    case Stage::IHAVE_ARTICLE:
+        switch (status)
+        {
+        case 235:
+            finish(offer, FeedOutcome::ACCEPTED, status);
+            return;
+        case 436:
+            finish(offer, FeedOutcome::DEFERRED, status);
+            return;
+        case 437:
+            finish(offer, FeedOutcome::REJECTED, status);
+            return;
+        }
+        break;
+    }
+
+    finish(offer, FeedOutcome::FAILED, status);
+}
+
+void FeedSender::desynchronize(int status)
+{
+    m_desynchronized = true;
+    for (const Command &command : m_in_flight)
+    {
+        finish(command.offer, FeedOutcome::FAILED, status);
+    }
+    for (const Offer &offer : m_wanted)
+    {
+        finish(offer, FeedOutcome::FAILED, status);
+    }
+    for (const Offer &offer : m_queued)
+    {
+        finish(offer, FeedOutcome::DEFERRED, 0);
+    }
+    m_in_flight.clear();
+    m_wanted.clear();
+    m_queued.clear();
+    m_checks = 0;
+}
+
+void FeedSender::finish(const Offer &offer, FeedOutcome outcome, int status)
+{
+    ++m_counts[static_cast<std::size_t>(outcome)];
+    m_results.push_back({offer.id, outcome, status});
+}
+
+} // namespace nntp
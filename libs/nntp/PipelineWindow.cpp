@@ -0,0 +1,172 @@
+#include <nntp/PipelineWindow.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace nntp
+{
+
+namespace
+{
+
+using Seconds = std::chrono::duration<double>;
+
+PipelineLimits validate(const PipelineLimits &limits)
+{
+    if (limits.floor < 1)
+    {
+        throw std::invalid_argument("PipelineLimits: floor must be at least 1");
+    }
+    if (limits.floor > limits.ceiling)
+    {
+        throw std::invalid_argument("PipelineLimits: floor must be <= ceiling");
+    }
+    if (limits.queueing_threshold <= 0.0)
+    {
+        throw std::invalid_argument("PipelineLimits: queueing threshold must be positive");
+    }
+    if (limits.decrease_factor <= 0.0 || limits.decrease_factor >= 1.0)
+    {
+        throw std::invalid_argument("PipelineLimits: decrease factor must be between 0 and 1");
+    }
+    return limits;
+}
+
+} // namespace
+
+PipelineWindow::PipelineWindow(const PipelineLimits &limits) :
+    m_limits(validate(limits)),
+    m_depth(static_cast<double>(std::clamp(limits.initial, limits.floor, limits.ceiling)))
+{
+}
+
+void PipelineWindow::on_send() noexcept
+{
+    ++m_in_flight;
+    if (m_in_flight >= depth())
+    {
+        m_window_full = true;
+    }
+}
+
+void PipelineWindow::on_response(Clock::time_point sent, Clock::time_point now, std::size_t response_bytes) noexcept
+{
+    if (m_in_flight > 0)
+    {
+        --m_in_flight;
+    }
+    ++m_responses;
+
+    update_rtt(now - sent, now);
+    update_throughput(now, response_bytes);
+
+    const double min_rtt = Seconds(m_min_rtt).count();
+    const double smoothed_rtt = Seconds(m_smoothed_rtt).count();
+    if (smoothed_rtt > min_rtt * (1.0 + m_limits.queueing_threshold))
+    {
+        decrease(now);
+    }
+    else if (m_window_full)
+    {
+        // Only grow when the window was actually the limiting factor; an idle
+        // or application-limited connection says nothing about the server.
+        increase();
+    }
+
+    if (m_in_flight == 0)
+    {
+        m_window_full = false;
+    }
+}
+
+void PipelineWindow::on_overload(Clock::time_point now) noexcept
+{
+    decrease(now);
+}
+
+PipelineMetrics PipelineWindow::metrics() const noexcept
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    PipelineMetrics result;
+    result.depth = depth();
+    result.in_flight = m_in_flight;
+    result.min_rtt = m_min_rtt == Clock::duration::max() ? microseconds{} : duration_cast<microseconds>(m_min_rtt);
+    result.smoothed_rtt = duration_cast<microseconds>(m_smoothed_rtt);
+    result.throughput = m_throughput;
+    result.responses = m_responses;
+    result.increases = m_increases;
+    result.decreases = m_decreases;
+    result.slow_start = m_slow_start;
+    return result;
+}
+
+void PipelineWindow::update_rtt(Clock::duration rtt, Clock::time_point now) noexcept
+{
+    if (rtt < m_min_rtt || now - m_min_rtt_stamp > m_limits.min_rtt_lifetime)
+    {
+        m_min_rtt = rtt;
+        m_min_rtt_stamp = now;
+    }
+
+    // Same gain as the TCP smoothed RTT estimator (RFC 6298)
+    if (m_responses == 1)
+    {
+        m_smoothed_rtt = rtt;
+    }
+    else
+    {
+        m_smoothed_rtt += (rtt - m_smoothed_rtt) / 8;
+    }
+}
+
+void PipelineWindow::update_throughput(Clock::time_point now, std::size_t response_bytes) noexcept
+{
+    if (m_responses == 1)
+    {
+        m_rate_start = now;
+    }
+    m_rate_bytes += response_bytes;
+
+    // Sample delivery rate over roughly one round trip to smooth out bursts
+    const Clock::duration elapsed = now - m_rate_start;
+    const Clock::duration interval = std::max<Clock::duration>(m_smoothed_rtt, std::chrono::milliseconds(1));
+    if (elapsed < interval)
+    {
+        return;
+    }
+
+    const double sample = static_cast<double>(m_rate_bytes) / Seconds(elapsed).count();
+    m_throughput = m_throughput == 0.0 ? sample : 0.75 * m_throughput + 0.25 * sample;
+    m_rate_start = now;
+    m_rate_bytes = 0;
+}
+
+void PipelineWindow::decrease(Clock::time_point now) noexcept
+{
+    // React at most once per round trip: responses already in the pipe were
+    // sent under the old window and would otherwise collapse it repeatedly.
+    if (m_decreases != 0 && now - m_last_decrease < m_smoothed_rtt)
+    {
+        return;
+    }
+
+    ++m_decreases;
+    m_slow_start = false;
+    m_last_decrease = now;
+    m_depth = std::max(static_cast<double>(m_limits.floor), m_depth * m_limits.decrease_factor);
+}
+
+void PipelineWindow::increase() noexcept
+{
+    const double ceiling = static_cast<double>(m_limits.ceiling);
+    const double next = std::min(ceiling, m_slow_start ? m_depth + 1.0 : m_depth + 1.0 / m_depth);
+    if (static_cast<std::size_t>(next) != depth())
+    {
+        ++m_increases;
+    }
+    m_depth = next;
+}
+
+} // namespace nntp
@@ -0,0 +1,147 @@
+#include <nntp/ResponseSkipper.h>
+
+#include "ascii.h"
+
+namespace nntp
+{
+
+namespace
+{
+
+// A multi-line body ends with a line holding a single dot
+constexpr std::string_view TERMINATOR{"\r\n.\r\n"};
+
+// The status line's CRLF counts towards the terminator of an empty body
+constexpr std::size_t BODY_START{2};
+
+std::string_view verb_of(std::string_view command) noexcept
+{
+    return command.substr(0, command.find_first_of(" \r\n"));
+}
+
+bool is_multiline_status(int status, bool listgroup) noexcept
+{
+    switch (status)
+    {
+    case 100: // HELP
+    case 101: // CAPABILITIES
+    case 215: // LIST
+    case 220: // ARTICLE
+    case 221: // HEAD, XHDR, XPAT
+    case 222: // BODY
+    case 224: // OVER, XOVER
+    case 225: // HDR
+    case 230: // NEWNEWS
+    case 231: // NEWGROUPS
+    case 282: // XGTITLE
+        return true;
+
+    case 211: // GROUP answers on one line, LISTGROUP appends the article numbers
+        return listgroup;
+
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+bool is_multiline(std::string_view command, int status) noexcept
+{
+    return is_multiline_status(status, iequals(verb_of(command), "LISTGROUP"));
+}
+
+ResponseSkipper::ResponseSkipper(std::string_view command) noexcept :
+    m_listgroup(iequals(verb_of(command), "LISTGROUP"))
+{
+}
+
+std::size_t ResponseSkipper::consume(std::string_view data) noexcept
+{
+    std::size_t used = 0;
+    while (used < data.size() && m_state != State::DONE)
+    {
+        if (m_state == State::BODY)
+        {
+            used += skip_body(data.substr(used));
+        }
+        else
+        {
+            used += skip_status_line(data.substr(used));
+        }
+    }
+    m_consumed += used;
+    return used;
+}
+
+std::size_t ResponseSkipper::skip_status_line(std::string_view data) noexcept
+{
+    std::size_t used = 0;
+    while (m_state == State::STATUS_CODE && used < data.size())
+    {
+        const char c = data[used];
+        if (c < '0' || c > '9' || m_digits == 3)
+        {
+            m_state = State::STATUS_LINE;
+            break;
+        }
+        m_status = m_status * 10 + (c - '0');
+        ++m_digits;
+        ++used;
+    }
+    if (m_state != State::STATUS_LINE)
+    {
+        return used;
+    }
+
+    const std::size_t eol = data.find('\n', used);
+    if (eol == std::string_view::npos)
+    {
+        return data.size();
+    }
+
+    if (is_multiline_status(m_status, m_listgroup))
+    {
+        m_state = State::BODY;
+        m_matched = BODY_START;
+    }
+    else
+    {
+        m_state = State::DONE;
+    }
+    return eol + 1;
+}
+
+std::size_t ResponseSkipper::skip_body(std::string_view data) noexcept
+{
+    std::size_t i = 0;
+    while (i < data.size())
+    {
+        if (m_matched == 0)
+        {
+            // Nothing can match before the next CR; skip straight to it
+            i = data.find('\r', i);
+            if (i == std::string_view::npos)
+            {
+                return data.size();
+            }
+        }
+
+        const char c = data[i++];
+        if (c == TERMINATOR[m_matched])
+        {
+            if (++m_matched == TERMINATOR.size())
+            {
+                m_state = State::DONE;
+                return i;
+            }
+        }
+        else
+        {
+            m_matched = c == '\r' ? 1 : 0;
+        }
+    }
+    return i;
+}
+
+} // namespace nntp
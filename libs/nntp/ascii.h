@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string_view>
+
+namespace nntp
+{
+
+/// Compare two strings ignoring ASCII case, as NNTP verbs and keywords are
+bool iequals(std::string_view lhs, std::string_view rhs) noexcept;
+
+} // namespace nntp
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <nntp/PipelineWindow.h>
+#include <nntp/ResponseSkipper.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+
+namespace nntp
+{
+
+/// Identifies a submitted command for response correlation
+using RequestId = std::uint64_t;
+
+/// A command line ready to be written to the connection
+struct OutgoingCommand
+{
+    RequestId id;
+    std::string_view line; ///< Includes the trailing CRLF
+};
+
+/// Sans-I/O queue of pipelined NNTP commands
+///
+/// Commands are queued by submit() and released for transmission by
+/// send_next() only while the adaptive PipelineWindow allows it.  NNTP
+/// answers pipelined commands strictly in order, so each complete response
+/// belongs to the oldest command in flight.
+///
+/// Each command may carry a std::stop_token.  A stopped command that has
+/// not been sent is dropped from the queue; one already on the wire is
+/// marked for discarding, and its response should be drained with the
+/// ResponseSkipper from skip_response() instead of being parsed.
+class CommandPipeline
+{
+public:
+    using Clock = PipelineWindow::Clock;
+
+    explicit CommandPipeline(const PipelineLimits &limits = {});
+
+    /// Queue a command line (without CRLF) and return its request id
+    /// Throws std::invalid_argument if the line is empty, contains CR or LF,
+    /// or exceeds the RFC 3977 limit of 512 octets including CRLF
+    RequestId submit(std::string_view command, std::stop_token token = {});
+
+    /// Cancel a command by request id
+    /// Returns false if the id is unknown or its response already completed
+    bool cancel(RequestId id);
+
+    /// Drop every queued command whose stop token has been triggered
+    /// Returns the number of commands dropped
+    std::size_t purge();
+
+    /// Release the next queued command if the window allows it
+    /// Stopped commands at the head of the queue are dropped, not sent
+    /// The returned line remains valid until its response is completed
+    std::optional<OutgoingCommand> send_next(Clock::time_point now);
+
+    /// True if the response to the oldest command in flight should be discarded
+    bool discarding() const noexcept;
+
+    /// Skipper for draining the response to the oldest command in flight
+    /// Throws std::logic_error if no command is in flight
+    ResponseSkipper skip_response() const;
+
+    /// Record the complete response to the oldest command in flight
+    /// Throws std::logic_error if no command is in flight
+    RequestId complete(Clock::time_point now, std::size_t response_bytes);
+
+    /// Shrink the window after the server signalled overload
+    void on_overload(Clock::time_point now) noexcept;
+
+    // clang-format off
+    std::size_t queued() const noexcept             { return m_queued.size(); }
+    std::size_t in_flight() const noexcept          { return m_in_flight.size(); }
+    bool idle() const noexcept                      { return m_queued.empty() && m_in_flight.empty(); }
+    std::uint64_t dropped() const noexcept          { return m_dropped; }
+    std::uint64_t discarded() const noexcept        { return m_discarded; }
+    const PipelineWindow &window() const noexcept   { return m_window; }
+    PipelineMetrics metrics() const noexcept        { return m_window.metrics(); }
+    // clang-format on
+
+private:
+    struct Entry
+    {
+        RequestId id;
+        std::string line;
+        std::stop_token token;
+        Clock::time_point sent;
+        bool cancelled;
+
+        bool stopped() const noexcept
+        {
+            return cancelled || token.stop_requested();
+        }
+    };
+
+    PipelineWindow m_window;
+    RequestId m_next_id{1};
+    std::deque<Entry> m_queued;
+    std::deque<Entry> m_in_flight;
+    std::uint64_t m_dropped{};
+    std::uint64_t m_discarded{};
+};
+
+} // namespace nntp
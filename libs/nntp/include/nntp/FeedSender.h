@@ -0,0 +1,154 @@
+#pragma once
+
+#include <nntp/MessageId.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nntp
+{
+
+/// How articles are offered to the peer
+enum class FeedMode
+{
+    STREAMING, ///< Pipelined CHECK and TAKETHIS (RFC 4644)
+    IHAVE,     ///< Lock-step IHAVE (RFC 3977 section 6.3.2)
+};
+
+/// Final disposition of an offered article
+enum class FeedOutcome
+{
+    ACCEPTED, ///< 239 or 235: the peer stored the article
+    REFUSED,  ///< 438 or 435: the peer does not want the article
+    REJECTED, ///< 439 or 437: the peer refused the transferred article
+    DEFERRED, ///< 431 or 436: offer the article again later
+    FAILED,   ///< Any other response, e.g. 400 or 5xx
+};
+
+struct FeedResult
+{
+    MessageId id;
+    FeedOutcome outcome;
+    int status;
+};
+
+/// Pick STREAMING if the body of a CAPABILITIES response advertises it
+FeedMode feed_mode(std::string_view capabilities) noexcept;
+
+/// Sans-I/O sender for an outgoing news feed
+///
+/// In streaming mode, the first prepare() sends MODE STREAM and nothing
+/// else is written until the peer answers.  A 203 enables streaming; any
+/// other reply, e.g. 501 from a peer that advertises STREAMING but only
+/// accepts the commands in transit mode, switches the sender to IHAVE mode.
+/// Once streaming, CHECK commands for queued articles are pipelined up
+/// to the window size and every article the peer asks for is sent with
+/// TAKETHIS as soon as its 238 response arrives.  In IHAVE mode, one
+/// article is offered at a time.  Article bytes are never copied: the
+/// buffers returned by prepare() refer directly to the caller's spool data.
+///
+/// A streaming response whose message-id does not match its command means
+/// the conversation is out of step.  Every article in flight then fails,
+/// queued articles are deferred, and the sender stops writing; the caller
+/// must close the connection and start over with a new sender.
+class FeedSender
+{
+public:
+    /// window bounds the CHECKs awaiting an answer; IHAVE mode always uses 1
+    /// Throws std::invalid_argument if window is 0 in streaming mode
+    explicit FeedSender(FeedMode mode, std::size_t window = 64);
+
+    /// Queue an article for transmission
+    /// article is the wire form of the article: CRLF line endings, dot-stuffed,
+    /// without the terminating dot line.  It must stay valid until the
+    /// article's FeedResult has been returned by take_results().
+    /// Throws std::invalid_argument if article does not end in CRLF
+    void offer(MessageId id, std::string_view article);
+
+    /// Buffers to write to the connection next, in order
+    /// The caller must write all of them before calling prepare() again;
+    /// they remain valid until then.  Empty when waiting for responses.
+    const std::vector<std::string_view> &prepare();
+
+    /// Consume response bytes and return how many were used
+    /// Only complete lines are consumed; keep the remainder for the next call
+    std::size_t receive(std::string_view data);
+
+    /// Outcomes determined since the last call
+    std::vector<FeedResult> take_results();
+
+    // clang-format off
+    FeedMode mode() const noexcept          { return m_mode; }
+    std::size_t queued() const noexcept     { return m_queued.size(); }
+    std::size_t in_flight() const noexcept  { return m_in_flight.size(); }
+    bool idle() const noexcept              { return m_queued.empty() && m_in_flight.empty() && m_wanted.empty() && m_handshake != Handshake::AWAITING; }
+    bool desynchronized() const noexcept    { return m_desynchronized; }
+    std::uint64_t count(FeedOutcome outcome) const noexcept { return m_counts[static_cast<std::size_t>(outcome)]; }
+    // clang-format on
+
+private:
+    enum class Stage
+    {
+        CHECK,
+        TAKETHIS,
+        IHAVE,
+        IHAVE_ARTICLE,
+    };
+
+    enum class Handshake
+    {
+        NONE,
+        UNSENT,
+        AWAITING,
+    };
+
+    struct Offer
+    {
+        MessageId id;
+        std::string_view article;
+    };
+
+    struct Command
+    {
+        Stage stage;
+        Offer offer;
+    };
+
+    void emit_command(std::string_view verb, std::string_view argument);
+    void emit_article(std::string_view article);
+    void on_mode_stream(int status);
+    void on_response(int status, std::string_view id);
+    void desynchronize(int status);
+    void finish(const Offer &offer, FeedOutcome outcome, int status);
+
+    FeedMode m_mode;
+    std::size_t m_window;
+    Handshake m_handshake;
+    std::size_t m_checks{};
+    bool m_desynchronized{};
+    std::deque<Offer> m_queued;
+    std::deque<Offer> m_wanted;
+    std::deque<Command> m_in_flight;
+
+    // Command text for one prepare() round.  A segment with a null data
+    // pointer is an offset into m_scratch, otherwise it points at a spool
+    // buffer; offsets are resolved to views once m_scratch stops growing.
+    struct Segment
+    {
+        const char *data;
+        std::size_t offset;
+        std::size_t size;
+    };
+    std::string m_scratch;
+    std::vector<Segment> m_segments;
+    std::vector<std::string_view> m_buffers;
+
+    std::vector<FeedResult> m_results;
+    std::uint64_t m_counts[5]{};
+};
+
+} // namespace nntp
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace nntp
+{
+
+/// Bounds and tuning for an adaptive pipeline window
+struct PipelineLimits
+{
+    /// Smallest number of commands kept in flight
+    std::size_t floor{1};
+
+    /// Largest number of commands kept in flight
+    std::size_t ceiling{64};
+
+    /// Window used before any round trip has been measured
+    std::size_t initial{2};
+
+    /// Smoothed RTT above min RTT * (1 + threshold) is treated as server queueing
+    double queueing_threshold{0.5};
+
+    /// Multiplicative decrease applied when queueing or overload is detected
+    double decrease_factor{0.7};
+
+    /// Age after which the minimum RTT estimate is discarded and re-learned
+    std::chrono::steady_clock::duration min_rtt_lifetime{std::chrono::seconds(10)};
+};
+
+/// Snapshot of the adaptive window state for diagnostics
+struct PipelineMetrics
+{
+    std::size_t depth{};
+    std::size_t in_flight{};
+    std::chrono::microseconds min_rtt{};
+    std::chrono::microseconds smoothed_rtt{};
+    double throughput{}; ///< Response bytes per second
+    std::uint64_t responses{};
+    std::uint64_t increases{};
+    std::uint64_t decreases{};
+    bool slow_start{};
+};
+
+/// Adaptive in-flight command window for NNTP pipelining
+///
+/// The window grows exponentially until the first sign of server queueing,
+/// then additively by one command per window of responses.  Queueing is
+/// detected when the smoothed round trip time rises well above the minimum
+/// observed round trip time; the window then shrinks multiplicatively, at
+/// most once per round trip.  The caller supplies all timestamps.
+class PipelineWindow
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Throws std::invalid_argument if the limits are inconsistent
+    explicit PipelineWindow(const PipelineLimits &limits = {});
+
+    // clang-format off
+    /// Current window depth in commands
+    std::size_t depth() const noexcept { return static_cast<std::size_t>(m_depth); }
+
+    /// Number of commands sent and not yet answered
+    std::size_t in_flight() const noexcept { return m_in_flight; }
+
+    /// True when another command may be sent without exceeding the window
+    bool can_send() const noexcept { return m_in_flight < depth(); }
+
+    const PipelineLimits &limits() const noexcept { return m_limits; }
+    // clang-format on
+
+    /// Record that a command was written to the connection
+    void on_send() noexcept;
+
+    /// Record a complete response to a command sent at time sent
+    void on_response(Clock::time_point sent, Clock::time_point now, std::size_t response_bytes) noexcept;
+
+    /// Record an explicit overload signal from the server, e.g. a 400 or 503 response
+    void on_overload(Clock::time_point now) noexcept;
+
+    PipelineMetrics metrics() const noexcept;
+
+private:
+    void update_rtt(Clock::duration rtt, Clock::time_point now) noexcept;
+    void update_throughput(Clock::time_point now, std::size_t response_bytes) noexcept;
+    void decrease(Clock::time_point now) noexcept;
+    void increase() noexcept;
+
+    PipelineLimits m_limits;
+    double m_depth;
+    std::size_t m_in_flight{};
+    bool m_slow_start{true};
+    bool m_window_full{};
+
+    Clock::duration m_min_rtt{Clock::duration::max()};
+    Clock::time_point m_min_rtt_stamp{};
+    Clock::duration m_smoothed_rtt{};
+    Clock::time_point m_last_decrease{};
+
+    Clock::time_point m_rate_start{};
+    std::size_t m_rate_bytes{};
+    double m_throughput{};
+
+    std::uint64_t m_responses{};
+    std::uint64_t m_increases{};
+    std::uint64_t m_decreases{};
+};
+
+} // namespace nntp
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace nntp
+{
+
+/// True if a response with this status code to this command line is multi-line
+bool is_multiline(std::string_view command, int status) noexcept;
+
+/// Consumes one complete NNTP response without copying or parsing its body
+///
+/// Used to drain responses whose commands were cancelled after they had
+/// already been written to the connection.  Bytes are examined in place and
+/// only the minimum state needed to find the end of the response is kept
+/// across calls, so a response may straddle any number of reads.
+class ResponseSkipper
+{
+public:
+    /// The command line decides whether a status code introduces a multi-line body
+    explicit ResponseSkipper(std::string_view command) noexcept;
+
+    /// Consume bytes up to the end of the response and return how many were used
+    /// Bytes beyond the end of the response are left for the next response
+    std::size_t consume(std::string_view data) noexcept;
+
+    // clang-format off
+    bool done() const noexcept              { return m_state == State::DONE; }
+    int status() const noexcept             { return m_status; }
+    std::size_t consumed() const noexcept   { return m_consumed; }
+    // clang-format on
+
+private:
+    enum class State
+    {
+        STATUS_CODE,
+        STATUS_LINE,
+        BODY,
+        DONE,
+    };
+
+    std::size_t skip_status_line(std::string_view data) noexcept;
+    std::size_t skip_body(std::string_view data) noexcept;
+
+    bool m_listgroup;
+    State m_state{State::STATUS_CODE};
+    int m_status{};
+    int m_digits{};
+    std::size_t m_matched{};
+    std::size_t m_consumed{};
+};
+
+} // namespace nntp
@@ -0,0 +1,416 @@
+#include <storage/cyclic_spool.h>
+
+#include "storage_io.h"
+
+#include <boost/capy/buffers.hpp>
+#include <boost/capy/cond.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace nntp {
+
+using detail::get;
+using detail::put;
+using detail::write_fully;
+
+namespace {
+
+constexpr char buffer_magic[8] = {'N', 'N', 'T', 'P', 'C', 'Y', 'C', '1'};
+constexpr std::uint32_t record_magic = 0x31545241; // "ART1"
+
+// Header block layout
+constexpr std::size_t size_field = 8;
+constexpr std::size_t position_field = 16;
+constexpr std::size_t cycle_field = 24;
+constexpr std::size_t clean_field = 32;
+
+constexpr std::uint64_t
+align_record(std::uint64_t value) noexcept
+{
+    constexpr auto alignment = cyclic_spool::record_alignment;
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/** Bytes a record of an article of the given length occupies. */
+constexpr std::uint64_t
+record_size(std::size_t length) noexcept
+{
+    return align_record(cyclic_spool::record_header_size + length);
+}
+
+std::error_code
+article_gone() noexcept
+{
+    return std::make_error_code(std::errc::no_message_available);
+}
+
+// The record header and the article go out together with one writev;
+// after a short write the rest follows from where it stopped
+boost::capy::task<std::error_code>
+write_record(file_stream& file, std::uint64_t offset, char const* header, std::string_view article)
+{
+    constexpr std::size_t header_size = cyclic_spool::record_header_size;
+    std::size_t const total = header_size + article.size();
+    std::size_t done = 0;
+    while (done < total)
+    {
+        std::size_t in_header = std::min(done, header_size);
+        std::size_t in_article = done - in_header;
+        std::array<boost::capy::const_buffer, 2> parts = {
+            boost::capy::const_buffer(header + in_header, header_size - in_header),
+            boost::capy::const_buffer(article.data() + in_article, article.size() - in_article)};
+        auto [ec, n] = co_await file.write_at(offset + done, parts);
+        if (ec)
+            co_return ec;
+        if (n == 0)
+            co_return std::make_error_code(std::errc::io_error);
+        done += n;
+    }
+    co_return std::error_code();
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+
+struct cyclic_spool::buffer
+{
+    explicit buffer(boost::capy::execution_context& ctx)
+        : file(ctx)
+    {
+    }
+
+    file_stream file;
+
+    /** Size of the file in bytes. */
+    std::uint64_t size = 0;
+
+    /** Offset of the next record. */
+    std::uint64_t position = header_size;
+
+    /** Cycle being written, or zero for a buffer never written. */
+    std::uint64_t cycle = 0;
+
+    /** Whether the header on disk was written by close(). */
+    bool clean = true;
+};
+
+cyclic_spool::cyclic_spool(boost::capy::execution_context& ctx, std::size_t batch_size)
+    : ctx_(ctx)
+{
+    if (batch_size == 0 || batch_size % record_alignment != 0)
+        throw std::invalid_argument("cyclic_spool: batch_size must be a multiple of record_alignment");
+    batch_.resize(batch_size);
+}
+
+cyclic_spool::~cyclic_spool() = default;
+
+boost::capy::task<std::error_code>
+cyclic_spool::open(std::vector<std::filesystem::path> paths, std::uint64_t buffer_size)
+{
+    if (is_open())
+        co_await close();
+
+    if (paths.empty() || buffer_size <= header_size || buffer_size % record_alignment != 0)
+        co_return std::make_error_code(std::errc::invalid_argument);
+
+    std::vector<std::unique_ptr<buffer>> buffers;
+    buffers.reserve(paths.size());
+    for (auto const& path : paths)
+    {
+        auto b = std::make_unique<buffer>(ctx_);
+        std::error_code ec = b->file.open(path, file_stream::read_write, file_stream::open_always);
+        if (!ec)
+            ec = co_await open_buffer(*b, buffer_size);
+        if (ec)
+            co_return ec;
+        buffers.push_back(std::move(b));
+    }
+
+    buffers_ = std::move(buffers);
+    batch_used_ = 0;
+    cycle_ = 0;
+    current_ = 0;
+    capacity_ = std::numeric_limits<std::uint64_t>::max();
+    for (std::size_t i = 0; i < buffers_.size(); ++i)
+    {
+        auto const& b = *buffers_[i];
+        capacity_ = std::min(capacity_, b.size - header_size);
+        if (b.cycle > cycle_)
+        {
+            cycle_ = b.cycle;
+            current_ = i;
+        }
+    }
+
+    // A new spool starts writing in its first buffer
+    if (cycle_ == 0)
+    {
+        current_ = buffers_.size() - 1;
+        co_return co_await advance();
+    }
+
+    // A spool that was not closed may have handed out tokens for
+    // articles that never reached the file. Storing new articles at
+    // the same offsets and cycle would let those tokens find them.
+    if (!buffers_[current_]->clean)
+        co_return co_await advance();
+
+    // Until close() says otherwise, a crash leaves the spool unclean
+    co_return co_await write_header(*buffers_[current_]);
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::open_buffer(buffer& b, std::uint64_t buffer_size)
+{
+    std::vector<char> block(header_size);
+    auto [ec, n] = co_await b.file.read_at(0, boost::capy::mutable_buffer(block.data(), block.size()));
+
+    // An empty file is a new buffer: allocate all of it now, so
+    // writing never finds the disk full
+    if (ec == boost::capy::cond::eof || (!ec && n == 0))
+    {
+        auto [alloc_ec, unused] = co_await b.file.fallocate(0, buffer_size);
+        if (alloc_ec)
+            co_return alloc_ec;
+        b.size = buffer_size;
+        b.position = header_size;
+        b.cycle = 0;
+        b.clean = true;
+        co_return co_await write_header(b, true);
+    }
+    if (ec)
+        co_return ec;
+
+    if (n < header_size || std::memcmp(block.data(), buffer_magic, sizeof(buffer_magic)) != 0)
+        co_return std::make_error_code(std::errc::illegal_byte_sequence);
+
+    b.size = get<std::uint64_t>(block.data() + size_field);
+    b.position = get<std::uint64_t>(block.data() + position_field);
+    b.cycle = get<std::uint64_t>(block.data() + cycle_field);
+    b.clean = get<std::uint64_t>(block.data() + clean_field) != 0;
+    if (b.size <= header_size || b.size % record_alignment != 0 ||
+        b.position < header_size || b.position > b.size || b.position % record_alignment != 0)
+        co_return std::make_error_code(std::errc::illegal_byte_sequence);
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::store(std::string_view article, spool_token& token)
+{
+    if (!is_open())
+        co_return std::make_error_code(std::errc::bad_file_descriptor);
+
+    std::uint64_t const record = record_size(article.size());
+    if (article.size() > std::numeric_limits<std::uint32_t>::max() || record > capacity_)
+        co_return std::make_error_code(std::errc::message_size);
+
+    // Writing moves on to the next buffer, overwriting its oldest
+    // articles, when the record does not fit in this one
+    if (buffers_[current_]->position + record > buffers_[current_]->size)
+    {
+        if (auto ec = co_await advance())
+            co_return ec;
+    }
+
+    auto& b = *buffers_[current_];
+    token.buffer = static_cast<std::uint32_t>(current_);
+    token.length = static_cast<std::uint32_t>(article.size());
+    token.offset = b.position;
+    token.cycle = b.cycle;
+
+    char header[record_header_size];
+    put(header, record_magic);
+    put(header + 4, token.length);
+    put(header + 8, token.cycle);
+
+    if (record <= batch_.size())
+    {
+        if (batch_used_ + record > batch_.size())
+        {
+            if (auto ec = co_await write_batch())
+                co_return ec;
+        }
+        if (batch_used_ == 0)
+            batch_offset_ = b.position;
+
+        char* p = batch_.data() + batch_used_;
+        std::memcpy(p, header, record_header_size);
+        std::memcpy(p + record_header_size, article.data(), article.size());
+        std::memset(p + record_header_size + article.size(), 0,
+            record - record_header_size - article.size());
+        batch_used_ += record;
+    }
+    else
+    {
+        // Too large to stage: the batch goes first to keep the
+        // buffer written in order
+        if (auto ec = co_await write_batch())
+            co_return ec;
+
+        // The space is claimed before the write suspends, so the
+        // buffer never ends before a record being written, and is
+        // given back if the write fails
+        b.position += record;
+        if (auto ec = co_await write_record(b.file, token.offset, header, article))
+        {
+            b.position -= record;
+            co_return ec;
+        }
+        co_return std::error_code();
+    }
+
+    b.position += record;
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::retrieve(spool_token const& token, std::string& article)
+{
+    article.clear();
+    if (!is_open() || token.buffer >= buffers_.size())
+        co_return article_gone();
+
+    auto& b = *buffers_[token.buffer];
+    auto overwritten = [&]
+    {
+        // The current cycle writes from the start of the buffer up to
+        // position. Where the cycle before it stopped is not recorded,
+        // so an article from any earlier lap may be gone.
+        return token.cycle > b.cycle ||
+            token.cycle + buffers_.size() < b.cycle ||
+            (token.cycle < b.cycle && token.offset < b.position);
+    };
+
+    std::uint64_t const end = token.offset + record_header_size + token.length;
+    if (overwritten() || token.offset < header_size || end > b.size ||
+        (token.cycle == b.cycle && end > b.position))
+        co_return article_gone();
+
+    if (in_batch(token))
+    {
+        char const* p = batch_.data() + (token.offset - batch_offset_);
+        if (get<std::uint32_t>(p) != record_magic || get<std::uint32_t>(p + 4) != token.length)
+            co_return article_gone();
+        article.assign(p + record_header_size, token.length);
+        co_return std::error_code();
+    }
+
+    // One positioned readv fetches the record header and the article
+    std::array<char, record_header_size> header;
+    article.resize(token.length);
+    std::size_t const total = record_header_size + token.length;
+    std::size_t done = 0;
+    while (done < total)
+    {
+        std::size_t in_header = std::min(done, record_header_size);
+        std::size_t in_article = done - in_header;
+        std::array<boost::capy::mutable_buffer, 2> parts = {
+            boost::capy::mutable_buffer(header.data() + in_header, record_header_size - in_header),
+            boost::capy::mutable_buffer(article.data() + in_article, token.length - in_article)};
+        auto [ec, n] = co_await b.file.read_at(token.offset + done, parts);
+        if (ec == boost::capy::cond::eof || (!ec && n == 0))
+            ec = article_gone();
+        if (ec)
+        {
+            article.clear();
+            co_return ec;
+        }
+        done += n;
+    }
+
+    // A store may have overwritten the record while it was read
+    if (overwritten() ||
+        get<std::uint32_t>(header.data()) != record_magic ||
+        get<std::uint32_t>(header.data() + 4) != token.length ||
+        get<std::uint64_t>(header.data() + 8) != token.cycle)
+    {
+        article.clear();
+        co_return article_gone();
+    }
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::flush()
+{
+    if (!is_open())
+        co_return std::error_code();
+    if (auto ec = co_await write_batch())
+        co_return ec;
+    co_return co_await write_header(*buffers_[current_]);
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::close()
+{
+    std::error_code ec;
+    if (is_open())
+    {
+        ec = co_await write_batch();
+        if (!ec)
+            ec = co_await write_header(*buffers_[current_], true);
+    }
+    for (auto& b : buffers_)
+        b->file.close();
+    buffers_.clear();
+    batch_used_ = 0;
+    co_return ec;
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::write_batch()
+{
+    if (batch_used_ == 0)
+        co_return std::error_code();
+
+    // The batch stays readable by retrieve until it is on disk
+    auto ec = co_await write_fully(buffers_[current_]->file, batch_offset_, batch_.data(), batch_used_);
+    if (!ec)
+        batch_used_ = 0;
+    co_return ec;
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::write_header(buffer& b, bool clean)
+{
+    std::vector<char> block(header_size);
+    std::memcpy(block.data(), buffer_magic, sizeof(buffer_magic));
+    put(block.data() + size_field, b.size);
+    put(block.data() + position_field, b.position);
+    put(block.data() + cycle_field, b.cycle);
+    put(block.data() + clean_field, std::uint64_t(clean));
+    co_return co_await write_fully(b.file, 0, block.data(), block.size());
+}
+
+boost::capy::task<std::error_code>
+cyclic_spool::advance()
+{
+    // The old buffer's header keeps the end of its last cycle, which
+    // tells its surviving articles from the space after them
+    if (auto ec = co_await flush())
+        co_return ec;
+
+    current_ = (current_ + 1) % buffers_.size();
+    auto& b = *buffers_[current_];
+    b.cycle = ++cycle_;
+    b.position = header_size;
+    co_return co_await write_header(b);
+}
+
+bool
+cyclic_spool::in_batch(spool_token const& token) const noexcept
+{
+    return batch_used_ != 0 &&
+        token.buffer == current_ &&
+        token.cycle == buffers_[current_]->cycle &&
+        token.offset >= batch_offset_ &&
+        token.offset < batch_offset_ + batch_used_;
+}
+
+} // namespace nntp
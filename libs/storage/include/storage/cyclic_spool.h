@@ -0,0 +1,216 @@
+#ifndef NNTP_CYCLIC_SPOOL_H
+#define NNTP_CYCLIC_SPOOL_H
+
+#include <fileio/file_stream.h>
+#include <boost/capy/ex/execution_context.hpp>
+#include <boost/capy/task.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace nntp {
+
+/** Address of an article in a cyclic_spool.
+
+    Tokens are small enough to keep in the history and overview
+    databases in place of a path. The cycle tells an article from
+    whatever later overwrote its space.
+*/
+struct spool_token
+{
+    /** Index of the cyclic buffer holding the article. */
+    std::uint32_t buffer = 0;
+
+    /** Length of the article in bytes. */
+    std::uint32_t length = 0;
+
+    /** File offset of the article's record header. */
+    std::uint64_t offset = 0;
+
+    /** Cycle of the buffer the article was written in. */
+    std::uint64_t cycle = 0;
+
+    friend bool operator==(spool_token const&, spool_token const&) = default;
+};
+
+/** Article storage in large preallocated files written in a circle.
+
+    Storing each article in a file of its own costs a create, an
+    inode and a directory entry per article, and expiring articles
+    costs an unlink each. A cyclic spool instead keeps a few large
+    buffer files, allocated once, and appends articles to them in
+    turn. When the last buffer is full, writing wraps to the first
+    and overwrites its oldest articles, so expiry needs no work at
+    all.
+
+    Each buffer file starts with a header_size block recording its
+    size, write position and cycle, and whether the spool was closed
+    since the buffer was last written. Articles follow as records: a
+    small header with the length and cycle, then the article,
+    padded so that each record starts on a record_alignment
+    boundary. The cycle increases each time writing moves to a
+    buffer, and a token is valid while the record at its offset
+    still carries its cycle.
+
+    Stores are staged in a batch of batch_size bytes and written
+    with one write_at once it fills, so ingest costs one operation
+    per batch rather than per article. Articles too large for the
+    batch are written directly. Retrieval is a single positioned
+    read of the record; articles still in the batch are copied from
+    memory.
+
+    flush() writes the batch and the header of the current buffer.
+    After a crash, articles stored since the last flush are lost,
+    although their tokens were handed out. Writing then resumes in
+    the next buffer with a new cycle rather than at the recorded
+    position, so those tokens never match articles stored later; the
+    cost is overwriting the oldest articles a little early.
+
+    @par Thread Safety
+    Distinct objects: Safe.
+    Shared objects: Unsafe. Only one open, store, flush or close may
+    be outstanding at a time. Retrieve may run alongside a store or
+    flush, but not alongside open or close, which destroy the buffer
+    files a pending retrieve reads from.
+*/
+class cyclic_spool
+{
+public:
+    /** Size of the header block at the start of each buffer file. */
+    static constexpr std::size_t header_size = 4096;
+
+    /** Alignment of each record within a buffer. */
+    static constexpr std::size_t record_alignment = 512;
+
+    /** Size of the header in front of each article. */
+    static constexpr std::size_t record_header_size = 16;
+
+    /** Default size of the store batch in bytes. */
+    static constexpr std::size_t default_batch_size = 1024 * 1024;
+
+    /** Construct a closed spool.
+
+        @param ctx The execution context the buffer files use.
+        @param batch_size Size of the store batch in bytes.
+
+        @throws std::invalid_argument if batch_size is not a positive
+            multiple of record_alignment.
+    */
+    explicit cyclic_spool(
+        boost::capy::execution_context& ctx,
+        std::size_t batch_size = default_batch_size);
+
+    ~cyclic_spool();
+
+    cyclic_spool(cyclic_spool const&) = delete;
+    cyclic_spool& operator=(cyclic_spool const&) = delete;
+
+    /** Open the buffer files, creating any that do not exist.
+
+        An open spool is closed first, so every retrieve must have
+        completed.
+
+        A new buffer file is preallocated to buffer_size bytes. An
+        existing one keeps the size it was created with. Writing
+        resumes in the buffer written most recently, or in the one
+        after it if the spool was not closed.
+
+        @param paths The buffer files, in the order they are filled.
+            Tokens refer to buffers by their index in this list.
+        @param buffer_size Size of each new buffer file in bytes.
+
+        @return A task yielding std::errc::invalid_argument if no
+            path is given or buffer_size is not a multiple of
+            record_alignment larger than header_size,
+            std::errc::illegal_byte_sequence if a file is not a
+            buffer, or the error opening a file.
+    */
+    boost::capy::task<std::error_code> open(
+        std::vector<std::filesystem::path> paths,
+        std::uint64_t buffer_size);
+
+    /** Check whether the spool is open. */
+    bool is_open() const noexcept { return !buffers_.empty(); }
+
+    /** Store an article.
+
+        The article is copied, and its token is valid as soon as the
+        returned task completes, although the article only reaches
+        the file when the batch is written.
+
+        @param article The article, headers and body.
+        @param token Set to the article's address.
+
+        @return A task yielding std::errc::message_size if the
+            article does not fit in a buffer, or the first write
+            error.
+    */
+    boost::capy::task<std::error_code> store(std::string_view article, spool_token& token);
+
+    /** Read an article.
+
+        @param token The article's address.
+        @param article Set to the article.
+
+        @return A task yielding std::errc::no_message_available if the
+            article has been overwritten or the token is not valid,
+            or the read error.
+    */
+    boost::capy::task<std::error_code> retrieve(spool_token const& token, std::string& article);
+
+    /** Write the batch and the current buffer's header.
+
+        @return A task yielding the first write error, if any.
+    */
+    boost::capy::task<std::error_code> flush();
+
+    /** Flush and close the buffer files.
+
+        Every retrieve must have completed first.
+
+        @return A task yielding the flush error, if any.
+    */
+    boost::capy::task<std::error_code> close();
+
+    /** Get the number of bytes staged in the batch. */
+    std::size_t staged() const noexcept { return batch_used_; }
+
+private:
+    struct buffer;
+
+    boost::capy::task<std::error_code> open_buffer(buffer& b, std::uint64_t buffer_size);
+    boost::capy::task<std::error_code> write_batch();
+    boost::capy::task<std::error_code> write_header(buffer& b, bool clean = false);
+    boost::capy::task<std::error_code> advance();
+
+    bool in_batch(spool_token const& token) const noexcept;
+
+    boost::capy::execution_context& ctx_;
+    std::vector<std::unique_ptr<buffer>> buffers_;
+
+    /** Buffer articles are being stored in. */
+    std::size_t current_ = 0;
+
+    /** Highest cycle of any buffer. */
+    std::uint64_t cycle_ = 0;
+
+    /** Largest record every buffer can hold. */
+    std::uint64_t capacity_ = 0;
+
+    std::vector<char> batch_;
+
+    /** File offset of the batch's first byte in the current buffer. */
+    std::uint64_t batch_offset_ = 0;
+
+    std::size_t batch_used_ = 0;
+};
+
+} // namespace nntp
+
+#endif // NNTP_CYCLIC_SPOOL_H
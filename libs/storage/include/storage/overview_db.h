@@ -0,0 +1,196 @@
+#ifndef NNTP_OVERVIEW_DB_H
+#define NNTP_OVERVIEW_DB_H
+
+#include <fileio/file_stream.h>
+#include <nntp/Article.h>
+#include <nntp/ArticleRange.h>
+#include <nntp/Newsgroup.h>
+#include <boost/capy/ex/execution_context.hpp>
+#include <boost/capy/task.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace nntp {
+
+/** The overview data of one article, as returned by a query. */
+struct overview_record
+{
+    /** The article's number in its group. */
+    Article article;
+
+    /** The overview data, a view into the query's buffer. */
+    std::string_view data;
+};
+
+/** Overview data of every group, stored in two files per group.
+
+    OVER and XOVER ask for the overview of a range of articles in a
+    group, and a reader asks for the range it has not seen yet each
+    time it enters the group. Keeping the records in one file per
+    group ordered by article number lets a query read them without
+    searching.
+
+    Each group has an index file and a data file in the database
+    directory. The data file holds the overview records back to
+    back and is only ever appended to. The index file starts with an
+    index_header_size header recording the group's first article
+    number, followed by one index_entry_size entry per article
+    number holding the offset and length of its record; an entry of
+    length zero marks a missing article. The entry of an article is
+    found by arithmetic, so the entries of any range are one
+    contiguous region of the index.
+
+    A query maps the index and reads the range's records from the
+    data file in runs, one positioned read per run of records that
+    lie together. Records added in article order are contiguous, so
+    such a range is one read. A record added again leaves its old
+    copy behind in the data file; the query reads the new copy on
+    its own rather than everything in between, so a query reads
+    little more than its records however often they were replaced.
+
+    Additions are staged per group and written with one write_at to
+    each file once the group's batch fills, when the group is
+    queried, or on flush(). Records staged but not written are lost
+    in a crash.
+
+    At most max_open_groups groups are open at once. Opening one
+    more writes the staged records of the group used least recently
+    and closes its files, index mapping and batch.
+
+    @par Thread Safety
+    Distinct objects: Safe.
+    Shared objects: Unsafe. Operations must not overlap.
+*/
+class overview_db
+{
+public:
+    /** Size of the header at the start of each index file. */
+    static constexpr std::size_t index_header_size = 16;
+
+    /** Size of the index entry of each article number. */
+    static constexpr std::size_t index_entry_size = 16;
+
+    /** Default size of each group's batch in bytes. */
+    static constexpr std::size_t default_batch_size = 256 * 1024;
+
+    /** Default number of groups kept open. */
+    static constexpr std::size_t default_max_open_groups = 256;
+
+    /** Construct a database.
+
+        No file is opened until a group is used. The directory is
+        created by the first addition.
+
+        @param ctx The execution context the files use.
+        @param directory The directory holding the group files.
+        @param batch_size Bytes of index entries and records staged
+            per group before they are written.
+        @param max_open_groups Number of groups whose files are kept
+            open.
+
+        @throws std::invalid_argument if batch_size is smaller than
+            index_entry_size, or max_open_groups is zero.
+    */
+    overview_db(
+        boost::capy::execution_context& ctx,
+        std::filesystem::path directory,
+        std::size_t batch_size = default_batch_size,
+        std::size_t max_open_groups = default_max_open_groups);
+
+    ~overview_db();
+
+    overview_db(overview_db const&) = delete;
+    overview_db& operator=(overview_db const&) = delete;
+
+    /** Add the overview record of an article.
+
+        A group's first addition creates its files and fixes its
+        first article number. Adding an article again replaces its
+        record.
+
+        @param group The group the article is in.
+        @param article The article's number in the group.
+        @param overview The overview data, without the line ending.
+
+        @return A task yielding std::errc::invalid_argument if the
+            overview is empty or too large,
+            std::errc::argument_out_of_domain if the article number
+            is below the group's first, or the first file error.
+    */
+    boost::capy::task<std::error_code> add(
+        Newsgroup const& group,
+        Article article,
+        std::string_view overview);
+
+    /** Read the overview records of a range of articles.
+
+        Staged records of the group are written first. Missing
+        articles are skipped, and an unbounded range extends to the
+        group's last article. A group that has no files yields no
+        records.
+
+        @param group The group to query.
+        @param range The articles to read.
+        @param records Set to the records found, in article order.
+        @param buffer Holds the data the records refer to.
+
+        @return A task yielding std::errc::illegal_byte_sequence if
+            the group's files are damaged, or the first file error.
+    */
+    boost::capy::task<std::error_code> query(
+        Newsgroup const& group,
+        ArticleRange const& range,
+        std::vector<overview_record>& records,
+        std::string& buffer);
+
+    /** Write the staged records of every group.
+
+        @return A task yielding the first write error, if any.
+    */
+    boost::capy::task<std::error_code> flush();
+
+    /** Flush and close every group's files.
+
+        @return A task yielding the flush error, if any.
+    */
+    boost::capy::task<std::error_code> close();
+
+    /** Get the number of bytes staged across all groups. */
+    std::size_t staged() const noexcept { return staged_; }
+
+    /** Get the number of groups whose files are open. */
+    std::size_t open_groups() const noexcept { return groups_.size(); }
+
+private:
+    struct group;
+
+    boost::capy::task<std::error_code> open_group(
+        Newsgroup const& name,
+        bool create,
+        group*& out);
+    boost::capy::task<std::error_code> write_group(group& g);
+    boost::capy::task<std::error_code> evict();
+
+    boost::capy::execution_context& ctx_;
+    std::filesystem::path directory_;
+    std::size_t batch_size_;
+    std::size_t max_open_groups_;
+    std::map<std::string, std::unique_ptr<group>, std::less<>> groups_;
+    std::size_t staged_ = 0;
+
+    /** Incremented on each use of a group, to find the least recent. */
+    std::uint64_t uses_ = 0;
+};
+
+} // namespace nntp
+
+#endif // NNTP_OVERVIEW_DB_H
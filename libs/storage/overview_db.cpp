@@ -0,0 +1,443 @@
+#include <storage/overview_db.h>
+
+#include "storage_io.h"
+
+#include <fileio/mapped_file.h>
+#include <boost/capy/buffers.hpp>
+#include <boost/capy/cond.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace nntp {
+
+using detail::get;
+using detail::put;
+using detail::write_fully;
+
+namespace {
+
+constexpr char index_magic[8] = {'N', 'N', 'T', 'P', 'O', 'V', 'X', '1'};
+
+// Index header layout
+constexpr std::size_t base_field = 8;
+
+// Index entry layout; the last four bytes are reserved
+constexpr std::size_t offset_field = 0;
+constexpr std::size_t length_field = 8;
+
+// Records of a query closer together than this in the data file are
+// read with one read, along with the bytes between them
+constexpr std::uint64_t read_gap = 4096;
+
+// Group names may contain '/', which must not reach the file system
+std::string
+file_stem(Newsgroup const& group)
+{
+    std::string stem;
+    stem.reserve(group.value().size());
+    for (char c : group.value())
+    {
+        if (c == '%')
+            stem += "%25";
+        else if (c == '/')
+            stem += "%2F";
+        else
+            stem += c;
+    }
+    return stem;
+}
+
+boost::capy::task<std::error_code>
+read_fully(file_stream& file, std::uint64_t offset, char* data, std::size_t size)
+{
+    std::size_t done = 0;
+    while (done < size)
+    {
+        auto [ec, n] = co_await file.read_at(
+            offset + done, boost::capy::mutable_buffer(data + done, size - done));
+        if (ec == boost::capy::cond::eof || (!ec && n == 0))
+            co_return std::make_error_code(std::errc::illegal_byte_sequence);
+        if (ec)
+            co_return ec;
+        done += n;
+    }
+    co_return std::error_code();
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+
+struct overview_db::group
+{
+    explicit group(boost::capy::execution_context& ctx)
+        : index(ctx)
+        , data(ctx)
+    {
+    }
+
+    file_stream index;
+    file_stream data;
+    std::filesystem::path index_path;
+
+    /** Read-only view of the index for queries, opened on first use. */
+    mapped_file map;
+
+    /** First article number, or zero for a group never added to. */
+    Article::ValueType base = 0;
+
+    /** Number of index entries written. */
+    std::uint64_t count = 0;
+
+    /** Size of the data file as written. */
+    std::uint64_t data_end = 0;
+
+    /** Staged index entries, a run starting at entry staged_first. */
+    std::vector<char> staged_index;
+    std::uint64_t staged_first = 0;
+
+    /** Staged records, to be appended at data_end. */
+    std::vector<char> staged_data;
+
+    /** Value of uses_ when the group was last used. */
+    std::uint64_t last_use = 0;
+
+    std::uint64_t staged_end() const noexcept
+    {
+        return staged_first + staged_index.size() / index_entry_size;
+    }
+
+    std::size_t staged() const noexcept
+    {
+        return staged_index.size() + staged_data.size();
+    }
+};
+
+overview_db::overview_db(
+    boost::capy::execution_context& ctx,
+    std::filesystem::path directory,
+    std::size_t batch_size,
+    std::size_t max_open_groups)
+    : ctx_(ctx)
+    , directory_(std::move(directory))
+    , batch_size_(batch_size)
+    , max_open_groups_(max_open_groups)
+{
+    if (batch_size < index_entry_size)
+        throw std::invalid_argument("overview_db: batch_size must hold an index entry");
+    if (max_open_groups == 0)
+        throw std::invalid_argument("overview_db: max_open_groups must not be zero");
+}
+
+overview_db::~overview_db() = default;
+
+boost::capy::task<std::error_code>
+overview_db::open_group(Newsgroup const& name, bool create, group*& out)
+{
+    out = nullptr;
+    if (auto it = groups_.find(name.value()); it != groups_.end())
+    {
+        out = it->second.get();
+        out->last_use = ++uses_;
+        co_return std::error_code();
+    }
+
+    std::error_code ec;
+    if (create)
+    {
+        std::filesystem::create_directories(directory_, ec);
+        if (ec)
+            co_return ec;
+    }
+
+    auto g = std::make_unique<group>(ctx_);
+    std::string const stem = file_stem(name);
+    g->index_path = directory_ / (stem + ".idx");
+    ec = g->index.open(g->index_path, file_stream::read_write,
+        create ? file_stream::open_always : file_stream::open_existing);
+    if (!create && ec == std::errc::no_such_file_or_directory)
+        co_return std::error_code();
+    if (ec)
+        co_return ec;
+    ec = g->data.open(directory_ / (stem + ".dat"), file_stream::read_write, file_stream::open_always);
+    if (ec)
+        co_return ec;
+
+    // An index without a header was never added to; the header is
+    // written with the first addition
+    std::uint64_t const index_size = g->index.size(ec);
+    if (ec)
+        co_return ec;
+    if (index_size != 0)
+    {
+        char header[index_header_size];
+        if (auto read_ec = co_await read_fully(g->index, 0, header, sizeof(header)))
+            co_return read_ec;
+        g->base = get<Article::ValueType>(header + base_field);
+        if (std::memcmp(header, index_magic, sizeof(index_magic)) != 0 || g->base == 0)
+            co_return std::make_error_code(std::errc::illegal_byte_sequence);
+        g->count = (index_size - index_header_size) / index_entry_size;
+        g->data_end = g->data.size(ec);
+        if (ec)
+            co_return ec;
+    }
+
+    if (groups_.size() >= max_open_groups_)
+    {
+        if (auto evict_ec = co_await evict())
+            co_return evict_ec;
+    }
+
+    out = g.get();
+    out->last_use = ++uses_;
+    groups_.emplace(name.value(), std::move(g));
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+overview_db::evict()
+{
+    auto victim = std::min_element(groups_.begin(), groups_.end(),
+        [](auto const& a, auto const& b) { return a.second->last_use < b.second->last_use; });
+
+    // The group's staged records go out before its files close; a
+    // group that cannot be written stays open
+    if (auto ec = co_await write_group(*victim->second))
+        co_return ec;
+    groups_.erase(victim);
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+overview_db::add(Newsgroup const& name, Article article, std::string_view overview)
+{
+    if (overview.empty() || overview.size() > std::numeric_limits<std::uint32_t>::max())
+        co_return std::make_error_code(std::errc::invalid_argument);
+
+    group* gp;
+    if (auto ec = co_await open_group(name, true, gp))
+        co_return ec;
+    auto& g = *gp;
+
+    if (g.base == 0)
+    {
+        char header[index_header_size] = {};
+        std::memcpy(header, index_magic, sizeof(index_magic));
+        put(header + base_field, article.value());
+        if (auto ec = co_await write_fully(g.index, 0, header, sizeof(header)))
+            co_return ec;
+        g.base = article.value();
+    }
+    if (article.value() < g.base)
+        co_return std::make_error_code(std::errc::argument_out_of_domain);
+
+    // Entries are staged as one run, so the batch goes out with one
+    // write to the index. Small gaps past the written entries are
+    // filled with missing-article entries; a gap over written entries
+    // would erase them when the run is written, so an entry that would
+    // leave one, or that cannot fit the run, starts a new run
+    std::uint64_t const n = article.value() - g.base;
+    bool const joins = !g.staged_index.empty() &&
+        n >= g.staged_first &&
+        (n - g.staged_first + 1) * index_entry_size <= batch_size_ &&
+        (n <= g.staged_end() || g.staged_end() >= g.count);
+    if (!joins)
+    {
+        if (auto ec = co_await write_group(g))
+            co_return ec;
+        g.staged_first = n;
+    }
+
+    std::size_t const before = g.staged();
+    std::size_t const at = (n - g.staged_first) * index_entry_size;
+    if (at >= g.staged_index.size())
+        g.staged_index.resize(at + index_entry_size);
+
+    char* entry = g.staged_index.data() + at;
+    std::memset(entry, 0, index_entry_size);
+    put(entry + offset_field, g.data_end + g.staged_data.size());
+    put(entry + length_field, static_cast<std::uint32_t>(overview.size()));
+    g.staged_data.insert(g.staged_data.end(), overview.begin(), overview.end());
+    staged_ += g.staged() - before;
+
+    if (g.staged() >= batch_size_)
+        co_return co_await write_group(g);
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+overview_db::query(
+    Newsgroup const& name,
+    ArticleRange const& range,
+    std::vector<overview_record>& records,
+    std::string& buffer)
+{
+    records.clear();
+    buffer.clear();
+
+    group* gp;
+    if (auto ec = co_await open_group(name, false, gp))
+        co_return ec;
+    if (!gp || gp->base == 0)
+        co_return std::error_code();
+    auto& g = *gp;
+    if (auto ec = co_await write_group(g))
+        co_return ec;
+
+    std::uint64_t const first = std::max(range.begin().value(), g.base) - g.base;
+    std::uint64_t last = g.count;
+    if (range.is_bounded())
+        last = range.end().value() < g.base ? 0 : std::min(last, range.end().value() - g.base + 1);
+    if (first >= last)
+        co_return std::error_code();
+
+    // The entries of the range are one contiguous region of the index
+    std::uint64_t const region = index_header_size + last * index_entry_size;
+    if (!g.map.is_open())
+    {
+        if (auto ec = g.map.open(g.index_path))
+            co_return ec;
+    }
+    if (g.map.size() < region)
+    {
+        if (auto ec = g.map.remap())
+            co_return ec;
+        if (g.map.size() < region)
+            co_return std::make_error_code(std::errc::illegal_byte_sequence);
+
+        // No view of the index outlives a query, so the mappings a
+        // growing index leaves behind can go at once
+        g.map.release_old_mappings();
+    }
+    std::size_t const entries = static_cast<std::size_t>(last - first);
+    std::byte const* index = g.map.view(
+        index_header_size + first * index_entry_size, entries * index_entry_size).data();
+
+    struct span
+    {
+        std::uint64_t offset;
+        std::uint32_t length;
+        Article::ValueType article;
+
+        /** Position of the record in buffer. */
+        std::size_t at = 0;
+    };
+    std::vector<span> spans;
+    for (std::size_t i = 0; i < entries; ++i)
+    {
+        std::byte const* entry = index + i * index_entry_size;
+        auto const length = get<std::uint32_t>(entry + length_field);
+        if (length == 0)
+            continue;
+        auto const offset = get<std::uint64_t>(entry + offset_field);
+        if (offset > g.data_end || length > g.data_end - offset)
+            co_return std::make_error_code(std::errc::illegal_byte_sequence);
+        spans.push_back({offset, length, g.base + first + i});
+    }
+    if (spans.empty())
+        co_return std::error_code();
+
+    // Records added in article order are one run of the data file.
+    // A replaced record moves to the end and leaves its old copy
+    // behind, so the records are read as runs in file order, and the
+    // bytes read beyond the records themselves stay bounded.
+    struct run
+    {
+        std::uint64_t offset;
+        std::uint64_t end;
+        std::size_t at;
+    };
+    std::vector<std::size_t> order(spans.size());
+    for (std::size_t k = 0; k < order.size(); ++k)
+        order[k] = k;
+    std::sort(order.begin(), order.end(),
+        [&](std::size_t a, std::size_t b) { return spans[a].offset < spans[b].offset; });
+
+    std::vector<run> runs;
+    std::size_t total = 0;
+    for (std::size_t k : order)
+    {
+        auto& s = spans[k];
+        if (runs.empty() || s.offset > runs.back().end + read_gap)
+        {
+            if (!runs.empty())
+                total += static_cast<std::size_t>(runs.back().end - runs.back().offset);
+            runs.push_back({s.offset, s.offset, total});
+        }
+        auto& r = runs.back();
+        r.end = std::max(r.end, s.offset + s.length);
+        s.at = r.at + static_cast<std::size_t>(s.offset - r.offset);
+    }
+    total += static_cast<std::size_t>(runs.back().end - runs.back().offset);
+
+    buffer.resize(total);
+    for (auto const& r : runs)
+    {
+        if (auto ec = co_await read_fully(g.data, r.offset, buffer.data() + r.at,
+                static_cast<std::size_t>(r.end - r.offset)))
+        {
+            buffer.clear();
+            co_return ec;
+        }
+    }
+
+    records.reserve(spans.size());
+    for (auto const& s : spans)
+        records.push_back({Article(s.article), std::string_view(buffer.data() + s.at, s.length)});
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+overview_db::write_group(group& g)
+{
+    if (g.staged_index.empty())
+        co_return std::error_code();
+
+    // Records go first, so an entry on disk never points past the
+    // end of the data file
+    if (!g.staged_data.empty())
+    {
+        if (auto ec = co_await write_fully(g.data, g.data_end, g.staged_data.data(), g.staged_data.size()))
+            co_return ec;
+        g.data_end += g.staged_data.size();
+        staged_ -= g.staged_data.size();
+        g.staged_data.clear();
+    }
+
+    if (auto ec = co_await write_fully(g.index,
+            index_header_size + g.staged_first * index_entry_size,
+            g.staged_index.data(), g.staged_index.size()))
+        co_return ec;
+    g.count = std::max(g.count, g.staged_end());
+    staged_ -= g.staged_index.size();
+    g.staged_index.clear();
+    co_return std::error_code();
+}
+
+boost::capy::task<std::error_code>
+overview_db::flush()
+{
+    std::error_code first_ec;
+    for (auto& [name, g] : groups_)
+    {
+        auto ec = co_await write_group(*g);
+        if (ec && !first_ec)
+            first_ec = ec;
+    }
+    co_return first_ec;
+}
+
+boost::capy::task<std::error_code>
+overview_db::close()
+{
+    auto ec = co_await flush();
+    groups_.clear();
+    staged_ = 0;
+    co_return ec;
+}
+
+} // namespace nntp
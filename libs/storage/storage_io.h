@@ -0,0 +1,57 @@
+#ifndef NNTP_STORAGE_IO_H
+#define NNTP_STORAGE_IO_H
+
+#include <fileio/file_stream.h>
+#include <boost/capy/buffers.hpp>
+#include <boost/capy/task.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+namespace nntp::detail {
+
+/** Store a value in a file header or record, in host byte order. */
+template<class T>
+void
+put(void* p, T value) noexcept
+{
+    std::memcpy(p, &value, sizeof(value));
+}
+
+/** Load a value stored by put. */
+template<class T>
+T
+get(void const* p) noexcept
+{
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/** Write all of a range at an offset, continuing after short writes.
+
+    @return A task yielding the write error, or std::errc::io_error
+        if a write makes no progress.
+*/
+inline boost::capy::task<std::error_code>
+write_fully(file_stream& file, std::uint64_t offset, char const* data, std::size_t size)
+{
+    std::size_t done = 0;
+    while (done < size)
+    {
+        auto [ec, n] = co_await file.write_at(
+            offset + done, boost::capy::const_buffer(data + done, size - done));
+        if (ec)
+            co_return ec;
+        if (n == 0)
+            co_return std::make_error_code(std::errc::io_error);
+        done += n;
+    }
+    co_return std::error_code();
+}
+
+} // namespace nntp::detail
+
+#endif // NNTP_STORAGE_IO_H
@@ -0,0 +1,157 @@
+#include <fileio/buffered_file_writer.h>
+#include <fileio/file_stream.h>
+#include <boost/corosio/io_context.hpp>
+#include <boost/corosio/timer.hpp>
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace nntp;
+using namespace boost;
+
+#if defined(__linux__)
+namespace
+{
+
+std::string read_all(std::filesystem::path const& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+TEST(BufferedFileWriter, InvalidArgumentsThrow)
+{
+    corosio::io_context ctx;
+    file_stream file(ctx);
+
+    EXPECT_THROW(buffered_file_writer(ctx.get_executor(), file, 0, 0), std::invalid_argument);
+    EXPECT_THROW(buffered_file_writer(ctx.get_executor(), file, 0, 1000), std::invalid_argument);
+    EXPECT_THROW(buffered_file_writer(ctx.get_executor(), file, 0, direct_io_alignment, 0), std::invalid_argument);
+}
+
+TEST(BufferedFileWriter, CoalescesSmallRecords)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_buffered_writer.dat";
+
+    std::string expected = "header";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        out << expected;
+    }
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::open_existing));
+
+        // Triple buffering with small blocks keeps several writes in flight
+        buffered_file_writer writer(ctx.get_executor(), file, expected.size(), direct_io_alignment, 3);
+        std::size_t max_in_flight = 0;
+        for (int i = 0; i < 2000; ++i)
+        {
+            std::string record = "<" + std::to_string(i) + "@example.net>\t" + std::to_string(i * 13) + "\n";
+            expected += record;
+            EXPECT_FALSE(co_await writer.write(record.data(), record.size()));
+            max_in_flight = std::max(max_in_flight, writer.in_flight());
+        }
+        EXPECT_EQ(writer.end(), expected.size());
+        EXPECT_LE(max_in_flight, 3u);
+
+        EXPECT_FALSE(co_await writer.flush());
+        EXPECT_EQ(writer.staged(), 0u);
+        EXPECT_EQ(writer.in_flight(), 0u);
+
+        // Appending after a partial block continues where it ended
+        std::string more = "tail";
+        expected += more;
+        EXPECT_FALSE(co_await writer.write(more.data(), more.size()));
+        EXPECT_FALSE(co_await writer.flush());
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    EXPECT_EQ(read_all(temp), expected);
+    std::filesystem::remove(temp);
+}
+
+TEST(BufferedFileWriter, FlushInterval)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_buffered_writer_interval.dat";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        buffered_file_writer writer(ctx.get_executor(), file);
+        writer.set_flush_interval(std::chrono::milliseconds(10));
+        EXPECT_FALSE(co_await writer.write("one\n", 4));
+        EXPECT_EQ(writer.staged(), 4u);
+
+        // The timer writes the partial block without another write()
+        corosio::timer wait(ctx);
+        wait.expires_after(std::chrono::milliseconds(200));
+        co_await wait.wait();
+        EXPECT_EQ(writer.staged(), 0u);
+        EXPECT_EQ(writer.in_flight(), 0u);
+        EXPECT_EQ(read_all(temp), "one\n");
+
+        // flush() cancels a long timer, so the context can finish
+        writer.set_flush_interval(std::chrono::hours(1));
+        EXPECT_FALSE(co_await writer.write("two\n", 4));
+        EXPECT_EQ(writer.staged(), 4u);
+        EXPECT_FALSE(co_await writer.flush());
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    EXPECT_EQ(read_all(temp), "one\ntwo\n");
+    std::filesystem::remove(temp);
+}
+
+TEST(BufferedFileWriter, WriteErrorIsSticky)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_buffered_writer_ro.dat";
+    {
+        std::ofstream out(temp, std::ios::binary);
+    }
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_only));
+
+        buffered_file_writer writer(ctx.get_executor(), file, 0, direct_io_alignment, 1);
+        std::string block(direct_io_alignment, 'x');
+        EXPECT_FALSE(co_await writer.write(block.data(), block.size()));
+
+        // The write of the full block fails on the read only file
+        auto ec = co_await writer.flush();
+        EXPECT_TRUE(ec);
+        EXPECT_EQ(co_await writer.write("more", 4), ec);
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+#endif
@@ -0,0 +1,126 @@
+#include <fileio/aligned_allocator.h>
+#include <fileio/direct_writer.h>
+#include <fileio/file_stream.h>
+#include <boost/corosio/io_context.hpp>
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace nntp;
+using namespace boost;
+
+TEST(AlignedAllocator, BufferIsAligned)
+{
+    aligned_buffer buffer(3 * direct_io_alignment);
+
+    EXPECT_TRUE(is_direct_aligned(buffer.data()));
+    EXPECT_TRUE(is_direct_aligned(buffer.size()));
+}
+
+TEST(AlignedAllocator, Rounding)
+{
+    EXPECT_EQ(direct_align_up(0), 0);
+    EXPECT_EQ(direct_align_up(1), direct_io_alignment);
+    EXPECT_EQ(direct_align_up(direct_io_alignment), direct_io_alignment);
+    EXPECT_EQ(direct_align_down(direct_io_alignment + 1), direct_io_alignment);
+    EXPECT_FALSE(is_direct_aligned(std::uint64_t{512}));
+}
+
+#if defined(__linux__)
+namespace
+{
+
+std::string read_all(std::filesystem::path const& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+TEST(DirectWriter, MisalignedOffsetThrows)
+{
+    corosio::io_context ctx;
+    file_stream file(ctx);
+
+    EXPECT_THROW(direct_writer(file, 100), std::invalid_argument);
+    EXPECT_THROW(direct_writer(file, 0, 1000), std::invalid_argument);
+}
+
+TEST(DirectWriter, AppendsAndPadsTail)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_direct_writer.dat";
+
+    std::string expected;
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        // Filesystems without O_DIRECT support (tmpfs) fall back to buffered
+        if (file.open(temp, file_stream::read_write, file_stream::create_always, file_stream::direct))
+            EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        // Records straddle the two-block staging buffer several times
+        direct_writer writer(file, 0, 2 * direct_io_alignment);
+        for (int i = 0; i < 20; ++i)
+        {
+            std::string record(1000 + i, static_cast<char>('a' + i));
+            expected += record;
+            EXPECT_FALSE(co_await writer.write(record.data(), record.size()));
+        }
+        EXPECT_EQ(writer.end(), expected.size());
+
+        // Flush twice to check the partial block is rewritten in place
+        EXPECT_FALSE(co_await writer.flush());
+        std::string more = "tail";
+        expected += more;
+        EXPECT_FALSE(co_await writer.write(more.data(), more.size()));
+        EXPECT_FALSE(co_await writer.flush());
+        EXPECT_LT(writer.staged(), direct_io_alignment);
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::string contents = read_all(temp);
+    EXPECT_EQ(contents.size(), direct_align_up(expected.size()));
+    EXPECT_EQ(contents.substr(0, expected.size()), expected);
+    EXPECT_EQ(contents.find_first_not_of('\0', expected.size()), std::string::npos);
+
+    std::filesystem::remove(temp);
+}
+
+TEST(DirectWriter, MisalignedDirectReadIsRejected)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_direct_misaligned.dat";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        if (file.open(temp, file_stream::read_write, file_stream::create_always, file_stream::direct))
+            co_return;
+
+        aligned_buffer buffer(2 * direct_io_alignment);
+        auto [ec, n] = co_await file.read_at(0, capy::mutable_buffer(buffer.data() + 1, direct_io_alignment));
+        EXPECT_EQ(ec, std::errc::invalid_argument);
+        EXPECT_EQ(n, 0);
+
+        auto [ec2, n2] = co_await file.read_at(512, capy::mutable_buffer(buffer.data(), direct_io_alignment));
+        EXPECT_EQ(ec2, std::errc::invalid_argument);
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+#endif
@@ -1,3 +1,4 @@
+#include <fileio/file_service.h>
 #include <fileio/file_stream.h>
 #include <boost/corosio/io_context.hpp>
 #include <boost/capy/ex/run_async.hpp>
@@ -5,8 +6,22 @@
 #include <boost/capy/cond.hpp>
 #include <gtest/gtest.h>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace nntp;
 using namespace boost;
@@ -281,3 +296,774 @@ TEST(FileStream, OperationsOnClosedFile)
     EXPECT_EQ(ec, std::errc::bad_file_descriptor);
 }
 
+
+#if defined(__linux__)
+TEST(FileStream, FixedBufferReadWrite)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.fixed_buffer_count = 2;
+    options.fixed_buffer_size = 64;
+    configure_file_service(ctx, options);
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_fixed.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        file.open(temp, file_stream::read_write, file_stream::create_always);
+
+        auto out = file.lease_buffer();
+        EXPECT_TRUE(out);
+        EXPECT_EQ(out.size(), 64);
+        std::memcpy(out.data(), "Registered", 10);
+        auto [write_ec, written] = co_await file.write_fixed(out, 10);
+        EXPECT_FALSE(write_ec);
+        EXPECT_EQ(written, 10);
+
+        file.seek(0);
+        auto in = file.lease_buffer();
+        auto [read_ec, n] = co_await file.read_fixed(in, in.size());
+        EXPECT_FALSE(read_ec);
+        EXPECT_EQ(n, 10);
+        EXPECT_EQ(std::string_view(static_cast<char*>(in.data()), n), "Registered");
+
+        // Both buffers are leased
+        EXPECT_FALSE(file.lease_buffer());
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, LeaseWithoutPool)
+{
+    corosio::io_context ctx;
+
+    file_stream file(ctx);
+
+    EXPECT_FALSE(file.lease_buffer());
+}
+
+TEST(FileStream, RegisteredFileTableFallback)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.registered_files = 1;
+    configure_file_service(ctx, options);
+    std::filesystem::path temp1 = std::filesystem::temp_directory_path() / "test_registered1.txt";
+    std::filesystem::path temp2 = std::filesystem::temp_directory_path() / "test_registered2.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        // The second file finds the table full and uses its descriptor
+        file_stream first(ctx);
+        file_stream second(ctx);
+        EXPECT_FALSE(first.open(temp1, file_stream::read_write, file_stream::create_always));
+        EXPECT_FALSE(second.open(temp2, file_stream::read_write, file_stream::create_always));
+
+        for (file_stream* file : {&first, &second})
+        {
+            std::string_view data = "Slot";
+            auto [write_ec, written] = co_await file->write_some(capy::const_buffer(data.data(), data.size()));
+            EXPECT_FALSE(write_ec);
+
+            file->seek(0);
+            std::array<char, 8> buffer;
+            auto [read_ec, n] = co_await file->read_some(capy::mutable_buffer(buffer.data(), buffer.size()));
+            EXPECT_FALSE(read_ec);
+            EXPECT_EQ(std::string_view(buffer.data(), n), data);
+        }
+
+        first.close();
+        second.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    auto stats = get_file_service_stats(ctx);
+    EXPECT_EQ(stats.registered_opens, 1);
+    EXPECT_EQ(stats.unregistered_opens, 1);
+
+    std::filesystem::remove(temp1);
+    std::filesystem::remove(temp2);
+}
+
+TEST(FileStream, SqpollReadsAndWrites)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.sqpoll = true;
+    options.sqpoll_idle_ms = 10;
+    configure_file_service(ctx, options);
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_sqpoll.txt";
+
+    // Whether or not the kernel grants SQPOLL, plain descriptors work
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        std::string data(8192, 's');
+        auto [write_ec, written] = co_await file.write_at(0, capy::const_buffer(data.data(), data.size()));
+        EXPECT_FALSE(write_ec);
+        EXPECT_EQ(written, data.size());
+
+        std::string_view tail = "tail";
+        file.seek(data.size());
+        auto [append_ec, appended] = co_await file.write_some(capy::const_buffer(tail.data(), tail.size()));
+        EXPECT_FALSE(append_ec);
+        EXPECT_EQ(appended, tail.size());
+
+        std::string buffer(data.size() + tail.size(), '\0');
+        auto [read_ec, n] = co_await file.read_at(0, capy::mutable_buffer(buffer.data(), buffer.size()));
+        EXPECT_FALSE(read_ec);
+        EXPECT_EQ(n, buffer.size());
+        EXPECT_EQ(buffer, data + std::string(tail));
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, ConcurrentPositionalIo)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_positional.txt";
+    constexpr std::size_t blocks = 16;
+    constexpr std::size_t block_size = 256;
+
+    file_stream file(ctx);
+    ASSERT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+    // Every block is written and read back by its own coroutine, all
+    // sharing one file_stream
+    std::vector<std::string> out(blocks);
+    std::vector<std::string> in(blocks, std::string(block_size, '\0'));
+    int finished = 0;
+    auto task = [&](std::size_t i) -> capy::task<>
+    {
+        out[i] = std::string(block_size, static_cast<char>('a' + i));
+        auto [write_ec, written] = co_await file.write_at(i * block_size, capy::const_buffer(out[i].data(), out[i].size()));
+        EXPECT_FALSE(write_ec);
+        EXPECT_EQ(written, block_size);
+
+        auto [read_ec, n] = co_await file.read_at(i * block_size, capy::mutable_buffer(in[i].data(), in[i].size()));
+        EXPECT_FALSE(read_ec);
+        EXPECT_EQ(n, block_size);
+        ++finished;
+    };
+
+    for (std::size_t i = 0; i < blocks; ++i)
+        capy::run_async(ctx.get_executor())(task(i));
+    ctx.run();
+
+    EXPECT_EQ(finished, blocks);
+    EXPECT_EQ(in, out);
+
+    // The file position is untouched by positional I/O
+    EXPECT_EQ(file.tell(), 0);
+
+    file.close();
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, CompletionsHarvestedInBatches)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_batches.txt";
+    constexpr std::size_t readers = 32;
+    constexpr std::size_t block_size = 128;
+    {
+        std::ofstream out(temp, std::ios::binary);
+        for (std::size_t i = 0; i < readers; ++i)
+            out << std::string(block_size, static_cast<char>('a' + i % 26));
+    }
+
+    file_stream file(ctx);
+    ASSERT_FALSE(file.open(temp, file_stream::read_only));
+
+    // Reads started in one turn complete close together, so most polls
+    // find several completions and each result reaches its own reader
+    std::vector<std::string> in(readers, std::string(block_size, '\0'));
+    auto task = [&](std::size_t i) -> capy::task<>
+    {
+        auto [ec, n] = co_await file.read_at(i * block_size, capy::mutable_buffer(in[i].data(), in[i].size()));
+        EXPECT_FALSE(ec);
+        EXPECT_EQ(n, block_size);
+    };
+
+    for (std::size_t i = 0; i < readers; ++i)
+        capy::run_async(ctx.get_executor())(task(i));
+    ctx.run();
+
+    for (std::size_t i = 0; i < readers; ++i)
+        EXPECT_EQ(in[i], std::string(block_size, static_cast<char>('a' + i % 26)));
+
+    auto stats = get_file_service_stats(ctx);
+    EXPECT_EQ(stats.completions, readers);
+    EXPECT_GE(stats.completion_batches, 1u);
+    EXPECT_LE(stats.completion_batches, stats.completions);
+
+    file.close();
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, DestroyWithReadsPending)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_destroy_pending.txt";
+    constexpr std::size_t readers = 8;
+    {
+        std::ofstream out(temp, std::ios::binary);
+        out << std::string(readers * 64, 'x');
+    }
+
+    auto file = std::make_unique<file_stream>(ctx);
+    ASSERT_FALSE(file->open(temp, file_stream::read_only));
+
+    // The operations keep the file's state alive after the stream is
+    // gone, and finish either with their data or as canceled
+    std::vector<std::array<char, 64>> buffers(readers);
+    int finished = 0;
+    auto reader = [&](file_stream& f, std::size_t i) -> capy::task<>
+    {
+        auto [ec, n] = co_await f.read_at(i * 64, capy::mutable_buffer(buffers[i].data(), buffers[i].size()));
+        if (ec)
+            EXPECT_EQ(ec, capy::cond::canceled);
+        else
+            EXPECT_EQ(n, 64u);
+        ++finished;
+    };
+    auto destroyer = [&]() -> capy::task<>
+    {
+        file.reset();
+        co_return;
+    };
+
+    for (std::size_t i = 0; i < readers; ++i)
+        capy::run_async(ctx.get_executor())(reader(*file, i));
+    capy::run_async(ctx.get_executor())(destroyer());
+    ctx.run();
+
+    EXPECT_EQ(finished, readers);
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, ReadAtEndOfFile)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_read_at_eof.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        std::array<char, 8> buffer;
+        auto [ec, n] = co_await file.read_at(1024, capy::mutable_buffer(buffer.data(), buffer.size()));
+        EXPECT_EQ(ec, capy::cond::eof);
+        EXPECT_EQ(n, 0);
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, GatherWriteScatterRead)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_gather.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        // Header, body and trailer go out as one writev
+        std::string_view header = "Message-ID: <a@b>\r\n\r\n";
+        std::string_view body = "body\r\n";
+        std::string_view trailer = ".\r\n";
+        std::array<capy::const_buffer, 3> segments = {
+            capy::const_buffer(header.data(), header.size()),
+            capy::const_buffer(body.data(), body.size()),
+            capy::const_buffer(trailer.data(), trailer.size())};
+        auto [write_ec, written] = co_await file.write_some(segments);
+        EXPECT_FALSE(write_ec);
+        EXPECT_EQ(written, header.size() + body.size() + trailer.size());
+        EXPECT_EQ(file.tell(), written);
+
+        // Read it back split across two buffers with one readv
+        file.seek(0);
+        std::array<char, 10> first;
+        std::array<char, 64> second;
+        std::array<capy::mutable_buffer, 2> parts = {
+            capy::mutable_buffer(first.data(), first.size()),
+            capy::mutable_buffer(second.data(), second.size())};
+        auto [read_ec, n] = co_await file.read_some(parts);
+        EXPECT_FALSE(read_ec);
+        EXPECT_EQ(n, written);
+        std::string joined = std::string(first.data(), first.size()) + std::string(second.data(), n - first.size());
+        EXPECT_EQ(joined, std::string(header) + std::string(body) + std::string(trailer));
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, AsyncFileManagement)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_async_manage.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        auto [open_ec, unused] = co_await file.async_open(temp, file_stream::read_write, file_stream::create_always);
+        EXPECT_FALSE(open_ec);
+        EXPECT_TRUE(file.is_open());
+
+        std::string_view data = "Durable";
+        auto [write_ec, written] = co_await file.write_some(capy::const_buffer(data.data(), data.size()));
+        EXPECT_FALSE(write_ec);
+        auto [sync_ec, unused2] = co_await file.fdatasync();
+        EXPECT_FALSE(sync_ec);
+
+        auto [size_ec, size] = co_await file.async_size();
+        EXPECT_FALSE(size_ec);
+        EXPECT_EQ(size, data.size());
+
+        auto [alloc_ec, unused3] = co_await file.fallocate(0, 65536);
+        if (alloc_ec != std::errc::operation_not_supported)
+        {
+            EXPECT_FALSE(alloc_ec);
+            auto [grown_ec, grown] = co_await file.async_size();
+            EXPECT_EQ(grown, 65536);
+        }
+
+        auto [fsync_ec, unused4] = co_await file.fsync();
+        EXPECT_FALSE(fsync_ec);
+
+        auto [close_ec, unused5] = co_await file.async_close();
+        EXPECT_FALSE(close_ec);
+        EXPECT_FALSE(file.is_open());
+
+        auto [closed_ec, unused6] = co_await file.fsync();
+        EXPECT_EQ(closed_ec, std::errc::bad_file_descriptor);
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, AdviseAndPrefetch)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_advise.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        std::string data(64 * 1024, 'a');
+        auto [write_ec, written] = co_await file.write_at(0, capy::const_buffer(data.data(), data.size()));
+        EXPECT_FALSE(write_ec);
+
+        auto [seq_ec, unused] = co_await file.advise(file_stream::sequential);
+        EXPECT_FALSE(seq_ec);
+        auto [prefetch_ec, unused2] = co_await file.prefetch(4096, 32768);
+        EXPECT_FALSE(prefetch_ec);
+        auto [random_ec, unused3] = co_await file.advise(file_stream::random, 0, 1ull << 40);
+        EXPECT_FALSE(random_ec);
+
+        // Dropping clean pages is only advice; the data must read back
+        auto [drop_ec, unused4] = co_await file.advise(file_stream::dontneed);
+        EXPECT_FALSE(drop_ec);
+
+        std::array<char, 16> buffer;
+        auto [read_ec, n] = co_await file.read_at(60000, capy::mutable_buffer(buffer.data(), buffer.size()));
+        EXPECT_FALSE(read_ec);
+        EXPECT_EQ(n, buffer.size());
+        EXPECT_EQ(std::string_view(buffer.data(), n), std::string(16, 'a'));
+
+        file.close();
+        auto [closed_ec, unused5] = co_await file.prefetch(0, 4096);
+        EXPECT_EQ(closed_ec, std::errc::bad_file_descriptor);
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, AsyncOpenMissingFile)
+{
+    corosio::io_context ctx;
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        auto [ec, unused] = co_await file.async_open("/nonexistent/path/file.txt", file_stream::read_only);
+        EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+        EXPECT_FALSE(file.is_open());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+}
+
+TEST(FileStream, CloseDuringAsyncOpen)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_close_during_open.txt";
+    file_stream file(ctx);
+
+    // A close issued while the open is in flight must stick
+    auto opener = [&]() -> capy::task<>
+    {
+        auto [ec, unused] = co_await file.async_open(temp, file_stream::read_write, file_stream::create_always);
+        EXPECT_EQ(ec, capy::cond::canceled);
+        EXPECT_FALSE(file.is_open());
+    };
+    auto closer = [&]() -> capy::task<>
+    {
+        auto [open_ec, unused] = co_await file.async_open(temp, file_stream::read_only);
+        EXPECT_EQ(open_ec, std::errc::operation_in_progress);
+        auto [close_ec, unused2] = co_await file.async_close();
+        EXPECT_EQ(close_ec, std::errc::operation_in_progress);
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(opener());
+    capy::run_async(ctx.get_executor())(closer());
+    ctx.run();
+
+    EXPECT_FALSE(file.is_open());
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, CloseSubmitsPreparedReads)
+{
+    corosio::io_context ctx;
+    std::filesystem::path first = std::filesystem::temp_directory_path() / "test_close_prepared_a.txt";
+    std::filesystem::path second = std::filesystem::temp_directory_path() / "test_close_prepared_b.txt";
+    {
+        std::ofstream(first, std::ios::binary) << "AAAA";
+        std::ofstream(second, std::ios::binary) << "BBBB";
+    }
+
+    file_stream file(ctx);
+    file_stream other(ctx);
+    ASSERT_FALSE(file.open(first, file_stream::read_only));
+
+    // The read is prepared but not yet submitted when the file closes
+    // and its descriptor number goes to the next file opened
+    auto reader = [&]() -> capy::task<>
+    {
+        std::array<char, 4> buffer;
+        auto [ec, n] = co_await file.read_at(0, capy::mutable_buffer(buffer.data(), buffer.size()));
+        if (!ec)
+            EXPECT_EQ(std::string_view(buffer.data(), n), "AAAA");
+    };
+    auto closer = [&]() -> capy::task<>
+    {
+        file.close();
+        EXPECT_FALSE(other.open(second, file_stream::read_only));
+        co_return;
+    };
+
+    capy::run_async(ctx.get_executor())(reader());
+    capy::run_async(ctx.get_executor())(closer());
+    ctx.run();
+
+    other.close();
+    std::filesystem::remove(first);
+    std::filesystem::remove(second);
+}
+
+TEST(FileStream, DurableWritesShareSync)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_durable.txt";
+    constexpr std::size_t writers = 8;
+    constexpr std::size_t record_size = 100;
+
+    file_stream file(ctx);
+    ASSERT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+    std::vector<std::string> records(writers);
+    int finished = 0;
+    auto task = [&](std::size_t i) -> capy::task<>
+    {
+        records[i] = std::string(record_size, static_cast<char>('A' + i));
+        auto [ec, n] = co_await file.write_durable_at(i * record_size, capy::const_buffer(records[i].data(), records[i].size()));
+        EXPECT_FALSE(ec);
+        EXPECT_EQ(n, record_size);
+        ++finished;
+    };
+
+    for (std::size_t i = 0; i < writers; ++i)
+        capy::run_async(ctx.get_executor())(task(i));
+    ctx.run();
+
+    EXPECT_EQ(finished, writers);
+
+    // Writers started in the same turn commit with one fdatasync
+    auto stats = get_file_service_stats(ctx);
+    EXPECT_LT(stats.submitted, 2 * writers);
+
+    file.close();
+    std::ifstream in(temp, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::string expected;
+    for (auto const& record : records)
+        expected += record;
+    EXPECT_EQ(contents, expected);
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, RingPerThread)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.ring_per_thread = true;
+    configure_file_service(ctx, options);
+
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_ring_per_thread.txt";
+    constexpr std::size_t blocks = 32;
+    constexpr std::size_t block_size = 512;
+    constexpr std::size_t threads = 4;
+    {
+        std::ofstream out(temp, std::ios::binary);
+        for (std::size_t i = 0; i < blocks; ++i)
+            out << std::string(block_size, static_cast<char>('a' + i % 26));
+    }
+
+    // Readers resume on the thread whose flush or readiness event
+    // harvested their completion, and start their next read on that
+    // thread's ring. Each has its own stream, since a stream is
+    // driven by one thread at a time.
+    std::atomic<std::size_t> matched{0};
+    auto task = [&](std::size_t first) -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_only));
+
+        std::string buffer(block_size, '\0');
+        for (std::size_t k = 0; k < blocks; ++k)
+        {
+            std::size_t i = (first + k) % blocks;
+            auto [ec, n] = co_await file.read_at(i * block_size, capy::mutable_buffer(buffer.data(), buffer.size()));
+            EXPECT_FALSE(ec);
+            EXPECT_EQ(n, block_size);
+            if (buffer == std::string(block_size, static_cast<char>('a' + i % 26)))
+                ++matched;
+        }
+        file.close();
+    };
+
+    for (std::size_t i = 0; i < blocks; ++i)
+        capy::run_async(ctx.get_executor())(task(i));
+
+    std::vector<std::thread> runners;
+    for (std::size_t t = 1; t < threads; ++t)
+        runners.emplace_back([&] { ctx.run(); });
+    ctx.run();
+    for (auto& runner : runners)
+        runner.join();
+
+    EXPECT_EQ(matched, blocks * blocks);
+
+    auto stats = get_file_service_stats(ctx);
+    EXPECT_GE(stats.rings, 1u);
+    EXPECT_LE(stats.rings, threads);
+    EXPECT_EQ(stats.completions, blocks * blocks);
+    EXPECT_LE(stats.owner_completions, stats.completions);
+
+    std::filesystem::remove(temp);
+}
+
+namespace
+{
+
+// Stands in for a corosio socket: splice_to only needs the descriptor
+struct native_socket
+{
+    int fd;
+    int native_handle() const noexcept { return fd; }
+};
+
+void splice_article(bool splice)
+{
+    corosio::io_context ctx;
+    file_service_options options;
+    options.splice = splice;
+    configure_file_service(ctx, options);
+
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_splice.txt";
+    std::string article;
+    for (std::size_t i = 0; article.size() < 1024 * 1024 + 123; ++i)
+        article += "line " + std::to_string(i) + "\r\n";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        out << "header" << article;
+    }
+
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+
+    // The peer drains the socket until the sender closes it
+    std::string received;
+    std::thread peer([&]
+    {
+        char buffer[65536];
+        for (;;)
+        {
+            auto n = ::read(fds[1], buffer, sizeof(buffer));
+            if (n <= 0)
+                break;
+            received.append(buffer, static_cast<std::size_t>(n));
+        }
+    });
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_only));
+        native_socket sock{fds[0]};
+
+        auto [ec, n] = co_await file.splice_to(sock, 6, article.size());
+        EXPECT_FALSE(ec);
+        EXPECT_EQ(n, article.size());
+
+        // A range past the end sends what there is
+        auto [eof_ec, tail] = co_await file.splice_to(sock, 6 + article.size() - 10, 100);
+        EXPECT_EQ(eof_ec, capy::cond::eof);
+        EXPECT_EQ(tail, 10u);
+
+        auto [empty_ec, none] = co_await file.splice_to(sock, 0, 0);
+        EXPECT_FALSE(empty_ec);
+        EXPECT_EQ(none, 0u);
+
+        file.close();
+        auto [closed_ec, unused] = co_await file.splice_to(sock, 0, 10);
+        EXPECT_EQ(closed_ec, std::errc::bad_file_descriptor);
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    ::close(fds[0]);
+    peer.join();
+    ::close(fds[1]);
+
+    EXPECT_EQ(received, article + article.substr(article.size() - 10));
+    if (!splice)
+        EXPECT_EQ(get_file_service_stats(ctx).splice_fallbacks, 0u);
+
+    std::filesystem::remove(temp);
+}
+
+} // namespace
+
+TEST(FileStream, SpliceToSocket)
+{
+    splice_article(true);
+}
+
+TEST(FileStream, SpliceToSocketCopying)
+{
+    splice_article(false);
+}
+
+TEST(FileStream, TimedReadsAndWrites)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_timed.txt";
+
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write, file_stream::create_always));
+
+        // Operations that finish in time are unaffected by the limit
+        std::string data = "timed data";
+        auto [ec, n] = co_await file.write_some(capy::const_buffer(data.data(), data.size()), std::chrono::seconds(5));
+        EXPECT_FALSE(ec);
+        EXPECT_EQ(n, data.size());
+        EXPECT_EQ(file.tell(), data.size());
+
+        file.seek(0);
+        std::array<char, 5> buffer;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        auto [ec2, n2] = co_await file.read_some(capy::mutable_buffer(buffer.data(), buffer.size()), deadline);
+        EXPECT_FALSE(ec2);
+        EXPECT_EQ(std::string(buffer.data(), n2), "timed");
+        EXPECT_EQ(file.tell(), 5u);
+
+        auto [ec3, n3] = co_await file.read_at(6, capy::mutable_buffer(buffer.data(), buffer.size()), std::chrono::seconds(5));
+        EXPECT_FALSE(ec3);
+        EXPECT_EQ(std::string(buffer.data(), n3), "data");
+        EXPECT_EQ(file.tell(), 5u);
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+
+TEST(FileStream, TimedReadOfStalledFile)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_timed.fifo";
+    std::filesystem::remove(temp);
+    ASSERT_EQ(::mkfifo(temp.c_str(), 0600), 0);
+
+    auto task = [&]() -> capy::task<>
+    {
+        // A FIFO nobody writes to stands in for a stalled device;
+        // opened for both directions, the open does not wait
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_write));
+
+        std::array<char, 16> buffer;
+        auto start = std::chrono::steady_clock::now();
+        auto [ec, n] = co_await file.read_some(capy::mutable_buffer(buffer.data(), buffer.size()), std::chrono::milliseconds(50));
+        EXPECT_EQ(ec, std::errc::timed_out);
+        EXPECT_EQ(n, 0);
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+        EXPECT_EQ(file.tell(), 0u);
+
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove(temp);
+}
+#endif
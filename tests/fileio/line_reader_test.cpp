@@ -0,0 +1,158 @@
+#include <fileio/line_reader.h>
+#include <fileio/file_stream.h>
+#include <fileio/test/mock_file_stream.h>
+#include <boost/corosio/io_context.hpp>
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <boost/capy/cond.hpp>
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace nntp;
+using namespace boost;
+
+namespace
+{
+
+// Read every line, then check the reader stays at EOF
+template<class Stream>
+capy::task<> read_lines(Stream& stream, std::size_t read_size, std::vector<std::string>& lines)
+{
+    line_reader<Stream> reader(stream, read_size);
+    std::string_view line;
+    std::error_code ec;
+    while (!(ec = co_await reader.read_line(line)))
+        lines.emplace_back(line);
+    EXPECT_EQ(ec, capy::cond::eof);
+    EXPECT_EQ(reader.line_number(), lines.size());
+    EXPECT_EQ(co_await reader.read_line(line), capy::cond::eof);
+    EXPECT_TRUE(line.empty());
+}
+
+std::vector<std::string> read_mock(std::string const& data, std::size_t read_size, std::size_t max_read_size)
+{
+    corosio::io_context ctx;
+    capy::test::fuse f;
+    test::mock_file_stream mock(f, max_read_size);
+    mock.provide(data);
+    EXPECT_FALSE(mock.open("newsrc", file_stream::read_only));
+
+    std::vector<std::string> lines;
+    capy::run_async(ctx.get_executor())(read_lines(mock, read_size, lines));
+    ctx.run();
+
+    EXPECT_FALSE(mock.close());
+    return lines;
+}
+
+} // namespace
+
+TEST(LineReader, SplitsLfAndCrlfLines)
+{
+    auto lines = read_mock("[server]\r\nhost=news\n\n# comment\r\n\r\nlast", 1024, std::size_t(-1));
+    std::vector<std::string> expected{"[server]", "host=news", "", "# comment", "", "last"};
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(LineReader, EmptyStream)
+{
+    auto lines = read_mock("", 1024, std::size_t(-1));
+    EXPECT_TRUE(lines.empty());
+}
+
+TEST(LineReader, FinalTerminatorEndsLastLine)
+{
+    auto lines = read_mock("one\ntwo\n", 1024, std::size_t(-1));
+    std::vector<std::string> expected{"one", "two"};
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(LineReader, LinesStraddleReads)
+{
+    // Reads of 3 bytes split every line, and a CRLF, across reads
+    auto lines = read_mock("alt.test y 1-10\r\ncomp.lang.c++ n 5\nx\r\n", 1024, 3);
+    std::vector<std::string> expected{"alt.test y 1-10", "comp.lang.c++ n 5", "x"};
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(LineReader, LineLongerThanBuffer)
+{
+    std::string longer(100, 'a');
+    auto lines = read_mock("ab\n" + longer + "\r\ncd\n" + longer, 8, std::size_t(-1));
+    std::vector<std::string> expected{"ab", longer, "cd", longer};
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(LineReader, RejectsZeroReadSize)
+{
+    capy::test::fuse f;
+    test::mock_file_stream mock(f);
+    EXPECT_THROW(line_reader<test::mock_file_stream>(mock, 0), std::invalid_argument);
+    EXPECT_THROW(line_reader<test::mock_file_stream>(mock, 8, 0), std::invalid_argument);
+}
+
+TEST(LineReader, LineLongerThanLimit)
+{
+    auto lines = read_mock("0123456789\r\nabc\n", 4, std::size_t(-1));
+    std::vector<std::string> expected{"0123456789", "abc"};
+    EXPECT_EQ(lines, expected);
+
+    corosio::io_context ctx;
+    capy::test::fuse f;
+    test::mock_file_stream mock(f, 3);
+    mock.provide("0123456789\r\n" + std::string(1000, 'b'));
+    EXPECT_FALSE(mock.open("newsrc", file_stream::read_only));
+
+    auto task = [&]() -> capy::task<>
+    {
+        line_reader<test::mock_file_stream> reader(mock, 4, 10);
+        std::string_view line;
+
+        // The CR is part of the terminator, so the line fits exactly
+        EXPECT_FALSE(co_await reader.read_line(line));
+        EXPECT_EQ(line, "0123456789");
+
+        // The long line is rejected without buffering all of it
+        EXPECT_EQ(co_await reader.read_line(line), std::errc::value_too_large);
+        EXPECT_TRUE(line.empty());
+        EXPECT_LT(mock.tell(), 100u);
+    };
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+}
+
+TEST(LineReader, ReadsFileStream)
+{
+    corosio::io_context ctx;
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_line_reader.txt";
+
+    std::vector<std::string> expected;
+    {
+        std::ofstream out(temp, std::ios::binary);
+        for (int i = 0; i < 5000; ++i)
+        {
+            expected.push_back("group." + std::to_string(i) + ": 1-" + std::to_string(i * 7));
+            out << expected.back() << (i % 2 ? "\r\n" : "\n");
+        }
+    }
+
+    std::vector<std::string> lines;
+    auto task = [&]() -> capy::task<>
+    {
+        file_stream file(ctx);
+        EXPECT_FALSE(file.open(temp, file_stream::read_only));
+
+        // A small buffer makes lines straddle many reads
+        co_await read_lines(file, 4096, lines);
+        file.close();
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    EXPECT_EQ(lines, expected);
+    std::filesystem::remove(temp);
+}
@@ -0,0 +1,163 @@
+#include <fileio/mapped_file.h>
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+
+using namespace nntp;
+
+namespace
+{
+
+void write_file(std::filesystem::path const& path, std::string const& contents, bool append = false)
+{
+    std::ofstream out(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    out << contents;
+}
+
+std::string as_string(std::span<std::byte const> bytes)
+{
+    return std::string(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+}
+
+} // namespace
+
+TEST(MappedFile, ViewsFileContents)
+{
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_mapped.txt";
+    write_file(temp, "Hello, mapped world!");
+
+    mapped_file file;
+    ASSERT_FALSE(file.open(temp));
+    EXPECT_TRUE(file.is_open());
+    EXPECT_EQ(file.size(), 20u);
+    EXPECT_EQ(as_string(file.data()), "Hello, mapped world!");
+    EXPECT_EQ(as_string(file.view(7, 6)), "mapped");
+
+    // Views are clipped to the end of the file
+    EXPECT_EQ(as_string(file.view(14, 100)), "world!");
+    EXPECT_TRUE(file.view(20, 1).empty());
+    EXPECT_TRUE(file.view(1000, 1).empty());
+
+    file.close();
+    EXPECT_FALSE(file.is_open());
+    EXPECT_TRUE(file.data().empty());
+    std::filesystem::remove(temp);
+}
+
+TEST(MappedFile, EmptyFile)
+{
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_mapped_empty.txt";
+    write_file(temp, "");
+
+    mapped_file file;
+    ASSERT_FALSE(file.open(temp));
+    EXPECT_TRUE(file.is_open());
+    EXPECT_EQ(file.size(), 0u);
+    EXPECT_TRUE(file.data().empty());
+    EXPECT_FALSE(file.advise(mapped_file::random));
+
+    file.close();
+    std::filesystem::remove(temp);
+}
+
+TEST(MappedFile, OpenMissingFile)
+{
+    mapped_file file;
+    EXPECT_TRUE(file.open("/nonexistent/path/to/file.txt"));
+    EXPECT_FALSE(file.is_open());
+}
+
+TEST(MappedFile, Advise)
+{
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_mapped_advise.txt";
+    write_file(temp, std::string(64 * 1024, 'x'));
+
+    mapped_file file;
+    ASSERT_FALSE(file.open(temp, mapped_file::populate));
+    EXPECT_FALSE(file.advise(mapped_file::random));
+    EXPECT_FALSE(file.advise(mapped_file::willneed, 5000, 10000));
+    EXPECT_FALSE(file.advise(mapped_file::sequential, 0, 1 << 30));
+    EXPECT_FALSE(file.advise(mapped_file::normal));
+    EXPECT_EQ(file.view(60000, 1)[0], std::byte{'x'});
+
+    file.close();
+    std::filesystem::remove(temp);
+}
+
+TEST(MappedFile, RemapAfterGrowth)
+{
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_mapped_grow.txt";
+    write_file(temp, "first");
+
+    mapped_file file;
+    ASSERT_FALSE(file.open(temp));
+    auto before = file.view(0, 5);
+
+    bool grew = true;
+    EXPECT_FALSE(file.remap(&grew));
+    EXPECT_FALSE(grew);
+
+    write_file(temp, "+second", true);
+    EXPECT_FALSE(file.remap(&grew));
+    EXPECT_TRUE(grew);
+    EXPECT_EQ(file.size(), 12u);
+    EXPECT_EQ(as_string(file.data()), "first+second");
+
+    // Views taken before the remap are still readable
+    EXPECT_EQ(as_string(before), "first");
+
+    file.close();
+    std::filesystem::remove(temp);
+}
+
+TEST(MappedFile, ReleaseOldMappings)
+{
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_mapped_release.txt";
+    write_file(temp, "0");
+
+    // Growing many times over maps again and again; releasing the
+    // old mappings leaves the current view intact
+    mapped_file file;
+    ASSERT_FALSE(file.open(temp));
+    std::string expected = "0";
+    for (int i = 0; i < 8; ++i)
+    {
+        std::string more(expected.size() * 3, static_cast<char>('a' + i));
+        write_file(temp, more, true);
+        expected += more;
+
+        auto current = file.view(0, 1);
+        bool grew = false;
+        EXPECT_FALSE(file.remap(&grew));
+        EXPECT_TRUE(grew);
+        EXPECT_EQ(as_string(current), "0");
+        file.release_old_mappings();
+        EXPECT_EQ(file.size(), expected.size());
+        EXPECT_EQ(as_string(file.data()), expected);
+    }
+
+    file.close();
+    std::filesystem::remove(temp);
+}
+
+TEST(MappedFile, Move)
+{
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / "test_mapped_move.txt";
+    write_file(temp, "moved");
+
+    mapped_file a;
+    ASSERT_FALSE(a.open(temp));
+    mapped_file b(std::move(a));
+    EXPECT_FALSE(a.is_open());
+    EXPECT_EQ(as_string(b.data()), "moved");
+
+    mapped_file c;
+    c = std::move(b);
+    EXPECT_FALSE(b.is_open());
+    EXPECT_EQ(as_string(c.data()), "moved");
+
+    c.close();
+    std::filesystem::remove(temp);
+}
@@ -0,0 +1,270 @@
+#include <nntp/CommandPipeline.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace nntp;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+using Clock = CommandPipeline::Clock;
+
+const Clock::time_point T0{std::chrono::hours(1)};
+
+PipelineLimits fixed_window(std::size_t depth)
+{
+    PipelineLimits result;
+    result.floor = depth;
+    result.ceiling = depth;
+    result.initial = depth;
+    return result;
+}
+
+} // namespace
+
+TEST(TestCommandPipelineSubmit, assignsIncreasingIds)
+{
+    CommandPipeline pipeline;
+
+    const RequestId first = pipeline.submit("HEAD 1");
+    const RequestId second = pipeline.submit("HEAD 2");
+
+    EXPECT_LT(first, second);
+    EXPECT_EQ(2U, pipeline.queued());
+    EXPECT_EQ(0U, pipeline.in_flight());
+}
+
+TEST(TestCommandPipelineSubmit, emptyCommandThrows)
+{
+    CommandPipeline pipeline;
+
+    EXPECT_THROW(pipeline.submit(""), std::invalid_argument);
+}
+
+TEST(TestCommandPipelineSubmit, embeddedLineBreakThrows)
+{
+    CommandPipeline pipeline;
+
+    EXPECT_THROW(pipeline.submit("HEAD 1\r\nQUIT"), std::invalid_argument);
+}
+
+TEST(TestCommandPipelineSubmit, overlongCommandThrows)
+{
+    CommandPipeline pipeline;
+
+    EXPECT_NO_THROW(pipeline.submit(std::string(510, 'X')));
+    EXPECT_THROW(pipeline.submit(std::string(511, 'X')), std::invalid_argument);
+}
+
+TEST(TestCommandPipelineSend, appendsCrLf)
+{
+    CommandPipeline pipeline;
+    const RequestId id = pipeline.submit("ARTICLE <a@b>");
+
+    auto command = pipeline.send_next(T0);
+
+    ASSERT_TRUE(command);
+    EXPECT_EQ(id, command->id);
+    EXPECT_EQ("ARTICLE <a@b>\r\n", command->line);
+}
+
+TEST(TestCommandPipelineSend, emptyQueueSendsNothing)
+{
+    CommandPipeline pipeline;
+
+    EXPECT_FALSE(pipeline.send_next(T0));
+}
+
+TEST(TestCommandPipelineSend, windowLimitsCommandsInFlight)
+{
+    CommandPipeline pipeline(fixed_window(2));
+    pipeline.submit("HEAD 1");
+    pipeline.submit("HEAD 2");
+    pipeline.submit("HEAD 3");
+
+    EXPECT_TRUE(pipeline.send_next(T0));
+    EXPECT_TRUE(pipeline.send_next(T0));
+    EXPECT_FALSE(pipeline.send_next(T0));
+    EXPECT_EQ(2U, pipeline.in_flight());
+    EXPECT_EQ(1U, pipeline.queued());
+}
+
+TEST(TestCommandPipelineSend, lineStaysValidWhileInFlight)
+{
+    CommandPipeline pipeline(fixed_window(4));
+    pipeline.submit("HEAD 1");
+    pipeline.submit("HEAD 2");
+
+    auto first = pipeline.send_next(T0);
+    auto second = pipeline.send_next(T0);
+    pipeline.submit("HEAD 3");
+    pipeline.send_next(T0);
+
+    EXPECT_EQ("HEAD 1\r\n", first->line);
+    EXPECT_EQ("HEAD 2\r\n", second->line);
+}
+
+TEST(TestCommandPipelineComplete, correlatesInOrder)
+{
+    CommandPipeline pipeline(fixed_window(4));
+    const RequestId first = pipeline.submit("HEAD 1");
+    const RequestId second = pipeline.submit("HEAD 2");
+    pipeline.send_next(T0);
+    pipeline.send_next(T0);
+
+    EXPECT_EQ(first, pipeline.complete(T0 + 10ms, 100));
+    EXPECT_EQ(second, pipeline.complete(T0 + 11ms, 100));
+    EXPECT_TRUE(pipeline.idle());
+}
+
+TEST(TestCommandPipelineComplete, freesWindowSlot)
+{
+    CommandPipeline pipeline(fixed_window(1));
+    pipeline.submit("HEAD 1");
+    pipeline.submit("HEAD 2");
+    pipeline.send_next(T0);
+    ASSERT_FALSE(pipeline.send_next(T0));
+
+    pipeline.complete(T0 + 10ms, 100);
+
+    EXPECT_TRUE(pipeline.send_next(T0 + 10ms));
+}
+
+TEST(TestCommandPipelineComplete, withoutCommandInFlightThrows)
+{
+    CommandPipeline pipeline;
+
+    EXPECT_THROW(pipeline.complete(T0, 0), std::logic_error);
+}
+
+TEST(TestCommandPipelineMetrics, windowGrowsForBulkFetch)
+{
+    CommandPipeline pipeline;
+    for (int i = 1; i <= 200; ++i)
+    {
+        pipeline.submit("HEAD " + std::to_string(i));
+    }
+
+    Clock::time_point now = T0;
+    while (!pipeline.idle())
+    {
+        std::size_t sent = 0;
+        while (pipeline.send_next(now))
+        {
+            ++sent;
+        }
+        now += 30ms;
+        for (std::size_t i = 0; i < sent; ++i)
+        {
+            pipeline.complete(now, 500);
+        }
+    }
+
+    const PipelineMetrics metrics = pipeline.metrics();
+    EXPECT_GT(metrics.depth, 2U);
+    EXPECT_EQ(200U, metrics.responses);
+    EXPECT_EQ(30000, metrics.min_rtt.count());
+}
+
+TEST(TestCommandPipelineCancel, queuedCommandIsDropped)
+{
+    CommandPipeline pipeline;
+    const RequestId first = pipeline.submit("HEAD 1");
+    const RequestId second = pipeline.submit("HEAD 2");
+
+    EXPECT_TRUE(pipeline.cancel(first));
+
+    auto command = pipeline.send_next(T0);
+    ASSERT_TRUE(command);
+    EXPECT_EQ(second, command->id);
+    EXPECT_EQ(1U, pipeline.dropped());
+}
+
+TEST(TestCommandPipelineCancel, inFlightCommandIsDiscarded)
+{
+    CommandPipeline pipeline;
+    const RequestId id = pipeline.submit("HEAD 1");
+    pipeline.send_next(T0);
+
+    EXPECT_TRUE(pipeline.cancel(id));
+
+    EXPECT_TRUE(pipeline.discarding());
+    EXPECT_EQ(id, pipeline.complete(T0 + 10ms, 40));
+    EXPECT_EQ(1U, pipeline.discarded());
+}
+
+TEST(TestCommandPipelineCancel, unknownIdIsNotCancelled)
+{
+    CommandPipeline pipeline;
+    const RequestId id = pipeline.submit("HEAD 1");
+    pipeline.send_next(T0);
+    pipeline.complete(T0 + 10ms, 40);
+
+    EXPECT_FALSE(pipeline.cancel(id));
+    EXPECT_FALSE(pipeline.cancel(id + 100));
+}
+
+TEST(TestCommandPipelineCancel, stoppedTokenSkipsQueuedCommands)
+{
+    CommandPipeline pipeline;
+    std::stop_source group;
+    pipeline.submit("ARTICLE 1", group.get_token());
+    pipeline.submit("ARTICLE 2", group.get_token());
+    const RequestId next = pipeline.submit("GROUP misc.test");
+
+    group.request_stop();
+
+    auto command = pipeline.send_next(T0);
+    ASSERT_TRUE(command);
+    EXPECT_EQ(next, command->id);
+    EXPECT_EQ(2U, pipeline.dropped());
+}
+
+TEST(TestCommandPipelineCancel, purgeDropsStoppedCommandsEagerly)
+{
+    CommandPipeline pipeline;
+    std::stop_source group;
+    for (int i = 1; i <= 100; ++i)
+    {
+        pipeline.submit("ARTICLE " + std::to_string(i), group.get_token());
+    }
+    pipeline.submit("GROUP misc.test");
+
+    group.request_stop();
+
+    EXPECT_EQ(100U, pipeline.purge());
+    EXPECT_EQ(1U, pipeline.queued());
+}
+
+TEST(TestCommandPipelineCancel, stoppedTokenDiscardsInFlightResponse)
+{
+    CommandPipeline pipeline(fixed_window(4));
+    std::stop_source group;
+    pipeline.submit("ARTICLE 1", group.get_token());
+    const RequestId next = pipeline.submit("GROUP misc.test");
+    pipeline.send_next(T0);
+    pipeline.send_next(T0);
+
+    group.request_stop();
+
+    ASSERT_TRUE(pipeline.discarding());
+    ResponseSkipper skipper = pipeline.skip_response();
+    const std::string_view wire = "220 1 <a@b>\r\nSubject: x\r\n\r\nbody\r\n.\r\n211 5 1 5 misc.test\r\n";
+    const std::size_t used = skipper.consume(wire);
+    ASSERT_TRUE(skipper.done());
+    pipeline.complete(T0 + 10ms, used);
+
+    EXPECT_FALSE(pipeline.discarding());
+    EXPECT_EQ("211 5 1 5 misc.test\r\n", wire.substr(used));
+    EXPECT_EQ(next, pipeline.complete(T0 + 10ms, wire.size() - used));
+}
+
+TEST(TestCommandPipelineCancel, skipResponseWithoutCommandThrows)
+{
+    CommandPipeline pipeline;
+
+    EXPECT_THROW(pipeline.skip_response(), std::logic_error);
+}
@@ -0,0 +1,280 @@
+#include <nntp/FeedSender.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+using namespace nntp;
+
+namespace
+{
+
+const std::string_view ARTICLE_A{"Message-ID: <a@b>\r\n\r\nbody\r\n"};
+const std::string_view ARTICLE_B{"Message-ID: <c@d>\r\n\r\n..dot\r\n"};
+
+std::string joined(const std::vector<std::string_view> &buffers)
+{
+    std::string result;
+    for (std::string_view buffer : buffers)
+    {
+        result.append(buffer);
+    }
+    return result;
+}
+
+// Complete the MODE STREAM exchange that opens every streaming feed
+void negotiate(FeedSender &sender)
+{
+    ASSERT_EQ("MODE STREAM\r\n", joined(sender.prepare()));
+    sender.receive("203 Streaming permitted\r\n");
+}
+
+} // namespace
+
+TEST(TestFeedMode, streamingAdvertised)
+{
+    EXPECT_EQ(FeedMode::STREAMING, feed_mode("VERSION 2\r\nIHAVE\r\nSTREAMING\r\n"));
+    EXPECT_EQ(FeedMode::STREAMING, feed_mode("VERSION 2\nstreaming"));
+}
+
+TEST(TestFeedMode, fallsBackToIhave)
+{
+    EXPECT_EQ(FeedMode::IHAVE, feed_mode("VERSION 2\r\nIHAVE\r\nREADER\r\n"));
+    EXPECT_EQ(FeedMode::IHAVE, feed_mode(""));
+}
+
+TEST(TestFeedSenderOffer, articleWithoutCrLfThrows)
+{
+    FeedSender sender(FeedMode::STREAMING);
+
+    EXPECT_THROW(sender.offer(MessageId("<a@b>"), "body"), std::invalid_argument);
+}
+
+TEST(TestFeedSenderOffer, zeroWindowThrows)
+{
+    EXPECT_THROW(FeedSender(FeedMode::STREAMING, 0), std::invalid_argument);
+}
+
+TEST(TestFeedSenderOffer, zeroWindowIsIgnoredForIhave)
+{
+    FeedSender sender(FeedMode::IHAVE, 0);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+
+    EXPECT_EQ("IHAVE <a@b>\r\n", joined(sender.prepare()));
+}
+
+TEST(TestFeedSenderStreaming, checksArePipelined)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+
+    const std::vector<std::string_view> &buffers = sender.prepare();
+
+    ASSERT_EQ(1U, buffers.size());
+    EXPECT_EQ("CHECK <a@b>\r\nCHECK <c@d>\r\n", buffers[0]);
+    EXPECT_EQ(2U, sender.in_flight());
+    EXPECT_EQ(0U, sender.queued());
+}
+
+TEST(TestFeedSenderStreaming, windowLimitsChecks)
+{
+    FeedSender sender(FeedMode::STREAMING, 1);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+
+    EXPECT_EQ("CHECK <a@b>\r\n", joined(sender.prepare()));
+    EXPECT_TRUE(sender.prepare().empty());
+    EXPECT_EQ(1U, sender.queued());
+}
+
+TEST(TestFeedSenderStreaming, transfersDoNotCountAgainstWindow)
+{
+    FeedSender sender(FeedMode::STREAMING, 1);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+    sender.prepare();
+    sender.receive("238 <a@b>\r\n");
+
+    // The TAKETHIS for <a@b> and the CHECK for <c@d> go out together
+    const std::string sent = joined(sender.prepare());
+    EXPECT_NE(std::string::npos, sent.find("TAKETHIS <a@b>\r\n"));
+    EXPECT_NE(std::string::npos, sent.find("CHECK <c@d>\r\n"));
+    EXPECT_EQ(2U, sender.in_flight());
+}
+
+TEST(TestFeedSenderStreaming, wantedArticleIsSentWithTakethis)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.prepare();
+
+    const std::string_view response = "238 <a@b>\r\n";
+    EXPECT_EQ(response.size(), sender.receive(response));
+    const std::vector<std::string_view> &buffers = sender.prepare();
+
+    ASSERT_EQ(3U, buffers.size());
+    EXPECT_EQ("TAKETHIS <a@b>\r\n", buffers[0]);
+    EXPECT_EQ(ARTICLE_A.data(), buffers[1].data());
+    EXPECT_EQ(".\r\n", buffers[2]);
+}
+
+TEST(TestFeedSenderStreaming, outcomesAreTrackedPerId)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+    sender.offer(MessageId("<e@f>"), ARTICLE_A);
+    sender.prepare();
+
+    sender.receive("238 <a@b>\r\n438 <c@d>\r\n431 <e@f>\r\n");
+    sender.prepare();
+    sender.receive("239 <a@b>\r\n");
+
+    const std::vector<FeedResult> results = sender.take_results();
+    ASSERT_EQ(3U, results.size());
+    EXPECT_EQ(MessageId("<c@d>"), results[0].id);
+    EXPECT_EQ(FeedOutcome::REFUSED, results[0].outcome);
+    EXPECT_EQ(MessageId("<e@f>"), results[1].id);
+    EXPECT_EQ(FeedOutcome::DEFERRED, results[1].outcome);
+    EXPECT_EQ(MessageId("<a@b>"), results[2].id);
+    EXPECT_EQ(FeedOutcome::ACCEPTED, results[2].outcome);
+    EXPECT_EQ(239, results[2].status);
+    EXPECT_TRUE(sender.idle());
+    EXPECT_TRUE(sender.take_results().empty());
+}
+
+TEST(TestFeedSenderStreaming, rejectedTransfer)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.prepare();
+    sender.receive("238 <a@b>\r\n");
+    sender.prepare();
+
+    sender.receive("439 <a@b>\r\n");
+
+    EXPECT_EQ(1U, sender.count(FeedOutcome::REJECTED));
+    EXPECT_EQ(0U, sender.count(FeedOutcome::ACCEPTED));
+}
+
+TEST(TestFeedSenderStreaming, mismatchedIdFailsEverythingInFlight)
+{
+    FeedSender sender(FeedMode::STREAMING, 2);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+    sender.offer(MessageId("<e@f>"), ARTICLE_A);
+    sender.prepare();
+
+    sender.receive("238 <c@d>\r\n438 <c@d>\r\n");
+
+    EXPECT_TRUE(sender.desynchronized());
+    EXPECT_EQ(2U, sender.count(FeedOutcome::FAILED));
+    EXPECT_EQ(1U, sender.count(FeedOutcome::DEFERRED));
+    EXPECT_TRUE(sender.idle());
+    EXPECT_TRUE(sender.prepare().empty());
+
+    sender.offer(MessageId("<g@h>"), ARTICLE_B);
+    EXPECT_TRUE(sender.prepare().empty());
+    EXPECT_EQ(2U, sender.count(FeedOutcome::DEFERRED));
+}
+
+TEST(TestFeedSenderStreaming, partialLineIsNotConsumed)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    negotiate(sender);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.prepare();
+
+    EXPECT_EQ(0U, sender.receive("438 <a@"));
+    EXPECT_EQ(1U, sender.in_flight());
+    EXPECT_EQ(11U, sender.receive("438 <a@b>\r\n"));
+    EXPECT_EQ(1U, sender.count(FeedOutcome::REFUSED));
+}
+
+TEST(TestFeedSenderStreaming, modeStreamPrecedesChecks)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+
+    EXPECT_EQ("MODE STREAM\r\n", joined(sender.prepare()));
+    EXPECT_TRUE(sender.prepare().empty());
+    EXPECT_FALSE(sender.idle());
+
+    sender.receive("203 Streaming permitted\r\n");
+    EXPECT_EQ(FeedMode::STREAMING, sender.mode());
+    EXPECT_EQ("CHECK <a@b>\r\n", joined(sender.prepare()));
+}
+
+TEST(TestFeedSenderStreaming, refusedModeStreamFallsBackToIhave)
+{
+    FeedSender sender(FeedMode::STREAMING);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+    sender.prepare();
+
+    sender.receive("501 Unknown MODE variant\r\n");
+
+    EXPECT_EQ(FeedMode::IHAVE, sender.mode());
+    EXPECT_EQ("IHAVE <a@b>\r\n", joined(sender.prepare()));
+    EXPECT_TRUE(sender.prepare().empty());
+    EXPECT_TRUE(sender.take_results().empty());
+}
+
+TEST(TestFeedSenderIhave, offersOneArticleAtATime)
+{
+    FeedSender sender(FeedMode::IHAVE);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+
+    EXPECT_EQ("IHAVE <a@b>\r\n", joined(sender.prepare()));
+    EXPECT_TRUE(sender.prepare().empty());
+
+    sender.receive("335 Send it\r\n");
+    EXPECT_EQ(std::string(ARTICLE_A) + ".\r\n", joined(sender.prepare()));
+
+    sender.receive("235 Article transferred OK\r\n");
+    EXPECT_EQ("IHAVE <c@d>\r\n", joined(sender.prepare()));
+
+    sender.receive("435 Article not wanted\r\n");
+    EXPECT_EQ(1U, sender.count(FeedOutcome::ACCEPTED));
+    EXPECT_EQ(1U, sender.count(FeedOutcome::REFUSED));
+    EXPECT_TRUE(sender.idle());
+}
+
+TEST(TestFeedSenderIhave, transferFailures)
+{
+    FeedSender sender(FeedMode::IHAVE);
+    sender.offer(MessageId("<a@b>"), ARTICLE_A);
+    sender.offer(MessageId("<c@d>"), ARTICLE_B);
+    sender.offer(MessageId("<e@f>"), ARTICLE_A);
+
+    sender.prepare();
+    sender.receive("436 Retry later\r\n");
+    sender.prepare();
+    sender.receive("335 Send it\r\n");
+    sender.prepare();
+    sender.receive("437 Rejected\r\n");
+    sender.prepare();
+    sender.receive("502 Permission denied\r\n");
+
+    EXPECT_EQ(1U, sender.count(FeedOutcome::DEFERRED));
+    EXPECT_EQ(1U, sender.count(FeedOutcome::REJECTED));
+    EXPECT_EQ(1U, sender.count(FeedOutcome::FAILED));
+}
+
+TEST(TestFeedSender, unsolicitedResponseIsIgnored)
+{
+    FeedSender sender(FeedMode::STREAMING);
+
+    EXPECT_EQ(21U, sender.receive("400 Shutting down\r\n\r\n"));
+    EXPECT_TRUE(sender.take_results().empty());
+}
@@ -0,0 +1,215 @@
+#include <nntp/PipelineWindow.h>
+
+#include <gtest/gtest.h>
+
+using namespace nntp;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+using Clock = PipelineWindow::Clock;
+
+const Clock::time_point T0{std::chrono::hours(1)};
+
+PipelineLimits limits(std::size_t floor, std::size_t ceiling, std::size_t initial)
+{
+    PipelineLimits result;
+    result.floor = floor;
+    result.ceiling = ceiling;
+    result.initial = initial;
+    return result;
+}
+
+// Fill the window, then answer every command after rtt
+Clock::time_point round_trip(PipelineWindow &window, Clock::time_point now, Clock::duration rtt)
+{
+    std::size_t sent = 0;
+    while (window.can_send())
+    {
+        window.on_send();
+        ++sent;
+    }
+    for (std::size_t i = 0; i < sent; ++i)
+    {
+        window.on_response(now, now + rtt, 1000);
+    }
+    return now + rtt;
+}
+
+} // namespace
+
+TEST(TestPipelineWindowConstruct, defaultLimits)
+{
+    PipelineWindow window;
+
+    EXPECT_EQ(2U, window.depth());
+    EXPECT_EQ(0U, window.in_flight());
+    EXPECT_TRUE(window.can_send());
+}
+
+TEST(TestPipelineWindowConstruct, initialClampedToCeiling)
+{
+    PipelineWindow window(limits(1, 4, 10));
+
+    EXPECT_EQ(4U, window.depth());
+}
+
+TEST(TestPipelineWindowConstruct, initialClampedToFloor)
+{
+    PipelineWindow window(limits(3, 8, 1));
+
+    EXPECT_EQ(3U, window.depth());
+}
+
+TEST(TestPipelineWindowConstruct, zeroFloorThrows)
+{
+    EXPECT_THROW(PipelineWindow(limits(0, 8, 2)), std::invalid_argument);
+}
+
+TEST(TestPipelineWindowConstruct, floorAboveCeilingThrows)
+{
+    EXPECT_THROW(PipelineWindow(limits(9, 8, 2)), std::invalid_argument);
+}
+
+TEST(TestPipelineWindowConstruct, invalidDecreaseFactorThrows)
+{
+    PipelineLimits bad;
+    bad.decrease_factor = 1.0;
+
+    EXPECT_THROW(PipelineWindow{bad}, std::invalid_argument);
+}
+
+TEST(TestPipelineWindowSend, windowLimitsInFlight)
+{
+    PipelineWindow window(limits(1, 8, 2));
+
+    window.on_send();
+    window.on_send();
+
+    EXPECT_EQ(2U, window.in_flight());
+    EXPECT_FALSE(window.can_send());
+}
+
+TEST(TestPipelineWindowGrow, slowStartDoublesPerRoundTrip)
+{
+    PipelineWindow window(limits(1, 64, 2));
+
+    Clock::time_point now = round_trip(window, T0, 50ms);
+    EXPECT_EQ(4U, window.depth());
+
+    round_trip(window, now, 50ms);
+    EXPECT_EQ(8U, window.depth());
+    EXPECT_TRUE(window.metrics().slow_start);
+}
+
+TEST(TestPipelineWindowGrow, neverExceedsCeiling)
+{
+    PipelineWindow window(limits(1, 10, 2));
+
+    Clock::time_point now = T0;
+    for (int i = 0; i < 20; ++i)
+    {
+        now = round_trip(window, now, 50ms);
+    }
+
+    EXPECT_EQ(10U, window.depth());
+}
+
+TEST(TestPipelineWindowGrow, applicationLimitedDoesNotGrow)
+{
+    PipelineWindow window(limits(1, 64, 4));
+
+    // Only one command outstanding at a time: the window is never the bottleneck
+    for (int i = 0; i < 10; ++i)
+    {
+        window.on_send();
+        window.on_response(T0 + i * 50ms, T0 + i * 50ms + 50ms, 1000);
+    }
+
+    EXPECT_EQ(4U, window.depth());
+}
+
+TEST(TestPipelineWindowShrink, queueingDelayShrinksWindow)
+{
+    PipelineWindow window(limits(1, 64, 2));
+    Clock::time_point now = T0;
+    for (int i = 0; i < 4; ++i)
+    {
+        now = round_trip(window, now, 20ms);
+    }
+    const std::size_t grown = window.depth();
+
+    // Responses now take five times as long as the best observed round trip
+    for (int i = 0; i < 10; ++i)
+    {
+        now = round_trip(window, now, 100ms);
+    }
+
+    EXPECT_LT(window.depth(), grown);
+    EXPECT_FALSE(window.metrics().slow_start);
+    EXPECT_GT(window.metrics().decreases, 0U);
+}
+
+TEST(TestPipelineWindowShrink, neverBelowFloor)
+{
+    PipelineWindow window(limits(3, 64, 8));
+
+    Clock::time_point now = T0;
+    for (int i = 0; i < 20; ++i)
+    {
+        window.on_overload(now);
+        now += 1s;
+    }
+
+    EXPECT_EQ(3U, window.depth());
+}
+
+TEST(TestPipelineWindowShrink, overloadAtMostOncePerRoundTrip)
+{
+    PipelineWindow window(limits(1, 64, 2));
+    Clock::time_point now = T0;
+    for (int i = 0; i < 4; ++i)
+    {
+        now = round_trip(window, now, 20ms);
+    }
+    const std::size_t grown = window.depth();
+
+    window.on_overload(now);
+    const std::size_t once = window.depth();
+    window.on_overload(now + 1ms);
+
+    EXPECT_LT(once, grown);
+    EXPECT_EQ(once, window.depth());
+    EXPECT_EQ(1U, window.metrics().decreases);
+}
+
+TEST(TestPipelineWindowShrink, additiveIncreaseAfterBackoff)
+{
+    PipelineWindow window(limits(1, 64, 16));
+    window.on_overload(T0);
+    const std::size_t backed_off = window.depth();
+
+    round_trip(window, T0 + 1s, 20ms);
+
+    EXPECT_EQ(backed_off + 1, window.depth());
+}
+
+TEST(TestPipelineWindowMetrics, reportsRoundTripAndThroughput)
+{
+    PipelineWindow window(limits(1, 64, 2));
+
+    Clock::time_point now = T0;
+    for (int i = 0; i < 4; ++i)
+    {
+        now = round_trip(window, now, 10ms);
+    }
+    const PipelineMetrics metrics = window.metrics();
+
+    EXPECT_EQ(10000, metrics.min_rtt.count());
+    EXPECT_EQ(10000, metrics.smoothed_rtt.count());
+    EXPECT_GT(metrics.throughput, 0.0);
+    EXPECT_EQ(window.depth(), metrics.depth);
+    EXPECT_EQ(0U, metrics.in_flight);
+    EXPECT_EQ(30U, metrics.responses);
+}
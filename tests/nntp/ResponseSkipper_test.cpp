@@ -0,0 +1,123 @@
+#include <nntp/ResponseSkipper.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+using namespace nntp;
+
+TEST(TestIsMultiline, articleBodyIsMultiline)
+{
+    EXPECT_TRUE(is_multiline("ARTICLE 1", 220));
+    EXPECT_TRUE(is_multiline("HEAD 1", 221));
+    EXPECT_TRUE(is_multiline("BODY 1", 222));
+    EXPECT_TRUE(is_multiline("OVER 1-10", 224));
+}
+
+TEST(TestIsMultiline, errorsAreSingleLine)
+{
+    EXPECT_FALSE(is_multiline("ARTICLE 1", 423));
+    EXPECT_FALSE(is_multiline("ARTICLE <a@b>", 430));
+    EXPECT_FALSE(is_multiline("STAT 1", 223));
+}
+
+TEST(TestIsMultiline, groupIsSingleLine)
+{
+    EXPECT_FALSE(is_multiline("GROUP misc.test", 211));
+}
+
+TEST(TestIsMultiline, listgroupIsMultiline)
+{
+    EXPECT_TRUE(is_multiline("LISTGROUP misc.test", 211));
+    EXPECT_TRUE(is_multiline("listgroup", 211));
+}
+
+TEST(TestResponseSkipper, singleLineResponse)
+{
+    ResponseSkipper skipper("ARTICLE <a@b>");
+
+    const std::size_t used = skipper.consume("430 No such article\r\n");
+
+    EXPECT_TRUE(skipper.done());
+    EXPECT_EQ(430, skipper.status());
+    EXPECT_EQ(21U, used);
+}
+
+TEST(TestResponseSkipper, multiLineResponse)
+{
+    ResponseSkipper skipper("HEAD 1");
+    const std::string_view response = "221 1 <a@b>\r\nSubject: x\r\nFrom: y\r\n.\r\n";
+
+    const std::size_t used = skipper.consume(response);
+
+    EXPECT_TRUE(skipper.done());
+    EXPECT_EQ(221, skipper.status());
+    EXPECT_EQ(response.size(), used);
+    EXPECT_EQ(response.size(), skipper.consumed());
+}
+
+TEST(TestResponseSkipper, emptyBody)
+{
+    ResponseSkipper skipper("LISTGROUP misc.test");
+    const std::string_view response = "211 0 0 0 misc.test\r\n.\r\n";
+
+    EXPECT_EQ(response.size(), skipper.consume(response));
+    EXPECT_TRUE(skipper.done());
+}
+
+TEST(TestResponseSkipper, stopsAtEndOfResponse)
+{
+    ResponseSkipper skipper("BODY 1");
+    const std::string_view body = "222 1 <a@b>\r\nline\r\n.\r\n";
+    const std::string pipelined = std::string(body) + "222 2 <c@d>\r\n";
+
+    EXPECT_EQ(body.size(), skipper.consume(pipelined));
+    EXPECT_TRUE(skipper.done());
+}
+
+TEST(TestResponseSkipper, dotStuffedLinesAreNotTerminators)
+{
+    ResponseSkipper skipper("BODY 1");
+    const std::string_view response = "222 1 <a@b>\r\n..\r\n.x\r\n.\r\n";
+
+    EXPECT_EQ(response.size(), skipper.consume(response));
+    EXPECT_TRUE(skipper.done());
+}
+
+TEST(TestResponseSkipper, responseSplitAcrossEveryByte)
+{
+    ResponseSkipper skipper("ARTICLE 1");
+    const std::string_view response = "220 1 <a@b>\r\nSubject: x\r\n\r\nbody\r\n.\r\n";
+
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < response.size(); ++i)
+    {
+        EXPECT_FALSE(skipper.done());
+        used += skipper.consume(response.substr(i, 1));
+    }
+
+    EXPECT_TRUE(skipper.done());
+    EXPECT_EQ(response.size(), used);
+}
+
+TEST(TestResponseSkipper, terminatorSplitAcrossReads)
+{
+    ResponseSkipper skipper("BODY 1");
+
+    skipper.consume("222 1 <a@b>\r\nline\r");
+    EXPECT_FALSE(skipper.done());
+    skipper.consume("\n.");
+    EXPECT_FALSE(skipper.done());
+    skipper.consume("\r\n");
+
+    EXPECT_TRUE(skipper.done());
+}
+
+TEST(TestResponseSkipper, doneConsumesNothing)
+{
+    ResponseSkipper skipper("STAT 1");
+    skipper.consume("223 1 <a@b>\r\n");
+
+    EXPECT_EQ(0U, skipper.consume("223 2 <c@d>\r\n"));
+}
@@ -0,0 +1,273 @@
+#include <storage/cyclic_spool.h>
+#include <boost/corosio/io_context.hpp>
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace nntp;
+using namespace boost;
+
+namespace
+{
+
+std::vector<std::filesystem::path> spool_paths(std::string const& name, std::size_t count)
+{
+    std::vector<std::filesystem::path> paths;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        paths.push_back(std::filesystem::temp_directory_path() / (name + std::to_string(i) + ".cyc"));
+        std::filesystem::remove(paths.back());
+    }
+    return paths;
+}
+
+void remove_all(std::vector<std::filesystem::path> const& paths)
+{
+    for (auto const& path : paths)
+        std::filesystem::remove(path);
+}
+
+std::string make_article(std::size_t n, std::size_t size)
+{
+    std::string article = "Message-ID: <" + std::to_string(n) + "@example.net>\r\n\r\n";
+    article.resize(size, static_cast<char>('a' + n % 26));
+    return article;
+}
+
+} // namespace
+
+TEST(CyclicSpool, StoreAndRetrieve)
+{
+    corosio::io_context ctx;
+    auto paths = spool_paths("test_spool_basic", 2);
+
+    auto task = [&]() -> capy::task<>
+    {
+        cyclic_spool spool(ctx);
+        EXPECT_FALSE(co_await spool.open(paths, 1024 * 1024));
+        EXPECT_TRUE(spool.is_open());
+
+        std::vector<spool_token> tokens(50);
+        for (std::size_t i = 0; i < tokens.size(); ++i)
+            EXPECT_FALSE(co_await spool.store(make_article(i, 100 + 37 * i), tokens[i]));
+        EXPECT_GT(spool.staged(), 0u);
+
+        // Staged articles are served from memory, flushed ones from the file
+        std::string article;
+        EXPECT_FALSE(co_await spool.retrieve(tokens[3], article));
+        EXPECT_EQ(article, make_article(3, 100 + 37 * 3));
+
+        EXPECT_FALSE(co_await spool.flush());
+        EXPECT_EQ(spool.staged(), 0u);
+        for (std::size_t i = 0; i < tokens.size(); ++i)
+        {
+            EXPECT_FALSE(co_await spool.retrieve(tokens[i], article));
+            EXPECT_EQ(article, make_article(i, 100 + 37 * i));
+            EXPECT_EQ(tokens[i].offset % cyclic_spool::record_alignment, 0u);
+        }
+
+        // Tokens that never came from the spool find nothing
+        spool_token bogus = tokens[0];
+        bogus.cycle += 1;
+        EXPECT_EQ(co_await spool.retrieve(bogus, article), std::errc::no_message_available);
+        bogus = tokens[0];
+        bogus.buffer = 7;
+        EXPECT_EQ(co_await spool.retrieve(bogus, article), std::errc::no_message_available);
+
+        EXPECT_FALSE(co_await spool.close());
+        EXPECT_FALSE(spool.is_open());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    EXPECT_EQ(std::filesystem::file_size(paths[0]), 1024 * 1024u);
+    remove_all(paths);
+}
+
+TEST(CyclicSpool, ReopenResumesWriting)
+{
+    corosio::io_context ctx;
+    auto paths = spool_paths("test_spool_reopen", 2);
+
+    auto task = [&]() -> capy::task<>
+    {
+        spool_token first;
+        {
+            cyclic_spool spool(ctx);
+            EXPECT_FALSE(co_await spool.open(paths, 64 * 1024));
+            EXPECT_FALSE(co_await spool.store(make_article(1, 3000), first));
+            EXPECT_FALSE(co_await spool.close());
+        }
+
+        cyclic_spool spool(ctx);
+        EXPECT_FALSE(co_await spool.open(paths, 64 * 1024));
+
+        std::string article;
+        EXPECT_FALSE(co_await spool.retrieve(first, article));
+        EXPECT_EQ(article, make_article(1, 3000));
+
+        spool_token second;
+        EXPECT_FALSE(co_await spool.store(make_article(2, 10), second));
+        EXPECT_EQ(second.buffer, first.buffer);
+        EXPECT_EQ(second.cycle, first.cycle);
+        EXPECT_GT(second.offset, first.offset);
+        EXPECT_FALSE(co_await spool.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    remove_all(paths);
+}
+
+TEST(CyclicSpool, ReopenAfterCrashStartsNewCycle)
+{
+    corosio::io_context ctx;
+    auto paths = spool_paths("test_spool_crash", 2);
+
+    auto task = [&]() -> capy::task<>
+    {
+        spool_token flushed, lost;
+        {
+            cyclic_spool spool(ctx);
+            EXPECT_FALSE(co_await spool.open(paths, 64 * 1024));
+            EXPECT_FALSE(co_await spool.store(make_article(1, 3000), flushed));
+            EXPECT_FALSE(co_await spool.flush());
+            EXPECT_FALSE(co_await spool.store(make_article(2, 3000), lost));
+
+            // Destroyed without close(), as if the process had died
+        }
+
+        cyclic_spool spool(ctx);
+        EXPECT_FALSE(co_await spool.open(paths, 64 * 1024));
+
+        std::string article;
+        EXPECT_FALSE(co_await spool.retrieve(flushed, article));
+        EXPECT_EQ(article, make_article(1, 3000));
+
+        // The lost article's space is not reused under its cycle
+        spool_token next;
+        EXPECT_FALSE(co_await spool.store(make_article(3, 3000), next));
+        EXPECT_NE(next.buffer, lost.buffer);
+        EXPECT_GT(next.cycle, lost.cycle);
+        EXPECT_EQ(co_await spool.retrieve(lost, article), std::errc::no_message_available);
+        EXPECT_FALSE(co_await spool.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    remove_all(paths);
+}
+
+TEST(CyclicSpool, WrapOverwritesOldest)
+{
+    corosio::io_context ctx;
+    auto paths = spool_paths("test_spool_wrap", 2);
+
+    auto task = [&]() -> capy::task<>
+    {
+        // Two small buffers and a small batch wrap after a few dozen articles
+        cyclic_spool spool(ctx, 4096);
+        EXPECT_FALSE(co_await spool.open(paths, 32 * 1024));
+
+        std::vector<spool_token> tokens(100);
+        for (std::size_t i = 0; i < tokens.size(); ++i)
+            EXPECT_FALSE(co_await spool.store(make_article(i, 900), tokens[i]));
+        EXPECT_GT(tokens.back().cycle, 2u);
+
+        std::string article;
+        EXPECT_EQ(co_await spool.retrieve(tokens.front(), article), std::errc::no_message_available);
+        EXPECT_TRUE(article.empty());
+
+        // The lap before the current one survives past the current
+        // position; anything older is gone
+        EXPECT_EQ(tokens[50].buffer, tokens.back().buffer);
+        EXPECT_EQ(tokens[50].cycle + paths.size(), tokens.back().cycle);
+        EXPECT_FALSE(co_await spool.retrieve(tokens[50], article));
+        EXPECT_EQ(article, make_article(50, 900));
+        spool_token stale = tokens[50];
+        stale.cycle -= paths.size();
+        EXPECT_EQ(co_await spool.retrieve(stale, article), std::errc::no_message_available);
+        for (std::size_t i = tokens.size() - 10; i < tokens.size(); ++i)
+        {
+            EXPECT_FALSE(co_await spool.retrieve(tokens[i], article));
+            EXPECT_EQ(article, make_article(i, 900));
+        }
+        EXPECT_FALSE(co_await spool.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    remove_all(paths);
+}
+
+TEST(CyclicSpool, LargeArticlesBypassTheBatch)
+{
+    corosio::io_context ctx;
+    auto paths = spool_paths("test_spool_large", 1);
+
+    auto task = [&]() -> capy::task<>
+    {
+        cyclic_spool spool(ctx, 4096);
+        EXPECT_FALSE(co_await spool.open(paths, 256 * 1024));
+
+        spool_token small, large, after;
+        EXPECT_FALSE(co_await spool.store(make_article(1, 200), small));
+        EXPECT_FALSE(co_await spool.store(make_article(2, 50000), large));
+        EXPECT_FALSE(co_await spool.store(make_article(3, 200), after));
+
+        std::string article;
+        EXPECT_FALSE(co_await spool.retrieve(large, article));
+        EXPECT_EQ(article, make_article(2, 50000));
+        EXPECT_FALSE(co_await spool.retrieve(small, article));
+        EXPECT_EQ(article, make_article(1, 200));
+        EXPECT_FALSE(co_await spool.retrieve(after, article));
+        EXPECT_EQ(article, make_article(3, 200));
+
+        // Nothing larger than a buffer can be stored
+        spool_token token;
+        EXPECT_EQ(co_await spool.store(std::string(256 * 1024, 'x'), token), std::errc::message_size);
+        EXPECT_FALSE(co_await spool.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    remove_all(paths);
+}
+
+TEST(CyclicSpool, RejectsBadArguments)
+{
+    corosio::io_context ctx;
+    EXPECT_THROW(cyclic_spool(ctx, 1000), std::invalid_argument);
+
+    auto paths = spool_paths("test_spool_bad", 1);
+    {
+        std::ofstream out(paths[0], std::ios::binary);
+        out << std::string(8192, 'x');
+    }
+
+    auto task = [&]() -> capy::task<>
+    {
+        cyclic_spool spool(ctx);
+        EXPECT_EQ(co_await spool.open({}, 64 * 1024), std::errc::invalid_argument);
+        EXPECT_EQ(co_await spool.open(paths, 1000), std::errc::invalid_argument);
+        EXPECT_EQ(co_await spool.open(paths, 64 * 1024), std::errc::illegal_byte_sequence);
+        EXPECT_FALSE(spool.is_open());
+
+        spool_token token;
+        EXPECT_EQ(co_await spool.store("article", token), std::errc::bad_file_descriptor);
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    remove_all(paths);
+}
@@ -0,0 +1,244 @@
+#include <storage/overview_db.h>
+#include <boost/corosio/io_context.hpp>
+#include <boost/capy/ex/run_async.hpp>
+#include <boost/capy/task.hpp>
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace nntp;
+using namespace boost;
+
+namespace
+{
+
+std::filesystem::path db_directory(std::string const& name)
+{
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(path);
+    return path;
+}
+
+std::string make_overview(Article::ValueType n)
+{
+    return std::to_string(n) + "\tSubject " + std::to_string(n) + "\tposter@example.net\t<" +
+        std::to_string(n) + "@example.net>\t\t1234\t42";
+}
+
+std::vector<Article::ValueType> numbers(std::vector<overview_record> const& records)
+{
+    std::vector<Article::ValueType> result;
+    for (auto const& r : records)
+        result.push_back(r.article.value());
+    return result;
+}
+
+} // namespace
+
+TEST(OverviewDb, AddAndQueryRanges)
+{
+    corosio::io_context ctx;
+    auto dir = db_directory("test_overview_basic");
+
+    auto task = [&]() -> capy::task<>
+    {
+        overview_db db(ctx, dir);
+        Newsgroup const group("comp.lang.c++");
+
+        // Numbering starts wherever the group's first article does,
+        // and gaps are missing articles
+        for (Article::ValueType n = 1000; n < 1100; ++n)
+        {
+            if (n % 10 != 3)
+                EXPECT_FALSE(co_await db.add(group, Article(n), make_overview(n)));
+        }
+        EXPECT_GT(db.staged(), 0u);
+
+        std::vector<overview_record> records;
+        std::string buffer;
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1001), Article(1005)), records, buffer));
+        EXPECT_EQ(numbers(records), (std::vector<Article::ValueType>{1001, 1002, 1004, 1005}));
+        EXPECT_EQ(records[0].data, make_overview(1001));
+        EXPECT_EQ(records[3].data, make_overview(1005));
+        EXPECT_EQ(db.staged(), 0u);
+
+        // Ranges are clipped to the articles the group has
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1), Article(1001)), records, buffer));
+        EXPECT_EQ(numbers(records), (std::vector<Article::ValueType>{1000, 1001}));
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1097)), records, buffer));
+        EXPECT_EQ(numbers(records), (std::vector<Article::ValueType>{1097, 1098, 1099}));
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(5000), Article(6000)), records, buffer));
+        EXPECT_TRUE(records.empty());
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1), Article(999)), records, buffer));
+        EXPECT_TRUE(records.empty());
+
+        // Groups are independent, and unknown ones are empty
+        EXPECT_FALSE(co_await db.add(Newsgroup("alt.test"), Article(1), "only"));
+        EXPECT_FALSE(co_await db.query(Newsgroup("alt.test"), ArticleRange(Article(1)), records, buffer));
+        ASSERT_EQ(records.size(), 1u);
+        EXPECT_EQ(records[0].data, "only");
+        EXPECT_FALSE(co_await db.query(Newsgroup("no.such.group"), ArticleRange(Article(1)), records, buffer));
+        EXPECT_TRUE(records.empty());
+        EXPECT_FALSE(std::filesystem::exists(dir / "no.such.group.idx"));
+
+        EXPECT_FALSE(co_await db.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(OverviewDb, ReopenAndReplace)
+{
+    corosio::io_context ctx;
+    auto dir = db_directory("test_overview_reopen");
+
+    auto task = [&]() -> capy::task<>
+    {
+        Newsgroup const group("misc.test");
+        {
+            overview_db db(ctx, dir);
+            for (Article::ValueType n = 1; n <= 20; ++n)
+                EXPECT_FALSE(co_await db.add(group, Article(n), make_overview(n)));
+            EXPECT_FALSE(co_await db.close());
+        }
+
+        overview_db db(ctx, dir);
+        EXPECT_FALSE(co_await db.add(group, Article(21), make_overview(21)));
+        EXPECT_FALSE(co_await db.add(group, Article(5), "replaced"));
+
+        std::vector<overview_record> records;
+        std::string buffer;
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1)), records, buffer));
+        ASSERT_EQ(records.size(), 21u);
+        EXPECT_EQ(records[4].data, "replaced");
+        EXPECT_EQ(records[19].data, make_overview(20));
+        EXPECT_EQ(records[20].data, make_overview(21));
+
+        // A replaced record followed by a later article leaves the
+        // written entries between them alone
+        EXPECT_FALSE(co_await db.add(group, Article(7), "again 7"));
+        EXPECT_FALSE(co_await db.add(group, Article(22), make_overview(22)));
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1)), records, buffer));
+        ASSERT_EQ(records.size(), 22u);
+        EXPECT_EQ(records[6].data, "again 7");
+        for (Article::ValueType n = 8; n <= 22; ++n)
+            EXPECT_EQ(records[n - 1].data, make_overview(n));
+
+        // A replaced record is read on its own, not along with all
+        // the data added after its first copy
+        for (Article::ValueType n = 23; n <= 300; ++n)
+            EXPECT_FALSE(co_await db.add(group, Article(n), make_overview(n)));
+        EXPECT_FALSE(co_await db.add(group, Article(2), "again"));
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1), Article(2)), records, buffer));
+        ASSERT_EQ(records.size(), 2u);
+        EXPECT_EQ(records[0].data, make_overview(1));
+        EXPECT_EQ(records[1].data, "again");
+        EXPECT_EQ(buffer.size(), records[0].data.size() + records[1].data.size());
+        EXPECT_FALSE(co_await db.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(OverviewDb, SmallBatchesAndLargeGaps)
+{
+    corosio::io_context ctx;
+    auto dir = db_directory("test_overview_batches");
+
+    auto task = [&]() -> capy::task<>
+    {
+        // A batch of a few entries writes every few additions, and a
+        // gap wider than the batch leaves a hole in the index
+        overview_db db(ctx, dir, 256);
+        Newsgroup const group("alt/odd%name");
+        std::vector<Article::ValueType> added;
+        for (Article::ValueType n : {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 100000, 100001})
+        {
+            EXPECT_FALSE(co_await db.add(group, Article(n), make_overview(n)));
+            added.push_back(n);
+            EXPECT_LT(db.staged(), 256u);
+        }
+
+        std::vector<overview_record> records;
+        std::string buffer;
+        EXPECT_FALSE(co_await db.query(group, ArticleRange(Article(1)), records, buffer));
+        EXPECT_EQ(numbers(records), added);
+        for (auto const& r : records)
+            EXPECT_EQ(r.data, make_overview(r.article.value()));
+        EXPECT_TRUE(std::filesystem::exists(dir / "alt%2Fodd%25name.idx"));
+        EXPECT_FALSE(co_await db.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(OverviewDb, ClosesLeastRecentlyUsedGroups)
+{
+    corosio::io_context ctx;
+    auto dir = db_directory("test_overview_lru");
+
+    auto task = [&]() -> capy::task<>
+    {
+        overview_db db(ctx, dir, overview_db::default_batch_size, 2);
+        Newsgroup const a("alt.a"), b("alt.b"), c("alt.c");
+        EXPECT_FALSE(co_await db.add(a, Article(1), make_overview(1)));
+        EXPECT_FALSE(co_await db.add(b, Article(1), make_overview(2)));
+        EXPECT_FALSE(co_await db.add(a, Article(2), make_overview(3)));
+
+        // b is the least recently used, so c's opening writes and closes it
+        EXPECT_FALSE(co_await db.add(c, Article(1), make_overview(4)));
+        EXPECT_EQ(db.open_groups(), 2u);
+
+        std::vector<overview_record> records;
+        std::string buffer;
+        EXPECT_FALSE(co_await db.query(b, ArticleRange(Article(1)), records, buffer));
+        ASSERT_EQ(records.size(), 1u);
+        EXPECT_EQ(records[0].data, make_overview(2));
+        EXPECT_EQ(db.open_groups(), 2u);
+
+        // Reopening b closed a, whose staged records were written
+        // first; only c's record is still staged
+        EXPECT_EQ(db.staged(), make_overview(4).size() + overview_db::index_entry_size);
+        EXPECT_FALSE(co_await db.query(a, ArticleRange(Article(1)), records, buffer));
+        EXPECT_EQ(numbers(records), (std::vector<Article::ValueType>{1, 2}));
+        EXPECT_FALSE(co_await db.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(OverviewDb, RejectsBadArguments)
+{
+    corosio::io_context ctx;
+    auto dir = db_directory("test_overview_bad");
+    EXPECT_THROW(overview_db(ctx, dir, 8), std::invalid_argument);
+    EXPECT_THROW(overview_db(ctx, dir, overview_db::default_batch_size, 0), std::invalid_argument);
+
+    auto task = [&]() -> capy::task<>
+    {
+        overview_db db(ctx, dir);
+        Newsgroup const group("misc.test");
+        EXPECT_EQ(co_await db.add(group, Article(10), ""), std::errc::invalid_argument);
+        EXPECT_FALSE(co_await db.add(group, Article(10), make_overview(10)));
+        EXPECT_EQ(co_await db.add(group, Article(9), make_overview(9)), std::errc::argument_out_of_domain);
+        EXPECT_FALSE(co_await db.close());
+    };
+
+    capy::run_async(ctx.get_executor())(task());
+    ctx.run();
+
+    std::filesystem::remove_all(dir);
+}